@@ -0,0 +1,93 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+#include "hg-ctest-evtrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+char const * const EV_TRACE_FNAME = "ctest-evtrace";
+
+__thread struct ev_ring *ev_ring_self = NULL;
+
+/* every ring ever attached, newest first. Rings outlive their threads so
+ * they can be dumped after the threads are joined */
+static struct ev_ring *ev_rings = NULL;
+static int ev_num_rings = 0;
+
+static char const * const ev_names[EV_NUM_TYPES] = {
+    "forward", "bulk", "progress", "progress", "trigger", "callback",
+    "handler", "respond"
+};
+
+struct ev_ring *ev_ring_attach(void)
+{
+    struct ev_ring *r = malloc(sizeof(*r));
+
+    if (r == NULL)
+        return NULL;
+    r->head = 0;
+    r->tid = __sync_fetch_and_add(&ev_num_rings, 1);
+    do {
+        r->next = ev_rings;
+    } while (!__sync_bool_compare_and_swap(&ev_rings, r->next, r));
+    ev_ring_self = r;
+    return r;
+}
+
+int ev_trace_dump(char const *fname, double ns_per_tick)
+{
+    FILE *f;
+    struct ev_ring *r;
+    uint64_t i, first, t0 = UINT64_MAX;
+    int pid = (int) getpid();
+    int sep = 0;
+
+    if (ev_rings == NULL)
+        return 0;
+
+    /* timestamps are relative to the oldest surviving event */
+    for (r = ev_rings; r; r = r->next) {
+        first = r->head > EV_RING_SIZE ? r->head - EV_RING_SIZE : 0;
+        if (r->head > first && r->recs[first & (EV_RING_SIZE-1)].ticks < t0)
+            t0 = r->recs[first & (EV_RING_SIZE-1)].ticks;
+    }
+
+    f = fopen(fname, "w");
+    if (f == NULL)
+        return -1;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (r = ev_rings; r; r = r->next) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"thread %d%s\"}}",
+                sep ? ",\n" : "", pid, r->tid, r->tid,
+                r->head > EV_RING_SIZE ? " (wrapped)" : "");
+        sep = 1;
+        first = r->head > EV_RING_SIZE ? r->head - EV_RING_SIZE : 0;
+        for (i = first; i < r->head; i++) {
+            const struct ev_rec *e = &r->recs[i & (EV_RING_SIZE-1)];
+            char const *ph;
+
+            /* progress is a duration, the rest are instants */
+            if (e->type == EV_PROGRESS_ENTER)
+                ph = "B";
+            else if (e->type == EV_PROGRESS_EXIT)
+                ph = "E";
+            else
+                ph = "i";
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,"
+                    "\"pid\":%d,\"tid\":%d,%s\"args\":{\"arg\":%u}}",
+                    e->type < EV_NUM_TYPES ? ev_names[e->type] : "unknown",
+                    ph, (e->ticks - t0) * ns_per_tick / 1e3, pid, r->tid,
+                    ph[0] == 'i' ? "\"s\":\"t\"," : "", e->arg);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0 ? 0 : -1;
+}
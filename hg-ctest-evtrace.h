@@ -0,0 +1,90 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+#ifndef HG_CTEST_EVTRACE_H
+#define HG_CTEST_EVTRACE_H
+
+/* hot-path event tracing
+ *
+ * compiled in with TRACE=1 (make TRACE=yes, cmake -DTRACE=ON), otherwise
+ * trace_event() expands to nothing, like dprintf. Each thread appends
+ * fixed-size timestamped events to its own ring (no locks or atomics on
+ * the hot path - the ring is only read once the process is done with it),
+ * overwriting the oldest events when full. ev_trace_dump writes all rings
+ * out as Chrome / Perfetto trace JSON (load in chrome://tracing or
+ * ui.perfetto.dev). Kept free of mercury includes like hg-ctest-trace.h -
+ * timestamps are raw ticks_now() ticks (hg-ctest-util.h), converted at
+ * dump time */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+/* events per thread ring (16 bytes each), a power of two */
+#define EV_RING_SIZE (1 << 16)
+
+enum ev_type {
+    EV_FORWARD,        /* HG_Forward issued, arg: slot */
+    EV_BULK,           /* HG_Bulk_transfer issued, arg: slot */
+    EV_PROGRESS_ENTER, /* progress_wait entered, arg: timeout (ms) */
+    EV_PROGRESS_EXIT,  /* progress_wait returned, arg: hg_return_t */
+    EV_TRIGGER,        /* trigger_ready returned, arg: # callbacks run */
+    EV_CALLBACK,       /* completion callback entered, arg: slot */
+    EV_HANDLER,        /* server handler entered, arg: enum stat_rpc */
+    EV_RESPOND,        /* server response sent, arg: enum stat_rpc */
+    EV_NUM_TYPES
+};
+
+struct ev_rec {
+    uint64_t ticks;
+    uint32_t type;
+    uint32_t arg;
+};
+
+struct ev_ring {
+    uint64_t head; /* total events ever recorded */
+    int tid;       /* order of attachment, 0 is the first thread */
+    struct ev_ring *next;
+    struct ev_rec recs[EV_RING_SIZE];
+};
+
+extern __thread struct ev_ring *ev_ring_self;
+
+/* allocate the calling thread's ring and add it to the global list */
+struct ev_ring *ev_ring_attach(void);
+
+static inline void ev_record(uint64_t ticks, uint32_t type, uint32_t arg)
+{
+    struct ev_ring *r = ev_ring_self;
+    struct ev_rec *e;
+
+    if (r == NULL && (r = ev_ring_attach()) == NULL)
+        return;
+    e = &r->recs[r->head & (EV_RING_SIZE - 1)];
+    e->ticks = ticks;
+    e->type = type;
+    e->arg = arg;
+    r->head++;
+}
+
+#if TRACE
+#   define trace_event(_type, _arg) \
+    ev_record(ticks_now(), (_type), (uint32_t) (_arg))
+#else
+#   define trace_event(_type, _arg) do { } while (0)
+#endif
+
+/* write every ring's events to fname as Chrome trace JSON, returning 0 on
+ * success. Call once the traced threads are quiescent */
+int ev_trace_dump(char const *fname, double ns_per_tick);
+
+/* filename prefix for ^ - dumps go to <prefix>-<pid>.json */
+extern char const * const EV_TRACE_FNAME;
+
+#endif /* end of include guard: HG_CTEST_EVTRACE_H */
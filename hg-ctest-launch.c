@@ -0,0 +1,480 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+/* single-node launcher for hg-ctest4: forks one server and N clients, hands
+ * the server address to the clients through a pipe, optionally pins each
+ * process, and prints the clients' records (plus a merged summary) once
+ * everyone is done. With -c, a chain of proxy servers (--forward-to) sits
+ * between the clients and the server */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "hg-ctest-util.h"
+
+/* how long to wait for the server to come up (ms) */
+#define SERVER_ADDR_TIMEOUT 60000
+
+/* a forked benchmark process and the output we've read from it */
+struct proc {
+    pid_t pid;
+    int out_fd;
+    char *out;
+    size_t out_len, out_cap;
+};
+
+/* merged summary, one per (size, type) seen in client result lines */
+struct summary {
+    char class[32], transport[32], type[16];
+    unsigned long size;
+    int bench_time;
+    int num_clients;
+    unsigned long num_ops;
+};
+
+static char const * exe = "./hg-ctest4";
+static int num_clis = 1;
+static int num_bulk_clis = 0;
+static int num_proxies = 0;
+static char const * rpc_mode = "rpc";
+static size_t rdma_size = 4096;
+static int *cpus = NULL;
+static int num_cpus = 0;
+
+static void usage();
+
+/* process idx 0 is the server, then any proxies, then the clients */
+static void pin_self(int idx)
+{
+    cpu_set_t set;
+
+    if (num_cpus == 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[idx % num_cpus], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        perror("warning: sched_setaffinity");
+}
+
+/* fork/exec argv with stdout on a pipe (and, if addr_fd >= 0, that fd
+ * advertised to the server through ADDR_FD_ENV). All our pipes are
+ * close-on-exec, so each child only inherits the fds meant for it */
+static int spawn(struct proc *p, int idx, char *argv[], int addr_fd)
+{
+    int out[2];
+    char fdstr[16];
+
+    if (pipe2(out, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(NULL);
+    p->pid = fork();
+    if (p->pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    else if (p->pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(out[1]);
+        if (addr_fd >= 0) {
+            fcntl(addr_fd, F_SETFD, 0);
+            snprintf(fdstr, sizeof(fdstr), "%d", addr_fd);
+            setenv(ADDR_FD_ENV, fdstr, 1);
+        }
+        pin_self(idx);
+        execv(argv[0], argv);
+        fprintf(stderr, "error: unable to exec %s: %s\n", argv[0],
+                strerror(errno));
+        _exit(127);
+    }
+    close(out[1]);
+    p->out_fd = out[0];
+    p->out = NULL;
+    p->out_len = p->out_cap = 0;
+    return 0;
+}
+
+/* drain whatever is readable, returning 0 at EOF */
+static int read_output(struct proc *p)
+{
+    ssize_t n;
+
+    if (p->out_cap - p->out_len < 4096) {
+        p->out_cap = p->out_cap ? p->out_cap * 2 : 16384;
+        p->out = realloc(p->out, p->out_cap);
+        if (!p->out) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    n = read(p->out_fd, p->out + p->out_len, p->out_cap - p->out_len - 1);
+    if (n > 0) {
+        p->out_len += n;
+        p->out[p->out_len] = '\0';
+        return 1;
+    }
+    else if (n < 0 && errno == EINTR)
+        return 1;
+    close(p->out_fd);
+    p->out_fd = -1;
+    return 0;
+}
+
+/* read the server's address off the pipe, passing through its stdout in
+ * the meantime (so a server that dies early doesn't hang us) */
+static int read_server_addr(int fd, char *addr, size_t len)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    size_t off = 0;
+    ssize_t n;
+    int rc;
+
+    while (off < len - 1) {
+        rc = poll(&pfd, 1, SERVER_ADDR_TIMEOUT);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        else if (rc <= 0)
+            return -1;
+        n = read(fd, addr + off, len - 1 - off);
+        if (n <= 0)
+            break;
+        off += n;
+        if (memchr(addr, '\n', off))
+            break;
+    }
+    addr[off] = '\0';
+    addr[strcspn(addr, "\n")] = '\0';
+    return off > 0 ? 0 : -1;
+}
+
+/* sum up the per-client result lines, format:
+ *   <class> <protocol> <size> <bench time> <type> <id> <# calls> ... */
+static void summarize(struct proc *clis, int n)
+{
+    struct summary *sums = NULL;
+    int num_sums = 0;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        char *line, *save = NULL;
+        if (!clis[i].out)
+            continue;
+        for (line = strtok_r(clis[i].out, "\n", &save); line;
+                line = strtok_r(NULL, "\n", &save)) {
+            struct summary s;
+            int id, consumed;
+            unsigned long ops;
+            char next[32];
+
+            if (sscanf(line, "%31s %31s %lu %d %15s %d %lu %n",
+                        s.class, s.transport, &s.size, &s.bench_time,
+                        s.type, &id, &ops, &consumed) != 7)
+                continue;
+            /* skip lat / rate / chunk lines */
+            if (sscanf(line + consumed, "%31s", next) == 1 &&
+                    strchr("0123456789", next[0]) == NULL)
+                continue;
+            for (j = 0; j < num_sums; j++) {
+                if (sums[j].size == s.size &&
+                        strcmp(sums[j].type, s.type) == 0)
+                    break;
+            }
+            if (j == num_sums) {
+                sums = realloc(sums, (num_sums + 1) * sizeof(*sums));
+                if (!sums) {
+                    perror("realloc");
+                    exit(1);
+                }
+                s.num_clients = 0;
+                s.num_ops = 0;
+                sums[num_sums++] = s;
+            }
+            sums[j].num_clients++;
+            sums[j].num_ops += ops;
+        }
+    }
+
+    /* format: launch <class> <protocol> <size> <bench time> <type>
+     *   <# clients> <total ops> <aggregate ops/s> */
+    for (j = 0; j < num_sums; j++) {
+        printf("launch %-8s %-8s %12lu %3d %4s %3d %10lu %.3e\n",
+                sums[j].class, sums[j].transport, sums[j].size,
+                sums[j].bench_time, sums[j].type, sums[j].num_clients,
+                sums[j].num_ops,
+                sums[j].num_ops / (double) sums[j].bench_time);
+    }
+    free(sums);
+}
+
+int main(int argc, char *argv[])
+{
+    char const * listen_addr;
+    char info_str[256];
+    char (*svr_addrs)[1024];
+    char size_str[32], nclis_str[16];
+    char **extra;
+    int num_extra;
+    char **av;
+    struct proc *servers, *clis;
+    int num_servers;
+    struct pollfd *pfds;
+    int addr_pipe[2];
+    int arg = 1, i, status, failed = 0, open_fds;
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--") == 0)
+            break;
+        else if (arg+1 >= argc) {
+            usage();
+            exit(1);
+        }
+        else if (strcmp(argv[arg], "-n") == 0)
+            num_clis = atoi(argv[arg+1]);
+        else if (strcmp(argv[arg], "-b") == 0)
+            num_bulk_clis = atoi(argv[arg+1]);
+        else if (strcmp(argv[arg], "-c") == 0)
+            num_proxies = atoi(argv[arg+1]);
+        else if (strcmp(argv[arg], "-m") == 0)
+            rpc_mode = argv[arg+1];
+        else if (strcmp(argv[arg], "-s") == 0)
+            rdma_size = (size_t) strtoul(argv[arg+1], NULL, 10);
+        else if (strcmp(argv[arg], "-x") == 0)
+            exe = argv[arg+1];
+        else if (strcmp(argv[arg], "-P") == 0) {
+            if (parse_cpu_list(argv[arg+1], &cpus, &num_cpus) != 0) {
+                fprintf(stderr, "error: bad cpu list %s\n", argv[arg+1]);
+                exit(1);
+            }
+        }
+        else {
+            usage();
+            exit(1);
+        }
+        arg += 2;
+    }
+    if (arg >= argc || num_clis < 1 || num_bulk_clis < 0 ||
+            num_bulk_clis > num_clis || num_proxies < 0) {
+        usage();
+        exit(1);
+    }
+    listen_addr = argv[arg++];
+    /* everything after "--" goes to each hg-ctest4 invocation */
+    if (arg < argc && strcmp(argv[arg], "--") == 0)
+        arg++;
+    extra = &argv[arg];
+    num_extra = argc - arg;
+
+    /* clients only need the class+protocol part */
+    snprintf(info_str, sizeof(info_str), "%s", listen_addr);
+    if (strstr(info_str, "://"))
+        *strstr(info_str, "://") = '\0';
+    snprintf(size_str, sizeof(size_str), "%lu", (unsigned long) rdma_size);
+    snprintf(nclis_str, sizeof(nclis_str), "%d", num_clis);
+
+    num_servers = num_proxies + 1;
+    av = malloc((num_extra + 10) * sizeof(*av));
+    clis = calloc(num_clis, sizeof(*clis));
+    servers = calloc(num_servers, sizeof(*servers));
+    svr_addrs = malloc(num_servers * sizeof(*svr_addrs));
+    pfds = malloc((num_clis + num_servers) * sizeof(*pfds));
+    if (!av || !clis || !servers || !svr_addrs || !pfds) {
+        perror("malloc");
+        exit(1);
+    }
+
+    /* server: <exe> [extra] server <size> <num clients> <listen addr>,
+     * then proxies back to front, each forwarding to the one before:
+     * <exe> [extra] --forward-to <addr> server <size> <num clients> <info>
+     * (proxies listen wherever the transport puts them) */
+    av[0] = (char*) exe;
+    memcpy(&av[1], extra, num_extra * sizeof(*av));
+    for (int k = 0; k < num_servers; k++) {
+        if (pipe2(addr_pipe, O_CLOEXEC) != 0) {
+            perror("pipe");
+            failed = 1;
+            num_servers = k;
+            break;
+        }
+        i = num_extra + 1;
+        if (k > 0) {
+            av[i++] = "--forward-to";
+            av[i++] = svr_addrs[k-1];
+        }
+        av[i++] = "server";
+        av[i++] = size_str;
+        av[i++] = nclis_str;
+        av[i++] = k == 0 ? (char*) listen_addr : info_str;
+        av[i] = NULL;
+        if (spawn(&servers[k], k, av, addr_pipe[1]) != 0) {
+            failed = 1;
+            num_servers = k;
+            break;
+        }
+        close(addr_pipe[1]);
+        if (read_server_addr(addr_pipe[0], svr_addrs[k],
+                    sizeof(svr_addrs[k])) != 0) {
+            fprintf(stderr, "error: server %d didn't report an address\n",
+                    k);
+            failed = 1;
+            num_servers = k + 1;
+            break;
+        }
+        close(addr_pipe[0]);
+    }
+    if (failed) {
+        for (int k = 0; k < num_servers; k++) {
+            kill(servers[k].pid, SIGKILL);
+            waitpid(servers[k].pid, NULL, 0);
+        }
+        exit(1);
+    }
+
+    /* clients: <exe> [extra] client <size> <id> <mode> <info> <addr>,
+     * the first num_bulk_clis doing bulk, all talking to the last proxy
+     * (or the server) */
+    for (int c = 0; c < num_clis; c++) {
+        char id_str[16];
+        snprintf(id_str, sizeof(id_str), "%d", c);
+        i = num_extra + 1;
+        av[i++] = "client";
+        av[i++] = size_str;
+        av[i++] = id_str;
+        av[i++] = c < num_bulk_clis ? "bulk" : (char*) rpc_mode;
+        av[i++] = info_str;
+        av[i++] = svr_addrs[num_servers-1];
+        av[i] = NULL;
+        if (spawn(&clis[c], num_servers + c, av, -1) != 0) {
+            failed = 1;
+            num_clis = c;
+            break;
+        }
+    }
+
+    /* collect client output until they all close stdout, reading the
+     * servers' and proxies' output along the way so none of them can block
+     * on a full pipe while the clients wait on it */
+    do {
+        int np = 0;
+        for (int c = 0; c < num_clis; c++) {
+            if (clis[c].out_fd >= 0) {
+                pfds[np].fd = clis[c].out_fd;
+                pfds[np].events = POLLIN;
+                np++;
+            }
+        }
+        open_fds = np;
+        if (np == 0)
+            break;
+        for (int k = 0; k < num_servers; k++) {
+            if (servers[k].out_fd >= 0) {
+                pfds[np].fd = servers[k].out_fd;
+                pfds[np].events = POLLIN;
+                np++;
+            }
+        }
+        if (poll(pfds, np, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        np = 0;
+        for (int c = 0; c < num_clis; c++) {
+            if (clis[c].out_fd < 0)
+                continue;
+            if (pfds[np].revents & (POLLIN | POLLHUP | POLLERR))
+                read_output(&clis[c]);
+            np++;
+        }
+        for (int k = 0; k < num_servers; k++) {
+            if (servers[k].out_fd < 0)
+                continue;
+            if (pfds[np].revents & (POLLIN | POLLHUP | POLLERR))
+                read_output(&servers[k]);
+            np++;
+        }
+    } while (open_fds > 0);
+
+    for (int c = 0; c < num_clis; c++) {
+        waitpid(clis[c].pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "error: client %d failed\n", c);
+            failed = 1;
+        }
+    }
+
+    /* client 0 shuts the server down (through the proxies, front to back),
+     * unless something went wrong */
+    for (int k = num_servers - 1; k >= 0; k--) {
+        if (failed)
+            kill(servers[k].pid, SIGTERM);
+        while (servers[k].out_fd >= 0 && read_output(&servers[k]))
+            ;
+        waitpid(servers[k].pid, &status, 0);
+        if (!failed && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            fprintf(stderr, "error: server %d failed\n", k);
+            failed = 1;
+        }
+    }
+
+    /* per-client records in client order, then the server's and the
+     * proxies', then the merged summary */
+    for (int c = 0; c < num_clis; c++) {
+        if (clis[c].out)
+            fputs(clis[c].out, stdout);
+    }
+    for (int k = 0; k < num_servers; k++) {
+        if (servers[k].out)
+            fputs(servers[k].out, stdout);
+    }
+    summarize(clis, num_clis);
+
+    for (int c = 0; c < num_clis; c++)
+        free(clis[c].out);
+    for (int k = 0; k < num_servers; k++)
+        free(servers[k].out);
+    free(servers);
+    free(svr_addrs);
+    free(clis);
+    free(pfds);
+    free(av);
+    free(cpus);
+    return failed;
+}
+
+const char * usage_str =
+"Usage: hg-ctest-launch [-n CLIENTS] [-b BULK] [-m MODE] [-s SIZE] [-P CPUS]\n"
+"                       [-c PROXIES] [-x EXE] <listen addr> [-- OPTIONS]\n"
+"  runs one hg-ctest4 server and CLIENTS (default 1) clients on this node\n"
+"  -c puts a chain of PROXIES servers (--forward-to) in front of the server,\n"
+"     the clients talking to the last; proxies listen on the transport\n"
+"     alone, so it must pick their addresses (e.g. na+sm, ofi+tcp)\n"
+"  -b is the number of clients doing \"bulk\" (default 0); the rest use\n"
+"     MODE (\"rpc\", \"rpcbulk\" or \"rpcdata\", default \"rpc\")\n"
+"  -s is the rdma size (default 4096)\n"
+"  -P pins the server to the first of CPUS (e.g. 0,2,4-7), then proxies and\n"
+"     clients to the following ones, wrapping around\n"
+"  -x is the benchmark executable (default ./hg-ctest4)\n"
+"  OPTIONS are passed to every hg-ctest4 process (e.g. -t 5 -w 4)\n"
+"  client records are printed in client order, followed by the servers' and\n"
+"  \"launch <class> <protocol> <size> <bench time> <type> <# clients>\n"
+"  <total ops> <ops/s>\" summaries\n"
+"  Example:\n"
+"    hg-ctest-launch -n 4 -P 0-4 bmi+tcp://localhost:3344 -- -t 5\n";
+
+static void usage() {
+    fprintf(stderr, "%s", usage_str);
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+#include "hg-ctest-trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define WIN_BYTES ((off_t) (OP_TRACE_WIN_RECS * sizeof(struct op_trace_rec)))
+
+/* (re)write the header at the start of the file - through a byte copy,
+ * as gcc otherwise takes &t->hdr for its 8 byte first member */
+static int write_hdr(struct op_trace *t)
+{
+    unsigned char buf[sizeof(t->hdr)];
+
+    memcpy(buf, &t->hdr, sizeof(buf));
+    return pwrite(t->fd, buf, sizeof(buf), 0) == sizeof(buf) ? 0 : -1;
+}
+
+/* map (and prefault) the window at off, growing the file to cover it */
+static struct op_trace_rec * map_window(int fd, off_t off)
+{
+    long pgsz = sysconf(_SC_PAGESIZE);
+    volatile char *p;
+
+    if (pgsz <= 0)
+        pgsz = 4096;
+    if (ftruncate(fd, off + WIN_BYTES) != 0)
+        return NULL;
+    p = mmap(NULL, WIN_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, off);
+    if (p == MAP_FAILED)
+        return NULL;
+    /* take the page faults here rather than on the hot path */
+    for (off_t o = 0; o < WIN_BYTES; o += pgsz)
+        p[o] = 0;
+    return (struct op_trace_rec *) p;
+}
+
+static void unmap_window(struct op_trace_rec *win)
+{
+    if (win == NULL)
+        return;
+    /* start writeback now rather than when the pages get evicted */
+    msync(win, WIN_BYTES, MS_ASYNC);
+    munmap(win, WIN_BYTES);
+}
+
+#ifndef DUMMY_PTHREAD
+/* retires full windows and maps the one after the current */
+static void * writer_run(void *arg)
+{
+    struct op_trace *t = arg;
+    struct op_trace_rec *w;
+    off_t off;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        if (t->retired != NULL) {
+            w = t->retired;
+            t->retired = NULL;
+            pthread_mutex_unlock(&t->lock);
+            unmap_window(w);
+            pthread_mutex_lock(&t->lock);
+            pthread_cond_broadcast(&t->cond);
+        }
+        else if (t->stop)
+            break;
+        else if (t->next == NULL && !t->map_failed) {
+            off = t->next_off;
+            pthread_mutex_unlock(&t->lock);
+            w = map_window(t->fd, off);
+            pthread_mutex_lock(&t->lock);
+            if (w)
+                t->next = w;
+            else
+                t->map_failed = 1;
+            pthread_cond_broadcast(&t->cond);
+        }
+        else
+            pthread_cond_wait(&t->cond, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+#endif
+
+int op_trace_open(
+        struct op_trace *t,
+        char const *fname,
+        int32_t client_id,
+        uint32_t window_depth,
+        uint64_t buf_sz,
+        char const *mode)
+{
+    long pgsz = sysconf(_SC_PAGESIZE);
+
+    memset(t, 0, sizeof(*t));
+    memcpy(t->hdr.magic, OP_TRACE_MAGIC, sizeof(t->hdr.magic));
+    t->hdr.version = OP_TRACE_VERSION;
+    t->hdr.rec_size = sizeof(struct op_trace_rec);
+    t->hdr.data_off = (uint64_t) (pgsz > 0 ? pgsz : 4096);
+    t->hdr.client_id = client_id;
+    t->hdr.window_depth = window_depth;
+    t->hdr.buf_sz = buf_sz;
+    strncpy(t->hdr.mode, mode, sizeof(t->hdr.mode) - 1);
+
+    t->fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (t->fd < 0)
+        return -1;
+    if (write_hdr(t) != 0) {
+        close(t->fd);
+        return -1;
+    }
+    t->win_off = (off_t) t->hdr.data_off;
+    t->win = map_window(t->fd, t->win_off);
+    if (t->win == NULL) {
+        close(t->fd);
+        return -1;
+    }
+    t->win_idx = 0;
+#ifndef DUMMY_PTHREAD
+    t->next_off = t->win_off + WIN_BYTES;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    if (pthread_create(&t->writer, NULL, writer_run, t) != 0) {
+        unmap_window(t->win);
+        pthread_cond_destroy(&t->cond);
+        pthread_mutex_destroy(&t->lock);
+        close(t->fd);
+        return -1;
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &t->epoch);
+    return 0;
+}
+
+#ifdef DUMMY_PTHREAD
+/* locks and condition variables are no-ops in this build, so there's no
+ * writer: the window is switched (and the next one faulted in) here */
+int op_trace_next_window(struct op_trace *t)
+{
+    unmap_window(t->win);
+    t->win_off += WIN_BYTES;
+    t->win = map_window(t->fd, t->win_off);
+    t->win_idx = 0;
+    if (t->win == NULL) {
+        fprintf(stderr, "op trace: unable to map next window, "
+                "dropping records\n");
+        t->win_idx = OP_TRACE_WIN_RECS;
+        return -1;
+    }
+    return 0;
+}
+#else
+int op_trace_next_window(struct op_trace *t)
+{
+    pthread_mutex_lock(&t->lock);
+    /* normally the writer is well ahead of us */
+    if ((t->next == NULL && !t->map_failed) || t->retired != NULL) {
+        t->num_stalls++;
+        while ((t->next == NULL && !t->map_failed) || t->retired != NULL)
+            pthread_cond_wait(&t->cond, &t->lock);
+    }
+    if (t->next == NULL) {
+        pthread_mutex_unlock(&t->lock);
+        fprintf(stderr, "op trace: unable to map next window, "
+                "dropping records\n");
+        t->win_idx = OP_TRACE_WIN_RECS;
+        return -1;
+    }
+    t->retired = t->win;
+    t->win = t->next;
+    t->win_off = t->next_off;
+    t->win_idx = 0;
+    t->next = NULL;
+    t->next_off += WIN_BYTES;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
+#endif
+
+int op_trace_close(struct op_trace *t)
+{
+    off_t len;
+    int rc = 0;
+
+#ifndef DUMMY_PTHREAD
+    /* the writer retires whatever is pending before it stops */
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->writer, NULL);
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+    if (t->num_stalls > 0)
+        fprintf(stderr, "op trace: %lu window switches waited on the "
+                "writer\n", t->num_stalls);
+#endif
+
+    unmap_window(t->next);
+    unmap_window(t->win);
+    t->next = t->win = NULL;
+    /* trim the unused tail of the last window (and the one mapped ahead) */
+    len = (off_t) t->hdr.data_off +
+        (off_t) t->hdr.num_recs * (off_t) sizeof(struct op_trace_rec);
+    if (ftruncate(t->fd, len) != 0)
+        rc = -1;
+    if (write_hdr(t) != 0)
+        rc = -1;
+    if (close(t->fd) != 0)
+        rc = -1;
+    return rc;
+}
+
+int op_trace_foreach(
+        char const *fname,
+        void (*fn)(const struct op_trace_hdr *h,
+                   const struct op_trace_rec *r, void *arg),
+        void *arg)
+{
+    struct op_trace_hdr h;
+    struct op_trace_rec r;
+    uint64_t n = 0;
+    FILE *f = fopen(fname, "rb");
+
+    if (!f)
+        return -1;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+            memcmp(h.magic, OP_TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+            h.rec_size != sizeof(r) ||
+            fseeko(f, (off_t) h.data_off, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    /* num_recs is only set on a clean close - otherwise read until the
+     * zero-filled tail of the last window */
+    while ((h.num_recs == 0 || n < h.num_recs) &&
+            fread(&r, sizeof(r), 1, f) == 1) {
+        if (h.num_recs == 0 && r.start_ns == 0 && r.complete_ns == 0)
+            break;
+        fn(&h, &r, arg);
+        n++;
+    }
+
+    fclose(f);
+    return 0;
+}
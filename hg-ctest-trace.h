@@ -0,0 +1,111 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+#ifndef HG_CTEST_TRACE_H
+#define HG_CTEST_TRACE_H
+
+/* streaming per-op trace files
+ *
+ * records are appended into an mmap'd window of the trace file, double
+ * buffered: a writer thread keeps the following window mapped and
+ * prefaulted, so when the current one fills up the hot path only swaps
+ * pointers, and the writer hands the full one to the kernel for writeback
+ * (msync async + munmap). Memory use is bounded by two windows regardless
+ * of run length. Built with DUMMY_PTHREAD (no-op locks, see
+ * pthread-noop.c) there is no writer, and the completion path switches
+ * windows itself. Kept free of mercury includes so the decoder can be built
+ * standalone */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+
+#define OP_TRACE_MAGIC "HGCTRACE"
+#define OP_TRACE_VERSION 1
+/* records per mapped window (4 MiB with 32 byte records) */
+#define OP_TRACE_WIN_RECS (1 << 17)
+
+/* on-disk header, padded out to data_off (a page multiple) */
+struct op_trace_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t data_off;
+    uint64_t num_recs; /* filled in on close, 0 if the writer died */
+    int32_t client_id;
+    uint32_t window_depth;
+    uint64_t buf_sz;
+    char mode[16];
+};
+
+/* one completed op, times in ns - start is relative to the trace epoch */
+struct op_trace_rec {
+    uint64_t start_ns;
+    uint64_t call_ns;
+    uint64_t complete_ns;
+    uint32_t slot;
+    uint32_t flags;
+};
+
+struct op_trace {
+    int fd;
+    struct op_trace_hdr hdr;
+    struct timespec epoch;
+    struct op_trace_rec *win;
+    size_t win_idx;
+    off_t win_off;
+    /* writer thread state, under lock: next is the window after win (at
+     * next_off) once mapped, retired a full one waiting to be unmapped */
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct op_trace_rec *next, *retired;
+    off_t next_off;
+    int map_failed, stop;
+    unsigned long num_stalls; /* window switches that waited on the writer */
+};
+
+int op_trace_open(
+        struct op_trace *t,
+        char const *fname,
+        int32_t client_id,
+        uint32_t window_depth,
+        uint64_t buf_sz,
+        char const *mode);
+/* switches to the next window once the current one is full */
+int op_trace_next_window(struct op_trace *t);
+int op_trace_close(struct op_trace *t);
+
+static inline void op_trace_append(
+        struct op_trace *t,
+        uint64_t start_ns,
+        uint64_t call_ns,
+        uint64_t complete_ns,
+        uint32_t slot)
+{
+    struct op_trace_rec *r;
+    if (t->win_idx == OP_TRACE_WIN_RECS && op_trace_next_window(t) != 0)
+        return;
+    r = &t->win[t->win_idx++];
+    r->start_ns = start_ns;
+    r->call_ns = call_ns;
+    r->complete_ns = complete_ns;
+    r->slot = slot;
+    r->flags = 0;
+    t->hdr.num_recs++;
+}
+
+/* sequentially read back a trace file, calling fn on each record. Returns
+ * 0 on success, -1 if the file couldn't be opened/parsed */
+int op_trace_foreach(
+        char const *fname,
+        void (*fn)(const struct op_trace_hdr *h,
+                   const struct op_trace_rec *r, void *arg),
+        void *arg);
+
+#endif /* end of include guard: HG_CTEST_TRACE_H */
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+/* convert hg-ctest4 binary op traces (-T option) to CSV */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hg-ctest-trace.h"
+
+static void print_rec(
+        const struct op_trace_hdr *h,
+        const struct op_trace_rec *r,
+        void *arg)
+{
+    (void)arg;
+    printf("%s,%d,%lu,%u,%u,%.9f,%.9f,%.9f\n",
+            h->mode, h->client_id, (unsigned long) h->buf_sz,
+            h->window_depth, r->slot,
+            r->start_ns / 1e9, r->call_ns / 1e9, r->complete_ns / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: hg-ctest-trace2csv <trace file>...\n");
+        exit(1);
+    }
+
+    printf("mode,client,size,window,slot,start,call,complete\n");
+    for (int i = 1; i < argc; i++) {
+        if (op_trace_foreach(argv[i], print_rec, NULL) != 0) {
+            fprintf(stderr, "error: unable to read trace %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    return 0;
+}
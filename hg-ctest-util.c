@@ -4,13 +4,459 @@
  * directory
  */
 
+#define _GNU_SOURCE
 #include "hg-ctest-util.h"
 #include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <na.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 /* generic server mercury setup */
 static struct hg_comm_info hserv;
 
+struct server_opts hg_server_opts = { 1, 0, 0, 0, 0, 0, 1, NULL, 0 };
+
+struct progress_opts hg_progress_opts = { PROGRESS_BLOCK, 0, 1 };
+
+/* clock_gettime nanoseconds until timer_init says otherwise */
+struct timer_info hg_timer = { 0, 1ULL << TIMER_SHIFT, 1.0, 0.0 };
+
+/* off unless --converge */
+struct converge_opts hg_converge_opts = { 0.0, 60.0, 0.0, 32 };
+
+/* record reporting, off unless --report */
+enum report_format hg_report_format = REPORT_NONE;
+
+/* stamped into the meta record by the build */
+#ifndef GIT_HASH
+#define GIT_HASH "unknown"
+#endif
+
+#define REPORT_MAX_FIELDS 64
+
+struct report_field {
+    char key[32];
+    char val[128];
+    int is_str;
+};
+
+/* reporter state - the record being built, under lock from report_begin
+ * to report_end */
+static struct {
+    pthread_mutex_t lock;
+    char const *fname;
+    FILE *f;
+    char host[64];
+    time_t start;
+    char run[128];
+    char const *class, *transport;
+    struct report_field ctx[REPORT_MAX_FIELDS];
+    int num_ctx;
+    struct report_field rec[REPORT_MAX_FIELDS];
+    int num_rec;
+    char last_hdr[2048]; /* CSV columns last written */
+    char buf[8192];
+    size_t len;
+} report = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void report_meta(const struct hg_comm_info *h, hg_bool_t listen);
+
+static char const * const progress_mode_names[] = {
+    "block", "busy", "spin", "epoll"
+};
+
+/* epoll progress state, per thread and context, on a list of the calling
+ * thread's. A thread's states are closed when it exits, or one at a time
+ * with progress_release */
+struct epoll_progress {
+    hg_context_t *ctx;
+    int epfd; /* watches the context's wait fd and tfd */
+    int tfd; /* timerfd for the loop's timeout */
+    struct epoll_progress *next;
+};
+static __thread struct epoll_progress *epoll_state = NULL;
+static pthread_key_t epoll_key;
+static pthread_once_t epoll_key_once = PTHREAD_ONCE_INIT;
+
+/* a server progress/trigger loop, possibly on its own context */
+struct server_thread {
+    pthread_t tid;
+    int idx;
+    hg_context_t *ctx;
+    unsigned long num_handled;
+    /* bulk_read accounting */
+    unsigned long num_bulk_reads;
+    unsigned long num_bulk_regs; /* registrations on the critical path */
+    uint64_t bulk_reg_ns;
+    unsigned long num_pull_chunks;
+    int cpu, node;
+    /* get_stats / SIGUSR1 accounting - read unlocked by other threads,
+     * which is fine for reporting */
+    server_stats_t stats;
+    struct lat_hist handler_hist[STAT_NUM_RPCS];
+};
+
+static struct server_thread *server_threads;
+static int num_server_threads = 0;
+static int num_server_ctx = 1;
+static struct timespec server_start;
+
+/* set by SIGUSR1, the main server loop dumps stats when it sees it */
+static volatile sig_atomic_t dump_stats = 0;
+
+char const * const stat_rpc_names[STAT_NUM_RPCS] = {
+    "check_in", "noop", "get_bulk_handle", "shutdown_server", "bulk_read",
+    "sized_rpc", "get_stats", "barrier_join"
+};
+
+char const * const fwd_rpc_names[FWD_NUM_RPCS] = {
+    "noop", "bulk_read", "bulk_read_from", "shutdown_server"
+};
+
+/* loop the current handler is running under, for accounting */
+static __thread struct server_thread *cur_server_thread = NULL;
+
+/* serializes the checkin state when running multiple server threads */
+static pthread_mutex_t checkin_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* bulk_read pulls each get their own target buffer ("pull slot"), and at
+ * most as many pulls as there are slots run at once - the rest wait in a
+ * FIFO queue. Slot buffers are either pre-registered (--bulk-pool) or
+ * registered for the duration of each pull */
+struct pull_slot;
+
+/* what a pull reads: the decoded request (bulk_read's bh, or bh and origin
+ * for bulk_read_from) and where the bulk handle lives */
+struct pull_src {
+    bulk_read_from_in_t in;
+    int from; /* decoded as bulk_read_from_in_t, else bulk_read_in_t */
+    hg_addr_t addr; /* HG_ADDR_NULL -> the request's sender */
+};
+
+/* one piece of a (possibly chunked) pull */
+struct pull_chunk {
+    struct pull_slot *slot;
+    hg_size_t off, len;
+    struct pull_chunk *next;
+};
+
+struct pull_slot {
+    void *buf;
+    hg_size_t sz;
+    hg_bulk_t bh;
+    hg_handle_t handle; /* request currently pulling into the slot */
+    uint64_t start; /* when its handler ran (ticks) */
+    /* pull in progress: chunks go out from next_off until total is
+     * covered, with at most pull_chunks_in_flight outstanding. Chunk
+     * callbacks can run on several threads sharing a context, hence the
+     * lock */
+    struct pull_src src;
+    hg_size_t total, next_off;
+    int pending;
+    struct pull_chunk *chunks, *free_chunks;
+    pthread_mutex_t lock;
+    struct pull_slot *next;
+    struct pull_slot *all_next; /* every slot, for teardown */
+};
+
+/* bulk_read request waiting on a slot */
+struct pull_req {
+    hg_handle_t handle;
+    struct pull_src src;
+    uint64_t enqueued; /* also when its handler ran */
+    struct pull_req *next;
+};
+
+static struct pull_slot *pull_slots = NULL; /* allocated on first use */
+static int num_pull_slots = 0; /* made so far */
+/* slots to make (0 -> no limit: a new one whenever none is free) */
+static int max_pull_slots = 0;
+static size_t pull_slot_size = 0;
+static int pull_slots_pooled = 0;
+static struct pull_slot *pull_slots_free = NULL;
+static struct pull_req *pull_queue_head = NULL, *pull_queue_tail = NULL;
+/* queue accounting, under pull_mutex */
+static struct {
+    int depth, max_depth;
+    unsigned long num_queued;
+    uint64_t wait_ns, max_wait_ns;
+} pull_queue_stats;
+static pthread_mutex_t pull_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* next hop of a proxy server (--forward-to) */
+static hg_addr_t next_hop = HG_ADDR_NULL;
+
+/* slot buffers are pulled into, and on a staging proxy the next hop pulls
+ * back out of them */
+static inline hg_uint8_t pull_slot_perm(void)
+{
+    return next_hop != HG_ADDR_NULL ? HG_BULK_READWRITE : HG_BULK_WRITE_ONLY;
+}
+
+/* release a decoded bulk_read / bulk_read_from request */
+static void pull_src_free(hg_handle_t h, struct pull_src *src)
+{
+    if (src->from)
+        HG_Free_input(h, &src->in);
+    else {
+        bulk_read_in_t in;
+        in.bh = src->in.bh;
+        HG_Free_input(h, &in);
+    }
+}
+
+/* slots are only allocated (and, pooled, registered) by the first
+ * bulk_read, so servers that never see one don't pay for them */
+static void pull_slots_init(int count, size_t sz, int pooled)
+{
+    max_pull_slots = count;
+    pull_slot_size = sz;
+    pull_slots_pooled = pooled;
+}
+
+/* called with pull_mutex held; the slot isn't on the free list */
+static struct pull_slot * pull_slot_new(void)
+{
+    struct pull_slot *b;
+    hg_return_t hret;
+
+    b = calloc(1, sizeof(*b));
+    assert(b);
+    b->buf = calloc(pull_slot_size, 1);
+    assert(b->buf);
+    b->sz = pull_slot_size;
+    b->bh = HG_BULK_NULL;
+    b->chunks = calloc(hg_server_opts.pull_chunks_in_flight,
+            sizeof(*b->chunks));
+    assert(b->chunks);
+    b->free_chunks = NULL;
+    for (int c = 0; c < hg_server_opts.pull_chunks_in_flight; c++) {
+        b->chunks[c].slot = b;
+        b->chunks[c].next = b->free_chunks;
+        b->free_chunks = &b->chunks[c];
+    }
+    pthread_mutex_init(&b->lock, NULL);
+    if (pull_slots_pooled) {
+        hret = HG_Bulk_create(hserv.hgcl, 1, &b->buf, &b->sz,
+                pull_slot_perm(), &b->bh);
+        assert(hret == HG_SUCCESS);
+    }
+    b->all_next = pull_slots;
+    pull_slots = b;
+    num_pull_slots++;
+    return b;
+}
+
+/* called with pull_mutex held */
+static void pull_slots_alloc(void)
+{
+    struct pull_slot *b;
+
+    while (num_pull_slots < max_pull_slots) {
+        b = pull_slot_new();
+        b->next = pull_slots_free;
+        pull_slots_free = b;
+    }
+}
+
+static void pull_slots_fini(void)
+{
+    struct pull_slot *b, *next;
+
+    for (b = pull_slots; b != NULL; b = next) {
+        next = b->all_next;
+        if (b->bh != HG_BULK_NULL)
+            HG_Bulk_free(b->bh);
+        pthread_mutex_destroy(&b->lock);
+        free(b->chunks);
+        free(b->buf);
+        free(b);
+    }
+    pull_slots = pull_slots_free = NULL;
+    num_pull_slots = 0;
+}
+
+/* handler entry: count it and note the start time for time_handler */
+static inline void count_handler(enum stat_rpc which, uint64_t *start)
+{
+    trace_event(EV_HANDLER, which);
+    *start = ticks_now();
+    if (cur_server_thread) {
+        cur_server_thread->num_handled++;
+        cur_server_thread->stats.count[which]++;
+    }
+}
+
+/* handler done (responded) */
+static inline void time_handler(enum stat_rpc which, uint64_t start)
+{
+    uint64_t ns;
+
+    trace_event(EV_RESPOND, which);
+    if (cur_server_thread == NULL)
+        return;
+    ns = ticks_to_ns(ticks_now() - start);
+    cur_server_thread->stats.handler_ns[which] += ns;
+    lat_hist_record(&cur_server_thread->handler_hist[which], ns);
+}
+
+/* a proxy server (--forward-to) passes noop and bulk_read on to the next
+ * hop and responds once the next hop has. Each forward takes an op - a
+ * handle to the next hop plus the request it answers - off a free list
+ * kept per server context and RPC, creating one when the list is empty,
+ * so handles are reused like a client's (see enum fwd_rpc) */
+
+struct fwd_op {
+    hg_handle_t fwd; /* to the next hop */
+    int rpc, pool;
+    hg_handle_t handle; /* request being answered */
+    uint64_t start; /* when its handler ran (ticks) */
+    uint64_t sent; /* when it was forwarded (ticks) */
+    struct pull_src src; /* bulk_read(_from) passed on as is */
+    struct pull_slot *slot; /* staged bulk_read: the slot holding the data */
+    hg_bulk_t bh; /* ^ exposed to the next hop, if not the slot's own */
+    struct fwd_op *next;
+};
+
+/* one per server context */
+struct fwd_pool {
+    pthread_mutex_t lock;
+    struct fwd_op *free[FWD_NUM_RPCS];
+};
+
+static struct fwd_pool *fwd_pools = NULL;
+static int num_fwd_pools = 0;
+
+static void fwd_pools_init(int count)
+{
+    fwd_pools = calloc(count, sizeof(*fwd_pools));
+    assert(fwd_pools);
+    num_fwd_pools = count;
+    for (int i = 0; i < count; i++)
+        pthread_mutex_init(&fwd_pools[i].lock, NULL);
+}
+
+static void fwd_pools_fini(void)
+{
+    for (int i = 0; i < num_fwd_pools; i++) {
+        for (int r = 0; r < FWD_NUM_RPCS; r++) {
+            while (fwd_pools[i].free[r] != NULL) {
+                struct fwd_op *op = fwd_pools[i].free[r];
+                fwd_pools[i].free[r] = op->next;
+                HG_Destroy(op->fwd);
+                free(op);
+            }
+        }
+        pthread_mutex_destroy(&fwd_pools[i].lock);
+    }
+    free(fwd_pools);
+    fwd_pools = NULL;
+    num_fwd_pools = 0;
+}
+
+/* an op for forwarding rpc from the calling server thread's context */
+static struct fwd_op * fwd_get(enum fwd_rpc rpc)
+{
+    int pool = cur_server_thread && !hg_server_opts.shared_context ?
+        cur_server_thread->idx : 0;
+    struct fwd_pool *p = &fwd_pools[pool];
+    struct fwd_op *op;
+    hg_id_t id;
+    hg_return_t hret;
+
+    pthread_mutex_lock(&p->lock);
+    op = p->free[rpc];
+    if (op)
+        p->free[rpc] = op->next;
+    pthread_mutex_unlock(&p->lock);
+    if (op)
+        return op;
+
+    switch (rpc) {
+        case FWD_NOOP:           id = hserv.noop_rpc_id; break;
+        case FWD_BULK_READ:      id = hserv.bulk_read_rpc_id; break;
+        case FWD_BULK_READ_FROM: id = hserv.bulk_read_from_rpc_id; break;
+        default:                 id = hserv.shutdown_server_rpc_id; break;
+    }
+    op = calloc(1, sizeof(*op));
+    assert(op);
+    op->rpc = rpc;
+    op->pool = pool;
+    hret = HG_Create(server_threads[pool].ctx, next_hop, id, &op->fwd);
+    assert(hret == HG_SUCCESS);
+    return op;
+}
+
+static void fwd_put(struct fwd_op *op)
+{
+    struct fwd_pool *p = &fwd_pools[op->pool];
+
+    op->handle = HG_HANDLE_NULL;
+    op->slot = NULL;
+    pthread_mutex_lock(&p->lock);
+    op->next = p->free[op->rpc];
+    p->free[op->rpc] = op;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void fwd_send(struct fwd_op *op, hg_cb_t cb, void *in)
+{
+    hg_return_t hret;
+
+    op->sent = ticks_now();
+    hret = HG_Forward(op->fwd, cb, op, in);
+    assert(hret == HG_SUCCESS);
+}
+
+/* the next hop answered */
+static void fwd_done(struct fwd_op *op)
+{
+    if (cur_server_thread == NULL)
+        return;
+    cur_server_thread->stats.forwards[op->rpc]++;
+    cur_server_thread->stats.forward_ns[op->rpc] +=
+        ticks_to_ns(ticks_now() - op->sent);
+}
+
+/* noop or pass-through bulk_read(_from) answered downstream - answer
+ * upstream */
+static hg_return_t fwd_respond_cb(const struct hg_cb_info *info)
+{
+    struct fwd_op *op = info->arg;
+    enum stat_rpc which = op->rpc == FWD_NOOP ? STAT_NOOP : STAT_BULK_READ;
+    hg_return_t hret;
+
+    assert(info->ret == HG_SUCCESS);
+    fwd_done(op);
+    if (op->rpc != FWD_NOOP)
+        pull_src_free(op->handle, &op->src);
+    hret = HG_Respond(op->handle, NULL, NULL, NULL);
+    assert(hret == HG_SUCCESS);
+    time_handler(which, op->start);
+    HG_Destroy(op->handle);
+    fwd_put(op);
+    return HG_SUCCESS;
+}
+
 char const * const ADDR_FNAME = "ctest-server-addr.tmp";
+char const * const HIST_FNAME = "ctest-hist.tmp";
+char const * const TRACE_FNAME = "ctest-trace.tmp";
+char const * const BARRIER_FNAME = "ctest-barrier.tmp";
 
 void hg_init(
         char const *info_str,
@@ -22,8 +468,14 @@ void hg_init(
     hg_size_t hsz;
     hg_return_t hret;
 
-    h->buf = calloc(buf_sz, 1);
+    timer_init();
+
+    /* pin before touching the buffer, so its pages are placed on our
+     * node */
+    pin_thread(0);
+    h->buf = malloc(buf_sz);
     assert(h->buf);
+    memset(h->buf, 0, buf_sz);
     h->buf_sz = buf_sz;
 
     h->is_separate_servers = 0;
@@ -38,6 +490,8 @@ void hg_init(
     h->transport = HG_Class_get_protocol(h->hgcl);
     assert(h->transport != NULL);
 
+    report_meta(h, listen);
+
     /* initialize the checkin state */
     h->num_to_check_in = checkin_count;
     h->num_checked_in = 0;
@@ -55,6 +509,16 @@ void hg_init(
             void, void, noop);
     h->bulk_read_rpc_id = MERCURY_REGISTER(h->hgcl, "bulk_read",
             bulk_read_in_t, void, bulk_read);
+    h->sized_rpc_id = MERCURY_REGISTER(h->hgcl, "sized_rpc",
+            sized_rpc_in_t, sized_rpc_out_t, sized_rpc);
+    h->get_stats_rpc_id = MERCURY_REGISTER(h->hgcl, "get_stats",
+            void, get_stats_out_t, get_stats);
+    h->barrier_join_rpc_id = MERCURY_REGISTER(h->hgcl, "barrier_join",
+            barrier_join_in_t, barrier_join_out_t, barrier_join);
+    h->tree_arrive_rpc_id = MERCURY_REGISTER(h->hgcl, "tree_arrive",
+            void, void, tree_arrive);
+    h->bulk_read_from_rpc_id = MERCURY_REGISTER(h->hgcl, "bulk_read_from",
+            bulk_read_from_in_t, void, bulk_read_from);
 
     hret = HG_Addr_self(h->hgcl, &h->self);
     assert(hret == HG_SUCCESS);
@@ -67,10 +531,18 @@ void hg_init(
 
 void hg_fini(struct hg_comm_info *h)
 {
+#if TRACE
+    char ev_fname[256];
+    snprintf(ev_fname, sizeof(ev_fname), "%s-%d.json", EV_TRACE_FNAME,
+            (int) getpid());
+    if (ev_trace_dump(ev_fname, hg_timer.ns_per_tick) != 0)
+        fprintf(stderr, "warning: unable to write %s\n", ev_fname);
+#endif
     free(h->buf);
     free(h->checkin_handles);
     hg_return_t hret;
     hret = HG_Bulk_free(h->bh); assert(hret == HG_SUCCESS);
+    progress_release(h->hgctx);
     hret = HG_Context_destroy(h->hgctx); assert(hret == HG_SUCCESS);
     hret = HG_Addr_free(h->hgcl, h->self); assert(hret == HG_SUCCESS);
     hret = HG_Finalize(h->hgcl); assert(hret == HG_SUCCESS);
@@ -78,6 +550,11 @@ void hg_fini(struct hg_comm_info *h)
 
 hg_return_t check_in(hg_handle_t handle)
 {
+    hg_return_t hret_end = HG_SUCCESS;
+    uint64_t start;
+
+    count_handler(STAT_CHECK_IN, &start);
+    pthread_mutex_lock(&checkin_mutex);
     assert(hserv.num_checked_in < hserv.num_to_check_in);
     hserv.checkin_handles[hserv.num_checked_in] = handle;
     hserv.num_checked_in++;
@@ -85,7 +562,6 @@ hg_return_t check_in(hg_handle_t handle)
             hserv.num_to_check_in);
 
     if (hserv.num_checked_in == hserv.num_to_check_in) {
-        hg_return_t hret_end = HG_SUCCESS;
         for (int i = 0; i < hserv.num_to_check_in; i++) {
             dprintf("server responding to %d\n", i);
             hg_return_t hret =
@@ -96,188 +572,2557 @@ hg_return_t check_in(hg_handle_t handle)
             HG_Destroy(hserv.checkin_handles[i]);
         hserv.num_checked_in = 0;
         dprintf("server done issuing responds, returning\n");
-        return hret_end;
     }
-    else
-        return HG_SUCCESS;
+    pthread_mutex_unlock(&checkin_mutex);
+    time_handler(STAT_CHECK_IN, start);
+    return hret_end;
 }
 
-hg_return_t noop(hg_handle_t handle)
-{
-    hg_return_t hret = HG_Respond(handle, NULL, NULL, NULL);
-    assert(hret == HG_SUCCESS);
-    HG_Destroy(handle);
-    return hret;
-}
+/* barrier_join state - joins are held, indexed by client id, until all
+ * num_to_check_in clients have joined */
+static hg_handle_t *join_handles = NULL;
+static barrier_join_in_t *join_in = NULL;
+static int num_joined = 0;
 
-hg_return_t get_bulk_handle(hg_handle_t handle)
+hg_return_t barrier_join(hg_handle_t handle)
 {
-    hg_return_t hret;
-    get_bulk_handle_out_t out;
-
-    out.bh = hserv.bh;
+    hg_return_t hret, hret_end = HG_SUCCESS;
+    barrier_join_in_t in;
+    barrier_join_out_t out;
+    uint64_t start;
+    int n = hserv.num_to_check_in;
 
-    hret = HG_Respond(handle, NULL, NULL, &out);
+    count_handler(STAT_BARRIER_JOIN, &start);
+    hret = HG_Get_input(handle, &in);
     assert(hret == HG_SUCCESS);
+    assert(in.id < (hg_uint32_t) n && in.fanout > 0);
 
-    HG_Destroy(handle);
-    return hret;
+    pthread_mutex_lock(&checkin_mutex);
+    if (join_handles == NULL) {
+        join_handles = calloc(n, sizeof(*join_handles));
+        join_in = calloc(n, sizeof(*join_in));
+        assert(join_handles && join_in);
+    }
+    assert(join_handles[in.id] == HG_HANDLE_NULL);
+    join_handles[in.id] = handle;
+    join_in[in.id] = in;
+    num_joined++;
+    dprintf("server recv barrier join %d of %d\n", num_joined, n);
+
+    if (num_joined == n) {
+        for (int i = 0; i < n; i++) {
+            int k = (int) join_in[i].fanout, first_child = i * k + 1;
+            out.parent = i == 0 ? "" : join_in[(i-1) / k].addr;
+            out.num_children = first_child >= n ? 0 :
+                (hg_uint32_t) (n - first_child < k ? n - first_child : k);
+            hret = HG_Respond(join_handles[i], NULL, NULL, &out);
+            if (hret != HG_SUCCESS) hret_end = hret;
+        }
+        for (int i = 0; i < n; i++) {
+            HG_Free_input(join_handles[i], &join_in[i]);
+            HG_Destroy(join_handles[i]);
+        }
+        free(join_handles);
+        free(join_in);
+        join_handles = NULL;
+        join_in = NULL;
+        num_joined = 0;
+    }
+    pthread_mutex_unlock(&checkin_mutex);
+    time_handler(STAT_BARRIER_JOIN, start);
+    return hret_end;
 }
 
-static int do_shutdown = 0;
+/* tree barrier state (client side, driven from the one client thread). A
+ * child may arrive before we do - even before our own barrier_join has
+ * returned - so arrivals are held until we've arrived too */
+static struct {
+    int fanout;
+    int num_children;
+    hg_addr_t parent_addr;
+    hg_handle_t parent;     /* HG_HANDLE_NULL at the root */
+    hg_handle_t *children;  /* held tree_arrive handles, this round */
+    int num_arrived;        /* children arrived this round */
+    int self_arrived;
+    int forwarded;
+    int released;
+    hg_return_t hret;       /* first error this round */
+} tree = { 1, 0, HG_ADDR_NULL, HG_HANDLE_NULL, NULL, 0, 0, 0, 0, HG_SUCCESS };
 
-hg_return_t shutdown_server(hg_handle_t handle)
+/* round done - pass the release down and reset for the next round (the
+ * children can't arrive again until they see the release) */
+static void tree_release(void)
 {
     hg_return_t hret;
-    hret = HG_Respond(handle, NULL, NULL, NULL);
-    HG_Destroy(handle);
-    printf("server received shutdown request\n");
-    do_shutdown = 1;
-    return hret;
+
+    for (int i = 0; i < tree.num_arrived; i++) {
+        hret = HG_Respond(tree.children[i], NULL, NULL, NULL);
+        if (hret != HG_SUCCESS && tree.hret == HG_SUCCESS)
+            tree.hret = hret;
+        HG_Destroy(tree.children[i]);
+    }
+    tree.num_arrived = 0;
+    tree.self_arrived = 0;
+    tree.forwarded = 0;
+    tree.released = 1;
 }
 
-static hg_return_t bulk_read_continuation(
-        const struct hg_cb_info *callback_info)
+static hg_return_t tree_parent_cb(const struct hg_cb_info *info)
 {
-    hg_handle_t h = callback_info->arg;
-    hg_return_t hret = HG_Respond(h, NULL, NULL, NULL);
-    return hret;
+    if (info->ret != HG_SUCCESS && tree.hret == HG_SUCCESS)
+        tree.hret = info->ret;
+    tree_release();
+    return HG_SUCCESS;
 }
 
-hg_return_t bulk_read(hg_handle_t handle)
+/* forward our subtree's arrival once it's complete, releasing at the root */
+static void tree_try_forward(void)
 {
-    // get bulk handle to read from
     hg_return_t hret;
-    bulk_read_in_t in;
-    hret = HG_Get_input(handle, &in);
-    assert(hret == HG_SUCCESS);
-    hg_size_t in_buf_sz = HG_Bulk_get_size(in.bh);
 
-    struct hg_info *info = HG_Get_info(handle);
+    if (!tree.self_arrived || tree.forwarded ||
+            tree.num_arrived < tree.num_children)
+        return;
+    tree.forwarded = 1;
+    if (tree.parent == HG_HANDLE_NULL) {
+        tree_release();
+        return;
+    }
+    hret = HG_Forward(tree.parent, tree_parent_cb, NULL, NULL);
+    if (hret != HG_SUCCESS) {
+        tree.hret = hret;
+        tree_release();
+    }
+}
 
-    // create bulk handle to write to local buffer
-    hg_bulk_t wrbulk = HG_BULK_NULL;
-    hg_size_t buf_sz = hserv.buf_sz;
-    hret = HG_Bulk_create(hserv.hgcl, 1,
-            &hserv.buf, &buf_sz, HG_BULK_WRITE_ONLY, &wrbulk);
-    assert(hret == HG_SUCCESS);
+hg_return_t tree_arrive(hg_handle_t handle)
+{
+    assert(tree.num_arrived < tree.fanout);
+    tree.children[tree.num_arrived++] = handle;
+    dprintf("client recv tree arrive %d of %d\n", tree.num_arrived,
+            tree.num_children);
+    tree_try_forward();
+    return HG_SUCCESS;
+}
 
-    // perform the bulk transfer
-    assert(hret == HG_SUCCESS);
-    hret = HG_Bulk_transfer(hserv.hgctx, bulk_read_continuation,
-        handle, HG_BULK_PULL, info->addr, in.bh, 0, wrbulk, 0,
-        in_buf_sz > buf_sz ? buf_sz : in_buf_sz, HG_OP_ID_IGNORE);
-    assert(hret == HG_SUCCESS);
+struct barrier_join_cb {
+    int is_finished;
+    hg_return_t hret;
+    char *parent;
+    int num_children;
+};
 
-    HG_Bulk_free(wrbulk);
-    HG_Free_input(handle, &in);
-    HG_Destroy(handle);
+static hg_return_t barrier_join_cli_cb(const struct hg_cb_info *info)
+{
+    struct barrier_join_cb *cb = info->arg;
+    barrier_join_out_t out;
 
+    cb->hret = info->ret;
+    if (cb->hret == HG_SUCCESS)
+        cb->hret = HG_Get_output(info->info.forward.handle, &out);
+    if (cb->hret == HG_SUCCESS) {
+        cb->parent = strdup(out.parent);
+        assert(cb->parent);
+        cb->num_children = (int) out.num_children;
+        HG_Free_output(info->info.forward.handle, &out);
+    }
+    cb->is_finished = 1;
     return HG_SUCCESS;
 }
 
-void run_server(
-        size_t rdma_size,
-        char const * listen_addr,
-        char const * id_str,
-        int num_checkins)
+hg_return_t tree_barrier_init(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int id,
+        int fanout,
+        int max_retries)
 {
+    struct barrier_join_cb cb = { 0, HG_SUCCESS, NULL, 0 };
+    barrier_join_in_t in;
+    hg_handle_t handle;
     hg_return_t hret;
-    unsigned int num_cb;
-    FILE *f;
-    char * nm;
-    hg_size_t nm_len = 256;
-    char * fname;
-
-    if (id_str) {
-        fname = malloc(strlen(id_str)+strlen(ADDR_FNAME)+2);
-        assert(fname);
-        sprintf(fname, "%s-%s", ADDR_FNAME, id_str);
-    }
-    else
-        fname = strdup(ADDR_FNAME);
-
-    hg_init(listen_addr, rdma_size, HG_TRUE, num_checkins, &hserv);
-
-    /* print out server addr to file */
-    f = fopen(fname, "w");
-    assert(f);
+    char addr[256];
+    hg_size_t addr_len = sizeof(addr);
 
-    nm = malloc(nm_len);
-    assert(nm);
-    hret = HG_Addr_to_string(hserv.hgcl, nm, &nm_len, hserv.self);
-    assert(hret == HG_SUCCESS);
+    assert(id >= 0 && fanout > 0);
 
-    fprintf(f, "%s\n", nm);
-    fclose(f);
+    /* children hear about us at the same time we hear about our parent, so
+     * be ready for their arrivals before joining */
+    tree.fanout = fanout;
+    tree.children = calloc(fanout, sizeof(*tree.children));
+    assert(tree.children);
 
-    free(nm);
-    free(fname);
+    hret = HG_Addr_to_string(hg->hgcl, addr, &addr_len, hg->self);
+    if (hret != HG_SUCCESS)
+        return hret;
+    in.id = (hg_uint32_t) id;
+    in.fanout = (hg_uint32_t) fanout;
+    in.addr = addr;
 
-    /* unclear whether this is the correct processing loop or not for single
-     * threaded */
-    do {
-        do {
-            hret = HG_Trigger(hserv.hgctx, 0, 1, &num_cb);
-        } while(hret == HG_SUCCESS && num_cb == 1);
-        hret = HG_Progress(hserv.hgctx, 1000);
-    } while((hret == HG_SUCCESS || hret == HG_TIMEOUT) && !do_shutdown);
+    hret = HG_Create(hg->hgctx, svr, hg->barrier_join_rpc_id, &handle);
+    if (hret != HG_SUCCESS)
+        return hret;
+    hret = HG_Forward(handle, barrier_join_cli_cb, &cb, &in);
+    if (hret == HG_SUCCESS)
+        hret = wait_until(hg->hgctx, &cb.is_finished, max_retries);
+    HG_Destroy(handle);
+    if (hret == HG_SUCCESS)
+        hret = cb.hret;
+    if (hret != HG_SUCCESS)
+        return hret;
 
-    hg_fini(&hserv);
+    tree.num_children = cb.num_children;
+    if (cb.parent[0] != '\0') {
+        tree.parent_addr = lookup_serv_addr(hg, cb.parent);
+        if (tree.parent_addr == HG_ADDR_NULL)
+            hret = HG_OTHER_ERROR;
+        else
+            hret = HG_Create(hg->hgctx, tree.parent_addr,
+                    hg->tree_arrive_rpc_id, &tree.parent);
+    }
+    dprintf("client %d joined barrier tree, parent %s, %d children\n", id,
+            cb.parent, tree.num_children);
+    free(cb.parent);
+    return hret;
 }
 
-hg_bulk_t dup_hg_bulk(hg_class_t *cl, hg_bulk_t in)
+hg_return_t tree_barrier(struct hg_comm_info *hg, int max_retries)
 {
-    hg_bulk_t rtn;
-    hg_size_t sz;
     hg_return_t hret;
-    void * buf;
 
-    sz = HG_Bulk_get_serialize_size(in, HG_FALSE);
-    buf = malloc(sz);
-    if (!buf)
-        return HG_BULK_NULL;
-    hret = HG_Bulk_serialize(buf, sz, HG_FALSE, in);
-    if (hret != HG_SUCCESS)
-        return HG_BULK_NULL;
-    hret = HG_Bulk_deserialize(cl, &rtn, buf, sz);
-    free(buf);
-    if (hret != HG_SUCCESS)
-        return HG_BULK_NULL;
-    else
-        return rtn;
+    tree.hret = HG_SUCCESS;
+    tree.released = 0;
+    tree.self_arrived = 1;
+    tree_try_forward();
+    hret = wait_until(hg->hgctx, &tree.released, max_retries);
+    return hret == HG_SUCCESS ? tree.hret : hret;
 }
 
-typedef struct serv_addr_out
+void tree_barrier_fini(struct hg_comm_info *hg)
 {
-    hg_addr_t addr;
-    int set;
-} serv_addr_out_t;
+    if (tree.parent != HG_HANDLE_NULL)
+        HG_Destroy(tree.parent);
+    if (tree.parent_addr != HG_ADDR_NULL)
+        HG_Addr_free(hg->hgcl, tree.parent_addr);
+    free(tree.children);
+    tree.parent = HG_HANDLE_NULL;
+    tree.parent_addr = HG_ADDR_NULL;
+    tree.children = NULL;
+    tree.num_children = 0;
+}
 
-// helper for lookup_serv_addr
-static hg_return_t lookup_serv_addr_cb(const struct hg_cb_info *info)
+hg_return_t noop(hg_handle_t handle)
 {
-    serv_addr_out_t *out = info->arg;
-    out->addr = info->info.lookup.addr;
-    out->set = 1;
-    return HG_SUCCESS;
+    uint64_t start;
+    count_handler(STAT_NOOP, &start);
+    if (next_hop != HG_ADDR_NULL) {
+        struct fwd_op *op = fwd_get(FWD_NOOP);
+        op->handle = handle;
+        op->start = start;
+        fwd_send(op, fwd_respond_cb, NULL);
+        return HG_SUCCESS;
+    }
+    hg_return_t hret = HG_Respond(handle, NULL, NULL, NULL);
+    assert(hret == HG_SUCCESS);
+    time_handler(STAT_NOOP, start);
+    HG_Destroy(handle);
+    return hret;
 }
 
-hg_addr_t lookup_serv_addr(struct hg_comm_info *hg, const char *info_str)
+hg_return_t hg_proc_rpc_payload_t(hg_proc_t proc, void *data)
 {
-    serv_addr_out_t out;
+    rpc_payload_t *p = data;
     hg_return_t hret;
 
-    out.addr = HG_ADDR_NULL;
-    out.set = 0;
+    hret = hg_proc_hg_uint32_t(proc, &p->len);
+    if (hret != HG_SUCCESS)
+        return hret;
 
-    hret = HG_Addr_lookup(hg->hgctx, &lookup_serv_addr_cb, &out, info_str,
-            HG_OP_ID_IGNORE);
+    switch (hg_proc_get_op(proc)) {
+        case HG_ENCODE:
+            if (p->len > 0)
+                hret = hg_proc_memcpy(proc, p->buf, p->len);
+            break;
+        case HG_DECODE:
+            p->buf = NULL;
+            if (p->len > 0) {
+                p->buf = malloc(p->len);
+                if (p->buf == NULL)
+                    return HG_NOMEM_ERROR;
+                hret = hg_proc_memcpy(proc, p->buf, p->len);
+            }
+            break;
+        case HG_FREE:
+            free(p->buf);
+            p->buf = NULL;
+            break;
+        default:
+            break;
+    }
+    return hret;
+}
+
+hg_return_t sized_rpc(hg_handle_t handle)
+{
+    hg_return_t hret;
+    sized_rpc_in_t in;
+    sized_rpc_out_t out;
+    uint64_t start;
+
+    count_handler(STAT_SIZED_RPC, &start);
+    hret = HG_Get_input(handle, &in);
     assert(hret == HG_SUCCESS);
 
-    // run the progress loop until we've got the output
-    do {
-        unsigned int count = 0;
+    /* respond out of the (read-only from here) rdma buffer */
+    out.payload.len = in.out_len;
+    if (out.payload.len > hserv.buf_sz)
+        out.payload.len = (hg_uint32_t) hserv.buf_sz;
+    out.payload.buf = hserv.buf;
+
+    hret = HG_Respond(handle, NULL, NULL, &out);
+    assert(hret == HG_SUCCESS);
+    time_handler(STAT_SIZED_RPC, start);
+
+    HG_Free_input(handle, &in);
+    HG_Destroy(handle);
+    return hret;
+}
+
+hg_return_t get_bulk_handle(hg_handle_t handle)
+{
+    hg_return_t hret;
+    get_bulk_handle_out_t out;
+    uint64_t start;
+
+    count_handler(STAT_GET_BULK_HANDLE, &start);
+    out.bh = hserv.bh;
+    out.num_ctx = (hg_uint32_t) num_server_ctx;
+    out.num_clients = (hg_uint32_t) hserv.num_to_check_in;
+
+    hret = HG_Respond(handle, NULL, NULL, &out);
+    assert(hret == HG_SUCCESS);
+    time_handler(STAT_GET_BULK_HANDLE, start);
+
+    HG_Destroy(handle);
+    return hret;
+}
+
+static volatile int do_shutdown = 0;
+static int shutdown_forwarded = 0;
+
+/* a proxy stops once the rest of the chain has the shutdown */
+static hg_return_t fwd_shutdown_cb(const struct hg_cb_info *info)
+{
+    struct fwd_op *op = info->arg;
+
+    fwd_done(op);
+    fwd_put(op);
+    do_shutdown = 1;
+    return HG_SUCCESS;
+}
+
+hg_return_t shutdown_server(hg_handle_t handle)
+{
+    hg_return_t hret;
+    uint64_t start;
+    count_handler(STAT_SHUTDOWN, &start);
+    hret = HG_Respond(handle, NULL, NULL, NULL);
+    time_handler(STAT_SHUTDOWN, start);
+    HG_Destroy(handle);
+    printf("server received shutdown request\n");
+    if (next_hop == HG_ADDR_NULL)
+        do_shutdown = 1;
+    else if (__sync_bool_compare_and_swap(&shutdown_forwarded, 0, 1))
+        fwd_send(fwd_get(FWD_SHUTDOWN), fwd_shutdown_cb, NULL);
+    return hret;
+}
+
+hg_return_t hg_proc_server_stats_t(hg_proc_t proc, void *data)
+{
+    /* all counters, so send it as a flat array of them */
+    hg_uint64_t *v = data;
+    hg_return_t hret = HG_SUCCESS;
+
+    for (size_t i = 0; i < sizeof(server_stats_t) / sizeof(*v); i++) {
+        hret = hg_proc_hg_uint64_t(proc, &v[i]);
+        if (hret != HG_SUCCESS)
+            break;
+    }
+    return hret;
+}
+
+void server_stats_diff(
+        const server_stats_t *a,
+        const server_stats_t *b,
+        server_stats_t *d)
+{
+    const hg_uint64_t *va = (const hg_uint64_t *) a;
+    const hg_uint64_t *vb = (const hg_uint64_t *) b;
+    hg_uint64_t *vd = (hg_uint64_t *) d;
+
+    for (size_t i = 0; i < sizeof(server_stats_t) / sizeof(*vd); i++)
+        vd[i] = vb[i] - va[i];
+}
+
+void server_stats_add(server_stats_t *d, const server_stats_t *a)
+{
+    const hg_uint64_t *va = (const hg_uint64_t *) a;
+    hg_uint64_t *vd = (hg_uint64_t *) d;
+
+    for (size_t i = 0; i < sizeof(server_stats_t) / sizeof(*vd); i++)
+        vd[i] += va[i];
+}
+
+/* sum the server threads' stats, and their handler histograms if hists is
+ * non-NULL */
+static void server_stats_collect(server_stats_t *st, struct lat_hist *hists)
+{
+    struct timespec now;
+
+    memset(st, 0, sizeof(*st));
+    if (hists)
+        for (int r = 0; r < STAT_NUM_RPCS; r++)
+            lat_hist_init(&hists[r]);
+    for (int i = 0; i < num_server_threads; i++) {
+        const server_stats_t *t = &server_threads[i].stats;
+        for (int r = 0; r < STAT_NUM_RPCS; r++) {
+            st->count[r] += t->count[r];
+            st->handler_ns[r] += t->handler_ns[r];
+            if (hists)
+                lat_hist_merge(&hists[r], &server_threads[i].handler_hist[r]);
+        }
+        st->bulk_bytes += t->bulk_bytes;
+        st->progress_calls += t->progress_calls;
+        st->callbacks += t->callbacks;
+        st->busy_ns += t->busy_ns;
+        st->idle_ns += t->idle_ns;
+        for (int r = 0; r < FWD_NUM_RPCS; r++) {
+            st->forwards[r] += t->forwards[r];
+            st->forward_ns[r] += t->forward_ns[r];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    st->uptime_ns = time_to_ns(timediff(server_start, now));
+}
+
+void server_stats_print(FILE *f)
+{
+    server_stats_t st;
+    struct lat_hist hists[STAT_NUM_RPCS];
+
+    server_stats_collect(&st, hists);
+    fprintf(f, "server stats %.3f %10lu %10lu %.3e %.3e %lu\n",
+            st.uptime_ns / 1e9, (unsigned long) st.progress_calls,
+            (unsigned long) st.callbacks, st.busy_ns / 1e9, st.idle_ns / 1e9,
+            (unsigned long) st.bulk_bytes);
+    report_begin("server_stats");
+    report_dbl("uptime", st.uptime_ns / 1e9);
+    report_int("progress_calls", (long long) st.progress_calls);
+    report_int("callbacks", (long long) st.callbacks);
+    report_dbl("busy", st.busy_ns / 1e9);
+    report_dbl("idle", st.idle_ns / 1e9);
+    report_int("bulk_bytes", (long long) st.bulk_bytes);
+    report_end();
+    for (int r = 0; r < STAT_NUM_RPCS; r++) {
+        if (st.count[r] == 0)
+            continue;
+        fprintf(f, "server stats rpc %-15s %10lu %.3e %.3e\n",
+                stat_rpc_names[r], (unsigned long) st.count[r],
+                st.handler_ns[r] / 1e9,
+                st.handler_ns[r] / 1e9 / st.count[r]);
+        report_begin("server_rpc");
+        report_str("rpc", stat_rpc_names[r]);
+        report_int("count", (long long) st.count[r]);
+        report_dbl("handler_total", st.handler_ns[r] / 1e9);
+        report_dbl("handler_avg", st.handler_ns[r] / 1e9 / st.count[r]);
+        report_end();
+        lat_hist_print(f, "server", stat_rpc_names[r], &hists[r]);
+    }
+    fflush(f);
+}
+
+hg_return_t get_stats(hg_handle_t handle)
+{
+    hg_return_t hret;
+    get_stats_out_t out;
+    uint64_t start;
+
+    count_handler(STAT_GET_STATS, &start);
+    server_stats_collect(&out.stats, NULL);
+
+    hret = HG_Respond(handle, NULL, NULL, &out);
+    assert(hret == HG_SUCCESS);
+    time_handler(STAT_GET_STATS, start);
+
+    HG_Destroy(handle);
+    return hret;
+}
+
+struct num_ctx_cb {
+    int is_finished;
+    unsigned int num_ctx;
+};
+
+static hg_return_t num_ctx_cli_cb(const struct hg_cb_info *info)
+{
+    struct num_ctx_cb *cb = info->arg;
+    get_bulk_handle_out_t out;
+    hg_return_t hret;
+
+    assert(info->ret == HG_SUCCESS);
+    hret = HG_Get_output(info->info.forward.handle, &out);
+    assert(hret == HG_SUCCESS);
+    cb->num_ctx = out.num_ctx;
+    HG_Free_output(info->info.forward.handle, &out);
+    cb->is_finished = 1;
+    return HG_SUCCESS;
+}
+
+unsigned int get_server_num_ctx(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int max_retries)
+{
+    struct num_ctx_cb cb = { 0, 1 };
+    hg_handle_t handle;
+    hg_return_t hret;
+
+    hret = HG_Create(hg->hgctx, svr, hg->get_bulk_handle_rpc_id, &handle);
+    if (hret != HG_SUCCESS)
+        return 1;
+    hret = HG_Forward(handle, num_ctx_cli_cb, &cb, NULL);
+    if (hret == HG_SUCCESS)
+        wait_until(hg->hgctx, &cb.is_finished, max_retries);
+    HG_Destroy(handle);
+    return cb.is_finished && cb.num_ctx > 0 ? cb.num_ctx : 1;
+}
+
+struct get_stats_cb {
+    int is_finished;
+    server_stats_t *st;
+};
+
+static hg_return_t get_stats_cli_cb(const struct hg_cb_info *info)
+{
+    struct get_stats_cb *cb = info->arg;
+    get_stats_out_t out;
+    hg_return_t hret;
+
+    assert(info->ret == HG_SUCCESS);
+    hret = HG_Get_output(info->info.forward.handle, &out);
+    assert(hret == HG_SUCCESS);
+    *cb->st = out.stats;
+    HG_Free_output(info->info.forward.handle, &out);
+    cb->is_finished = 1;
+    return HG_SUCCESS;
+}
+
+hg_return_t get_server_stats(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int max_retries,
+        server_stats_t *st)
+{
+    struct get_stats_cb cb = { 0, st };
+    hg_handle_t handle;
+    hg_return_t hret;
+
+    hret = HG_Create(hg->hgctx, svr, hg->get_stats_rpc_id, &handle);
+    if (hret != HG_SUCCESS)
+        return hret;
+    hret = HG_Forward(handle, get_stats_cli_cb, &cb, NULL);
+    if (hret == HG_SUCCESS)
+        hret = wait_until(hg->hgctx, &cb.is_finished, max_retries);
+    HG_Destroy(handle);
+    return hret;
+}
+
+static void start_pull(
+        struct pull_slot *b,
+        hg_handle_t handle,
+        struct pull_src *src,
+        uint64_t start);
+
+/* the whole pull has landed (and been relayed, on a proxy) - respond and
+ * pass the slot on */
+static hg_return_t finish_pull(struct pull_slot *b)
+{
+    hg_handle_t h = b->handle;
+    struct pull_req *req;
+    hg_return_t hret;
+
+    if (!pull_slots_pooled) {
+        HG_Bulk_free(b->bh);
+        b->bh = HG_BULK_NULL;
+    }
+    pull_src_free(h, &b->src);
+    b->handle = HG_HANDLE_NULL;
+
+    hret = HG_Respond(h, NULL, NULL, NULL);
+    time_handler(STAT_BULK_READ, b->start);
+    HG_Destroy(h);
+
+    /* hand the slot to the oldest waiter, if any */
+    pthread_mutex_lock(&pull_mutex);
+    req = pull_queue_head;
+    if (req) {
+        pull_queue_head = req->next;
+        if (pull_queue_head == NULL) pull_queue_tail = NULL;
+        pull_queue_stats.depth--;
+        uint64_t wait_ns = ticks_to_ns(ticks_now() - req->enqueued);
+        pull_queue_stats.wait_ns += wait_ns;
+        if (wait_ns > pull_queue_stats.max_wait_ns)
+            pull_queue_stats.max_wait_ns = wait_ns;
+    }
+    else {
+        b->next = pull_slots_free;
+        pull_slots_free = b;
+    }
+    pthread_mutex_unlock(&pull_mutex);
+
+    if (req) {
+        start_pull(b, req->handle, &req->src, req->enqueued);
+        free(req);
+    }
+
+    return hret;
+}
+
+static hg_return_t relay_pull_cb(const struct hg_cb_info *info)
+{
+    struct fwd_op *op = info->arg;
+    struct pull_slot *b = op->slot;
+
+    assert(info->ret == HG_SUCCESS);
+    fwd_done(op);
+    if (op->bh != HG_BULK_NULL) {
+        HG_Bulk_free(op->bh);
+        op->bh = HG_BULK_NULL;
+    }
+    fwd_put(op);
+    return finish_pull(b);
+}
+
+/* staging proxy: the slot holds the data, have the next hop pull it from
+ * here. The slot's own handle does if the data fills it, otherwise the
+ * next hop gets a handle over just the data */
+static hg_return_t relay_pull(struct pull_slot *b)
+{
+    struct fwd_op *op = fwd_get(FWD_BULK_READ);
+    bulk_read_in_t in;
+    hg_return_t hret;
+
+    op->slot = b;
+    if (b->total == b->sz)
+        in.bh = b->bh;
+    else {
+        hret = HG_Bulk_create(hserv.hgcl, 1, &b->buf, &b->total,
+                HG_BULK_READ_ONLY, &op->bh);
+        assert(hret == HG_SUCCESS);
+        in.bh = op->bh;
+    }
+    fwd_send(op, relay_pull_cb, &in);
+    return HG_SUCCESS;
+}
+
+/* the pull is done - zero-sized ones are answered here even on a proxy */
+static hg_return_t pull_landed(struct pull_slot *b)
+{
+    if (next_hop != HG_ADDR_NULL && b->total > 0)
+        return relay_pull(b);
+    return finish_pull(b);
+}
+
+static hg_return_t bulk_read_continuation(
+        const struct hg_cb_info *callback_info);
+
+/* post chunks until the window is full or the pull is covered - called with
+ * the slot lock held */
+static void issue_pull_chunks(struct pull_slot *b)
+{
+    hg_return_t hret;
+    struct hg_info *info = HG_Get_info(b->handle);
+    hg_addr_t from = b->src.addr != HG_ADDR_NULL ? b->src.addr : info->addr;
+    hg_size_t chunk = hg_server_opts.pull_chunk_size ?
+        hg_server_opts.pull_chunk_size : b->total;
+
+    while (b->free_chunks != NULL && b->next_off < b->total) {
+        struct pull_chunk *ch = b->free_chunks;
+        b->free_chunks = ch->next;
+        ch->off = b->next_off;
+        ch->len = b->total - ch->off < chunk ? b->total - ch->off : chunk;
+        b->next_off += ch->len;
+        b->pending++;
+        hret = HG_Bulk_transfer(info->context, bulk_read_continuation,
+            ch, HG_BULK_PULL, from, b->src.in.bh, ch->off, b->bh, ch->off,
+            ch->len, HG_OP_ID_IGNORE);
+        assert(hret == HG_SUCCESS);
+        if (cur_server_thread)
+            cur_server_thread->num_pull_chunks++;
+    }
+}
+
+static hg_return_t bulk_read_continuation(
+        const struct hg_cb_info *callback_info)
+{
+    struct pull_chunk *ch = callback_info->arg;
+    struct pull_slot *b = ch->slot;
+    int done;
+
+    if (cur_server_thread)
+        cur_server_thread->stats.bulk_bytes += ch->len;
+
+    pthread_mutex_lock(&b->lock);
+    ch->next = b->free_chunks;
+    b->free_chunks = ch;
+    b->pending--;
+    issue_pull_chunks(b);
+    done = (b->pending == 0);
+    pthread_mutex_unlock(&b->lock);
+
+    return done ? pull_landed(b) : HG_SUCCESS;
+}
+
+/* issue the pull for a request that owns slot b */
+static void start_pull(
+        struct pull_slot *b,
+        hg_handle_t handle,
+        struct pull_src *src,
+        uint64_t start)
+{
+    hg_return_t hret;
+    hg_size_t in_buf_sz = HG_Bulk_get_size(src->in.bh);
+
+    // register the slot's buffer if it isn't already
+    if (!pull_slots_pooled) {
+        uint64_t reg_start = ticks_now();
+        hret = HG_Bulk_create(hserv.hgcl, 1, &b->buf, &b->sz,
+                pull_slot_perm(), &b->bh);
+        assert(hret == HG_SUCCESS);
+        if (cur_server_thread) {
+            cur_server_thread->num_bulk_regs++;
+            cur_server_thread->bulk_reg_ns +=
+                ticks_to_ns(ticks_now() - reg_start);
+        }
+    }
+
+    // perform the bulk transfer - the input and handle are released in
+    // finish_pull once we've responded
+    pthread_mutex_lock(&b->lock);
+    b->handle = handle;
+    b->start = start;
+    b->src = *src;
+    b->total = in_buf_sz > b->sz ? b->sz : in_buf_sz;
+    b->next_off = 0;
+    b->pending = 0;
+    issue_pull_chunks(b);
+    pthread_mutex_unlock(&b->lock);
+
+    /* nothing to move (zero-sized client buffer) */
+    if (b->total == 0)
+        pull_landed(b);
+}
+
+/* grab a slot and pull, or wait in line for one */
+static void pull_or_queue(
+        hg_handle_t handle,
+        struct pull_src *src,
+        uint64_t start)
+{
+    struct pull_slot *b;
+
+    if (cur_server_thread)
+        cur_server_thread->num_bulk_reads++;
+
+    pthread_mutex_lock(&pull_mutex);
+    if (pull_slots == NULL)
+        pull_slots_alloc();
+    b = pull_slots_free;
+    if (b)
+        pull_slots_free = b->next;
+    else if (max_pull_slots == 0)
+        b = pull_slot_new();
+    else {
+        struct pull_req *req = malloc(sizeof(*req));
+        assert(req);
+        req->handle = handle;
+        req->src = *src;
+        req->next = NULL;
+        req->enqueued = start;
+        if (pull_queue_tail)
+            pull_queue_tail->next = req;
+        else
+            pull_queue_head = req;
+        pull_queue_tail = req;
+        pull_queue_stats.num_queued++;
+        if (++pull_queue_stats.depth > pull_queue_stats.max_depth)
+            pull_queue_stats.max_depth = pull_queue_stats.depth;
+    }
+    pthread_mutex_unlock(&pull_mutex);
+
+    if (b)
+        start_pull(b, handle, src, start);
+}
+
+/* bulk_read_from origins, looked up once and kept for the server's life */
+struct origin {
+    char *name;
+    hg_addr_t addr;
+    struct origin *next;
+};
+static struct origin *origins = NULL;
+static pthread_mutex_t origin_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* cached address of name, or HG_ADDR_NULL. If addr is given it is cached
+ * unless another lookup got there first (in which case it is freed) */
+static hg_addr_t origin_cache(char const *name, hg_addr_t addr)
+{
+    struct origin *o;
+
+    pthread_mutex_lock(&origin_mutex);
+    for (o = origins; o != NULL; o = o->next)
+        if (strcmp(o->name, name) == 0)
+            break;
+    if (o == NULL && addr != HG_ADDR_NULL) {
+        o = malloc(sizeof(*o));
+        assert(o);
+        o->name = strdup(name);
+        assert(o->name);
+        o->addr = addr;
+        o->next = origins;
+        origins = o;
+    }
+    else if (o != NULL && addr != HG_ADDR_NULL)
+        HG_Addr_free(hserv.hgcl, addr);
+    pthread_mutex_unlock(&origin_mutex);
+    return o ? o->addr : HG_ADDR_NULL;
+}
+
+static void origins_fini(void)
+{
+    while (origins != NULL) {
+        struct origin *o = origins;
+        origins = o->next;
+        HG_Addr_free(hserv.hgcl, o->addr);
+        free(o->name);
+        free(o);
+    }
+}
+
+/* a bulk_read_from waiting on its origin's lookup */
+struct origin_lookup {
+    hg_handle_t handle;
+    struct pull_src src;
+    uint64_t start;
+};
+
+static hg_return_t origin_lookup_cb(const struct hg_cb_info *info)
+{
+    struct origin_lookup *l = info->arg;
+
+    assert(info->ret == HG_SUCCESS);
+    l->src.addr = origin_cache(l->src.in.origin, info->info.lookup.addr);
+    pull_or_queue(l->handle, &l->src, l->start);
+    free(l);
+    return HG_SUCCESS;
+}
+
+/* direct proxy: pass the request on with its origin - the sender, unless
+ * it came from an upstream proxy - for the last hop to pull from. The
+ * input is released once the next hop answers */
+static void forward_bulk_read(
+        hg_handle_t handle,
+        struct pull_src *src,
+        uint64_t start)
+{
+    struct fwd_op *op = fwd_get(FWD_BULK_READ_FROM);
+    bulk_read_from_in_t in;
+    char origin[256];
+    hg_return_t hret;
+
+    in.bh = src->in.bh;
+    if (src->from)
+        in.origin = src->in.origin;
+    else {
+        hg_size_t len = sizeof(origin);
+        hret = HG_Addr_to_string(hserv.hgcl, origin, &len,
+                HG_Get_info(handle)->addr);
+        assert(hret == HG_SUCCESS);
+        in.origin = origin;
+    }
+    op->handle = handle;
+    op->start = start;
+    op->src = *src;
+    fwd_send(op, fwd_respond_cb, &in);
+}
+
+static void serve_bulk_read(
+        hg_handle_t handle,
+        struct pull_src *src,
+        uint64_t start)
+{
+    hg_return_t hret;
+
+    if (next_hop != HG_ADDR_NULL && hg_server_opts.forward_bulk_direct) {
+        forward_bulk_read(handle, src, start);
+        return;
+    }
+    if (src->from) {
+        src->addr = origin_cache(src->in.origin, HG_ADDR_NULL);
+        if (src->addr == HG_ADDR_NULL) {
+            struct origin_lookup *l = malloc(sizeof(*l));
+            assert(l);
+            l->handle = handle;
+            l->src = *src;
+            l->start = start;
+            hret = HG_Addr_lookup(HG_Get_info(handle)->context,
+                    origin_lookup_cb, l, src->in.origin, HG_OP_ID_IGNORE);
+            assert(hret == HG_SUCCESS);
+            return;
+        }
+    }
+    pull_or_queue(handle, src, start);
+}
+
+hg_return_t bulk_read(hg_handle_t handle)
+{
+    // get bulk handle to read from
+    hg_return_t hret;
+    bulk_read_in_t in;
+    struct pull_src src;
+    uint64_t start;
+    count_handler(STAT_BULK_READ, &start);
+    hret = HG_Get_input(handle, &in);
+    assert(hret == HG_SUCCESS);
+
+    src.in.bh = in.bh;
+    src.in.origin = NULL;
+    src.from = 0;
+    src.addr = HG_ADDR_NULL;
+    serve_bulk_read(handle, &src, start);
+
+    return HG_SUCCESS;
+}
+
+/* bulk_read relayed by a direct proxy, pulling from its origin */
+hg_return_t bulk_read_from(hg_handle_t handle)
+{
+    hg_return_t hret;
+    struct pull_src src;
+    uint64_t start;
+    count_handler(STAT_BULK_READ, &start);
+    hret = HG_Get_input(handle, &src.in);
+    assert(hret == HG_SUCCESS);
+
+    src.from = 1;
+    src.addr = HG_ADDR_NULL;
+    serve_bulk_read(handle, &src, start);
+
+    return HG_SUCCESS;
+}
+
+/* progress/trigger loop for one server thread */
+static void * server_progress_run(void *arg)
+{
+    struct server_thread *t = arg;
+    hg_return_t hret;
+    uint64_t t0, t1, t2;
+    unsigned int num_cb;
+
+    cur_server_thread = t;
+    if (t->idx > 0)
+        pin_thread(t->idx);
+    get_placement(&t->cpu, &t->node);
+
+    /* unclear whether this is the correct processing loop or not for single
+     * threaded */
+    t0 = ticks_now();
+    do {
+        num_cb = 0;
+        hret = trigger_ready(t->ctx, &num_cb);
+        if (hret != HG_SUCCESS)
+            break;
+        t1 = ticks_now();
+        hret = progress_wait(t->ctx, 1000);
+        t2 = ticks_now();
+        t->stats.callbacks += num_cb;
+        t->stats.progress_calls++;
+        t->stats.busy_ns += ticks_to_ns(t1 - t0);
+        t->stats.idle_ns += ticks_to_ns(t2 - t1);
+        t0 = t2;
+        if (t->idx == 0 && dump_stats) {
+            dump_stats = 0;
+            server_stats_print(stdout);
+        }
+    } while((hret == HG_SUCCESS || hret == HG_TIMEOUT) && !do_shutdown);
+
+    cur_server_thread = NULL;
+    return NULL;
+}
+
+static void dump_stats_handler(int sig)
+{
+    (void) sig;
+    dump_stats = 1;
+}
+
+void run_server(
+        size_t rdma_size,
+        char const * listen_addr,
+        char const * id_str,
+        int num_checkins)
+{
+    hg_return_t hret;
+    FILE *f;
+    char * nm;
+    hg_size_t nm_len = 256;
+    char * fname;
+    char const * addr_fd;
+    struct cpu_time cpu_start, cpu_end;
+    struct sigaction sa;
+
+    if (id_str) {
+        fname = malloc(strlen(id_str)+strlen(ADDR_FNAME)+2);
+        assert(fname);
+        sprintf(fname, "%s-%s", ADDR_FNAME, id_str);
+    }
+    else
+        fname = strdup(ADDR_FNAME);
+
+    hg_init(listen_addr, rdma_size, HG_TRUE, num_checkins, &hserv);
+
+    /* a proxy finds its next hop before anyone can find it, so a chain
+     * comes up back to front */
+    if (hg_server_opts.forward_to) {
+        next_hop = lookup_serv_addr(&hserv, hg_server_opts.forward_to);
+        assert(next_hop != HG_ADDR_NULL);
+    }
+
+    /* in pooled mode the pool size is the concurrency limit */
+    if (hg_server_opts.bulk_pool_count > 0)
+        pull_slots_init(hg_server_opts.bulk_pool_count,
+                hg_server_opts.bulk_pool_size ? hg_server_opts.bulk_pool_size
+                                              : rdma_size, 1);
+    else
+        pull_slots_init(hg_server_opts.max_pulls,
+                hg_server_opts.bulk_pool_size ? hg_server_opts.bulk_pool_size
+                                              : rdma_size, 0);
+
+    /* print out server addr to file (or the launcher's pipe) */
+    addr_fd = getenv(ADDR_FD_ENV);
+    if (addr_fd)
+        f = fdopen(atoi(addr_fd), "w");
+    else
+        f = fopen(fname, "w");
+    assert(f);
+
+    nm = malloc(nm_len);
+    assert(nm);
+    hret = HG_Addr_to_string(hserv.hgcl, nm, &nm_len, hserv.self);
+    assert(hret == HG_SUCCESS);
+
+    fprintf(f, "%s\n", nm);
+    fclose(f);
+
+    free(nm);
+    free(fname);
+
+    /* set up the loops - thread 0 is the calling thread and always owns the
+     * context created by hg_init */
+    int nthreads = hg_server_opts.num_threads;
+    server_threads = calloc(nthreads, sizeof(*server_threads));
+    assert(server_threads);
+    num_server_threads = nthreads;
+    num_server_ctx = hg_server_opts.shared_context ? 1 : nthreads;
+    for (int i = 0; i < nthreads; i++) {
+        server_threads[i].idx = i;
+        for (int r = 0; r < STAT_NUM_RPCS; r++)
+            lat_hist_init(&server_threads[i].handler_hist[r]);
+        if (i == 0 || hg_server_opts.shared_context)
+            server_threads[i].ctx = hserv.hgctx;
+        else {
+            server_threads[i].ctx = HG_Context_create_id(hserv.hgcl,
+                    (hg_uint8_t) i);
+            assert(server_threads[i].ctx != NULL);
+        }
+    }
+    if (next_hop != HG_ADDR_NULL)
+        fwd_pools_init(num_server_ctx);
+    /* kill -USR1 dumps the stats so far */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_stats_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &server_start);
+    get_cpu_time(0, &cpu_start);
+    for (int i = 1; i < nthreads; i++) {
+        int rc = pthread_create(&server_threads[i].tid, NULL,
+                server_progress_run, &server_threads[i]);
+        assert(rc == 0);
+    }
+
+    server_progress_run(&server_threads[0]);
+
+    for (int i = 1; i < nthreads; i++) {
+        int rc = pthread_join(server_threads[i].tid, NULL);
+        assert(rc == 0);
+    }
+    get_cpu_time(0, &cpu_end);
+
+    /* final stats (see server_stats_print for the format) */
+    server_stats_print(stdout);
+
+    /* format: server forward <rpc> <direct bulk (bool)> <# forwards>
+     *   <avg next hop time>, one line per RPC passed on */
+    if (next_hop != HG_ADDR_NULL) {
+        server_stats_t st;
+        server_stats_collect(&st, NULL);
+        for (int r = 0; r < FWD_NUM_RPCS; r++) {
+            if (st.forwards[r] == 0)
+                continue;
+            printf("server forward %-15s %d %10lu %.3e\n", fwd_rpc_names[r],
+                    hg_server_opts.forward_bulk_direct,
+                    (unsigned long) st.forwards[r],
+                    st.forward_ns[r] / 1e9 / st.forwards[r]);
+            report_begin("server_forward");
+            report_str("next_hop", hg_server_opts.forward_to);
+            report_str("rpc", fwd_rpc_names[r]);
+            report_int("direct_bulk", hg_server_opts.forward_bulk_direct);
+            report_int("forwards", (long long) st.forwards[r]);
+            report_dbl("next_hop_avg",
+                    st.forward_ns[r] / 1e9 / st.forwards[r]);
+            report_end();
+        }
+    }
+
+    /* format: server thread <idx> <# contexts> <# handlers run> <cpu>
+     *   <numa node> */
+    unsigned long num_reads = 0, num_regs = 0, num_chunks = 0;
+    uint64_t reg_ns = 0;
+    for (int i = 0; i < nthreads; i++) {
+        printf("server thread %3d %3d %10lu %3d %2d\n", i, num_server_ctx,
+                server_threads[i].num_handled, server_threads[i].cpu,
+                server_threads[i].node);
+        report_begin("server_thread");
+        report_int("thread", i);
+        report_int("contexts", num_server_ctx);
+        report_int("handled", (long long) server_threads[i].num_handled);
+        report_int("cpu", server_threads[i].cpu);
+        report_int("node", server_threads[i].node);
+        report_end();
+        num_reads += server_threads[i].num_bulk_reads;
+        num_regs += server_threads[i].num_bulk_regs;
+        num_chunks += server_threads[i].num_pull_chunks;
+        reg_ns += server_threads[i].bulk_reg_ns;
+        if (server_threads[i].ctx != hserv.hgctx)
+            HG_Context_destroy(server_threads[i].ctx);
+    }
+    free(server_threads);
+    server_threads = NULL;
+    num_server_threads = 0;
+
+    /* format: server progress all <mode> <spin us> <trigger batch>
+     *   <user cpu s> <sys cpu s> (whole process, all threads) */
+    progress_print(stdout, "server", "all", &cpu_start, &cpu_end);
+
+    /* format: server bulk_read <pooled (bool)> <# slots> <# reads>
+     *   <# registrations> <total registration time> <avg registration time>
+     *   <# queued> <max queue depth> <avg queue wait> <max queue wait>
+     *   <chunk size (0 = whole)> <chunks in flight> <# chunks> */
+    if (num_reads > 0) {
+        printf("server bulk_read %d %4d %10lu %10lu %.3e %.3e "
+                "%10lu %5d %.3e %.3e %10lu %3d %10lu\n",
+                pull_slots_pooled, num_pull_slots, num_reads, num_regs,
+                reg_ns / 1e9, num_regs ? reg_ns / 1e9 / num_regs : 0.0,
+                pull_queue_stats.num_queued, pull_queue_stats.max_depth,
+                pull_queue_stats.num_queued ?
+                    pull_queue_stats.wait_ns / 1e9 / pull_queue_stats.num_queued
+                    : 0.0,
+                pull_queue_stats.max_wait_ns / 1e9,
+                (unsigned long) hg_server_opts.pull_chunk_size,
+                hg_server_opts.pull_chunks_in_flight, num_chunks);
+        report_begin("server_bulk_read");
+        report_int("pooled", pull_slots_pooled);
+        report_int("slots", num_pull_slots);
+        report_int("reads", (long long) num_reads);
+        report_int("registrations", (long long) num_regs);
+        report_dbl("reg_total", reg_ns / 1e9);
+        report_dbl("reg_avg", num_regs ? reg_ns / 1e9 / num_regs : 0.0);
+        report_int("queued", (long long) pull_queue_stats.num_queued);
+        report_int("max_queue_depth", pull_queue_stats.max_depth);
+        report_dbl("queue_wait_avg", pull_queue_stats.num_queued ?
+                pull_queue_stats.wait_ns / 1e9 / pull_queue_stats.num_queued
+                : 0.0);
+        report_dbl("queue_wait_max", pull_queue_stats.max_wait_ns / 1e9);
+        report_int("chunk_size", (long long) hg_server_opts.pull_chunk_size);
+        report_int("chunks_in_flight", hg_server_opts.pull_chunks_in_flight);
+        report_int("chunks", (long long) num_chunks);
+        report_end();
+    }
+
+    pull_slots_fini();
+    origins_fini();
+    if (next_hop != HG_ADDR_NULL) {
+        fwd_pools_fini();
+        HG_Addr_free(hserv.hgcl, next_hop);
+        next_hop = HG_ADDR_NULL;
+    }
+
+    hg_fini(&hserv);
+}
+
+void lat_hist_init(struct lat_hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min_ns = UINT64_MAX;
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+    for (int i = 0; i < LAT_HIST_NUM_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+}
+
+/* highest value that maps to bucket i */
+static uint64_t lat_hist_bucket_top(int i)
+{
+    int shift;
+    uint64_t sub;
+    if (i < 2 * LAT_HIST_SUB_COUNT)
+        return (uint64_t) i;
+    shift = i / LAT_HIST_SUB_COUNT - 1;
+    sub = (uint64_t) (i % LAT_HIST_SUB_COUNT + LAT_HIST_SUB_COUNT);
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t lat_hist_percentile(const struct lat_hist *h, double pct)
+{
+    uint64_t target, cnt = 0;
+
+    if (h->total == 0)
+        return 0;
+    target = (uint64_t) (pct / 100.0 * (double) h->total + 0.5);
+    if (target < 1) target = 1;
+    if (target > h->total) target = h->total;
+
+    for (int i = 0; i < LAT_HIST_NUM_BUCKETS; i++) {
+        cnt += h->counts[i];
+        if (cnt >= target) {
+            uint64_t v = lat_hist_bucket_top(i);
+            return v > h->max_ns ? h->max_ns : v;
+        }
+    }
+    return h->max_ns;
+}
+
+void lat_hist_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct lat_hist *h)
+{
+    fprintf(f, "%s lat %-12s %7lu %.3e %.3e %.3e %.3e %.3e\n",
+            prefix, label, (unsigned long) h->total,
+            lat_hist_percentile(h, 50.0) / 1e9,
+            lat_hist_percentile(h, 90.0) / 1e9,
+            lat_hist_percentile(h, 99.0) / 1e9,
+            lat_hist_percentile(h, 99.9) / 1e9,
+            h->max_ns / 1e9);
+
+    report_begin("lat");
+    report_str("label", label);
+    report_int("count", (long long) h->total);
+    report_dbl("p50", lat_hist_percentile(h, 50.0) / 1e9);
+    report_dbl("p90", lat_hist_percentile(h, 90.0) / 1e9);
+    report_dbl("p99", lat_hist_percentile(h, 99.0) / 1e9);
+    report_dbl("p999", lat_hist_percentile(h, 99.9) / 1e9);
+    report_dbl("max", h->max_ns / 1e9);
+    report_end();
+}
+
+void lat_hist_print_buckets(FILE *f, const struct lat_hist *h)
+{
+    /* fold the linear sub-buckets into powers of two */
+    uint64_t lo = 0, hi = 0, cnt = 0;
+
+    fprintf(f, "# histogram: <low (s)> <high (s)> <count>\n");
+    for (int i = 0; i < LAT_HIST_NUM_BUCKETS; i++) {
+        uint64_t top = lat_hist_bucket_top(i);
+        cnt += h->counts[i];
+        /* close a range at each power of two boundary */
+        if (((top + 1) & top) == 0 || i == LAT_HIST_NUM_BUCKETS - 1) {
+            hi = top;
+            if (cnt > 0)
+                fprintf(f, "#   %.3e %.3e %lu\n", lo / 1e9, hi / 1e9,
+                        (unsigned long) cnt);
+            lo = hi + 1;
+            cnt = 0;
+        }
+    }
+}
+
+int lat_hist_write(const struct lat_hist *h, char const *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "%lu %lu %lu\n", (unsigned long) h->total,
+            (unsigned long) h->min_ns, (unsigned long) h->max_ns);
+    for (int i = 0; i < LAT_HIST_NUM_BUCKETS; i++) {
+        if (h->counts[i])
+            fprintf(f, "%d %lu\n", i, (unsigned long) h->counts[i]);
+    }
+    return fclose(f);
+}
+
+int lat_hist_read_merge(struct lat_hist *dst, char const *fname)
+{
+    struct lat_hist in;
+    unsigned long total, min_ns, max_ns, cnt;
+    int i;
+    FILE *f = fopen(fname, "r");
+
+    if (!f)
+        return -1;
+    lat_hist_init(&in);
+    if (fscanf(f, "%lu %lu %lu", &total, &min_ns, &max_ns) != 3) {
+        fclose(f);
+        return -1;
+    }
+    in.total = total;
+    in.min_ns = min_ns;
+    in.max_ns = max_ns;
+    while (fscanf(f, "%d %lu", &i, &cnt) == 2) {
+        if (i >= 0 && i < LAT_HIST_NUM_BUCKETS)
+            in.counts[i] = cnt;
+    }
+    fclose(f);
+    lat_hist_merge(dst, &in);
+    return 0;
+}
+
+char const * const server_opts_usage =
+"  server threading options (server mode only):\n"
+"    --server-threads N runs N progress/trigger threads, each on its own\n"
+"      HG context (RPCs are spread over contexts by the clients)\n"
+"    --server-shared-ctx has all server threads share one HG context\n"
+"    --max-pulls M caps concurrent bulk_read pulls at M, each into its\n"
+"      own buffer; further requests are queued (default 0: no cap)\n"
+"    --bulk-pool N pre-registers N pull buffers rather than registering\n"
+"      one on every call (N replaces the --max-pulls limit)\n"
+"    --bulk-pool-size BYTES sets the pull buffer size (default: rdma size)\n"
+"    --pull-chunk BYTES splits each bulk_read pull into chunks of BYTES\n"
+"    --pull-chunks-inflight K keeps up to K chunks of a pull in flight\n"
+"      (default 1)\n"
+"    --forward-to ADDR makes this server a proxy: noop and bulk_read are\n"
+"      forwarded to the server at ADDR and answered once it answers\n"
+"    --forward-bulk stage|direct has a proxy pull bulk_read data into a\n"
+"      slot for the next hop to pull from there (stage, default), or pass\n"
+"      the client's handle on for the last hop to pull from the client\n"
+"      (direct - the client's address must be resolvable by it)\n";
+
+int parse_server_opt(int argc, char *argv[], int *arg)
+{
+    if (strcmp(argv[*arg], "--server-threads") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.num_threads = atoi(argv[*arg+1]);
+        if (hg_server_opts.num_threads < 1)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--bulk-pool") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.bulk_pool_count = atoi(argv[*arg+1]);
+        if (hg_server_opts.bulk_pool_count < 0)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--max-pulls") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.max_pulls = atoi(argv[*arg+1]);
+        if (hg_server_opts.max_pulls < 0)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--pull-chunk") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.pull_chunk_size =
+            (size_t) strtoul(argv[*arg+1], NULL, 10);
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--pull-chunks-inflight") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.pull_chunks_in_flight = atoi(argv[*arg+1]);
+        if (hg_server_opts.pull_chunks_in_flight < 1)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--bulk-pool-size") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.bulk_pool_size =
+            (size_t) strtoul(argv[*arg+1], NULL, 10);
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--forward-to") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_server_opts.forward_to = argv[*arg+1];
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--forward-bulk") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        if (strcmp(argv[*arg+1], "stage") == 0)
+            hg_server_opts.forward_bulk_direct = 0;
+        else if (strcmp(argv[*arg+1], "direct") == 0)
+            hg_server_opts.forward_bulk_direct = 1;
+        else
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--server-shared-ctx") == 0) {
+        hg_server_opts.shared_context = 1;
+        *arg += 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int *cpu_list = NULL;
+static int cpu_list_len = 0;
+static int cpu_base = -1;
+
+char const * const cpu_opts_usage =
+"  placement options (any mode, before client/server):\n"
+"    --cpu N pins the main thread to cpu N, and benchmark / progress\n"
+"      threads to N+1, N+2, ...\n"
+"    --cpu-list LIST (e.g. 0,2,4-7) pins thread i to the i-th cpu of LIST,\n"
+"      wrapping around\n";
+
+int parse_cpu_opt(int argc, char *argv[], int *arg)
+{
+    if (strcmp(argv[*arg], "--cpu") == 0) {
+        if (*arg+1 >= argc || !isdigit((unsigned char) argv[*arg+1][0]))
+            return -1;
+        cpu_base = atoi(argv[*arg+1]);
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--cpu-list") == 0) {
+        if (*arg+1 >= argc ||
+                parse_cpu_list(argv[*arg+1], &cpu_list, &cpu_list_len) != 0)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    return 0;
+}
+
+void pin_thread(int idx)
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (cpu_list_len > 0)
+        cpu = cpu_list[idx % cpu_list_len];
+    else if (cpu_base >= 0)
+        cpu = cpu_base + idx;
+    else
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        fprintf(stderr, "warning: unable to pin thread %d to cpu %d\n",
+                idx, cpu);
+}
+
+void get_placement(int *cpu, int *node)
+{
+    char path[64];
+    DIR *d;
+    struct dirent *e;
+
+    *cpu = sched_getcpu();
+    *node = -1;
+    if (*cpu < 0)
+        return;
+
+    /* sysfs lists the cpu's node as a nodeN entry */
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", *cpu);
+    d = opendir(path);
+    if (d == NULL)
+        return;
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "node", 4) == 0 &&
+                isdigit((unsigned char) e->d_name[4])) {
+            *node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+}
+
+char const * const progress_opts_usage =
+"  progress options (any mode, before client/server):\n"
+"    --progress MODE drives the benchmark loops with MODE: \"block\"\n"
+"      (HG_Progress with a timeout, default), \"busy\" (timeout 0) or\n"
+"      \"spin:US\" (busy-poll for US microseconds, then block) or \"epoll\"\n"
+"      (sleep in epoll on the context's wait fd and a timerfd, progressing\n"
+"      only when woken - needs a plugin with a wait fd)\n"
+"    --trigger-batch N runs up to N callbacks per HG_Trigger call\n"
+"      (default 1)\n";
+
+int parse_progress_opt(int argc, char *argv[], int *arg)
+{
+    char const *mode;
+
+    if (strcmp(argv[*arg], "--progress") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        mode = argv[*arg+1];
+        if (strcmp(mode, "block") == 0)
+            hg_progress_opts.mode = PROGRESS_BLOCK;
+        else if (strcmp(mode, "busy") == 0)
+            hg_progress_opts.mode = PROGRESS_BUSY;
+        else if (strcmp(mode, "epoll") == 0)
+            hg_progress_opts.mode = PROGRESS_EPOLL;
+        else if (strncmp(mode, "spin:", 5) == 0 && isdigit(mode[5])) {
+            hg_progress_opts.mode = PROGRESS_SPIN;
+            hg_progress_opts.spin_us = (unsigned int) atoi(mode + 5);
+        }
+        else
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--trigger-batch") == 0) {
+        if (*arg+1 >= argc || atoi(argv[*arg+1]) < 1)
+            return -1;
+        hg_progress_opts.trigger_batch = (unsigned int) atoi(argv[*arg+1]);
+        *arg += 2;
+        return 1;
+    }
+    return 0;
+}
+
+char const * const report_opts_usage =
+"  report options (any mode, before client/server):\n"
+"    --report FORMAT also writes results as records of named fields plus\n"
+"      run metadata, FORMAT being \"json\" (JSON lines) or \"csv\"\n"
+"    --report-file FILE appends the records to FILE instead of mixing them\n"
+"      into stdout\n";
+
+int parse_report_opt(int argc, char *argv[], int *arg)
+{
+    if (strcmp(argv[*arg], "--report") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        if (strcmp(argv[*arg+1], "json") == 0)
+            hg_report_format = REPORT_JSON;
+        else if (strcmp(argv[*arg+1], "csv") == 0)
+            hg_report_format = REPORT_CSV;
+        else
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--report-file") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        report.fname = argv[*arg+1];
+        *arg += 2;
+        return 1;
+    }
+    return 0;
+}
+
+/* set key in a field list, in place if it's already there so columns keep
+ * their order */
+static void report_set(
+        struct report_field *fields,
+        int *num,
+        char const *key,
+        char const *val,
+        int is_str)
+{
+    int i;
+
+    for (i = 0; i < *num; i++)
+        if (strcmp(fields[i].key, key) == 0)
+            break;
+    if (i == *num) {
+        if (*num == REPORT_MAX_FIELDS)
+            return;
+        (*num)++;
+    }
+    snprintf(fields[i].key, sizeof(fields[i].key), "%s", key);
+    snprintf(fields[i].val, sizeof(fields[i].val), "%s", val);
+    fields[i].is_str = is_str;
+}
+
+/* open the output and make up the run id, once */
+static void report_open(void)
+{
+    if (report.f)
+        return;
+    if (report.fname) {
+        report.f = fopen(report.fname, "a");
+        if (report.f == NULL) {
+            fprintf(stderr, "warning: unable to open %s, reporting to "
+                    "stdout\n", report.fname);
+            report.f = stdout;
+        }
+    }
+    else
+        report.f = stdout;
+    if (gethostname(report.host, sizeof(report.host)) != 0)
+        strcpy(report.host, "unknown");
+    report.host[sizeof(report.host)-1] = '\0';
+    report.start = time(NULL);
+    snprintf(report.run, sizeof(report.run), "%s-%d-%ld", report.host,
+            (int) getpid(), (long) report.start);
+}
+
+static void report_put(char const *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (report.len >= sizeof(report.buf))
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(report.buf + report.len, sizeof(report.buf) - report.len,
+            fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        report.len += (size_t) n;
+}
+
+/* a value as a JSON string / CSV cell */
+static void report_put_quoted(char const *val)
+{
+    char const *c;
+
+    if (hg_report_format == REPORT_CSV) {
+        if (strpbrk(val, ",\"\n") == NULL) {
+            report_put("%s", val);
+            return;
+        }
+        report_put("\"");
+        for (c = val; *c; c++) {
+            if (*c == '"')
+                report_put("\"\"");
+            else
+                report_put("%c", *c);
+        }
+        report_put("\"");
+        return;
+    }
+    report_put("\"");
+    for (c = val; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            report_put("\\%c", *c);
+        else if ((unsigned char) *c < 0x20)
+            report_put("\\u%04x", (unsigned char) *c);
+        else
+            report_put("%c", *c);
+    }
+    report_put("\"");
+}
+
+static void report_put_field(const struct report_field *fl, int first)
+{
+    if (hg_report_format == REPORT_CSV) {
+        if (!first)
+            report_put(",");
+        if (fl->is_str)
+            report_put_quoted(fl->val);
+        else
+            report_put("%s", fl->val);
+        return;
+    }
+    report_put("%s\"%s\":", first ? "" : ",", fl->key);
+    if (fl->is_str)
+        report_put_quoted(fl->val);
+    else
+        report_put("%s", fl->val);
+}
+
+void report_ctx_clear(void)
+{
+    pthread_mutex_lock(&report.lock);
+    report.num_ctx = 0;
+    pthread_mutex_unlock(&report.lock);
+}
+
+void report_ctx_str(char const *key, char const *val)
+{
+    pthread_mutex_lock(&report.lock);
+    report_set(report.ctx, &report.num_ctx, key, val, 1);
+    pthread_mutex_unlock(&report.lock);
+}
+
+void report_ctx_int(char const *key, long long val)
+{
+    char v[32];
+
+    snprintf(v, sizeof(v), "%lld", val);
+    pthread_mutex_lock(&report.lock);
+    report_set(report.ctx, &report.num_ctx, key, v, 0);
+    pthread_mutex_unlock(&report.lock);
+}
+
+void report_begin(char const *kind)
+{
+    if (!report_enabled())
+        return;
+    pthread_mutex_lock(&report.lock);
+    report_open();
+    report.num_rec = 0;
+    report_set(report.rec, &report.num_rec, "kind", kind, 1);
+    report_set(report.rec, &report.num_rec, "run", report.run, 1);
+    report_set(report.rec, &report.num_rec, "class",
+            report.class ? report.class : "default", 1);
+    report_set(report.rec, &report.num_rec, "transport",
+            report.transport ? report.transport : "", 1);
+    for (int i = 0; i < report.num_ctx; i++)
+        report_set(report.rec, &report.num_rec, report.ctx[i].key,
+                report.ctx[i].val, report.ctx[i].is_str);
+}
+
+void report_str(char const *key, char const *val)
+{
+    if (!report_enabled())
+        return;
+    report_set(report.rec, &report.num_rec, key, val, 1);
+}
+
+void report_int(char const *key, long long val)
+{
+    char v[32];
+
+    if (!report_enabled())
+        return;
+    snprintf(v, sizeof(v), "%lld", val);
+    report_set(report.rec, &report.num_rec, key, v, 0);
+}
+
+void report_dbl(char const *key, double val)
+{
+    char v[32];
+
+    if (!report_enabled())
+        return;
+    /* JSON has no inf / nan */
+    if (isfinite(val))
+        snprintf(v, sizeof(v), "%.9g", val);
+    else
+        snprintf(v, sizeof(v), "%s",
+                hg_report_format == REPORT_JSON ? "null" : "");
+    report_set(report.rec, &report.num_rec, key, v, 0);
+}
+
+void report_end(void)
+{
+    int i;
+
+    if (!report_enabled())
+        return;
+    report.len = 0;
+    if (hg_report_format == REPORT_CSV) {
+        /* new header row whenever the columns change */
+        size_t hlen = 0;
+        char hdr[sizeof(report.last_hdr)];
+        hdr[0] = '\0';
+        for (i = 0; i < report.num_rec && hlen < sizeof(hdr); i++)
+            hlen += (size_t) snprintf(hdr + hlen, sizeof(hdr) - hlen,
+                    "%s%s", i ? "," : "", report.rec[i].key);
+        if (strcmp(hdr, report.last_hdr) != 0) {
+            strcpy(report.last_hdr, hdr);
+            report_put("%s\n", hdr);
+        }
+        for (i = 0; i < report.num_rec; i++)
+            report_put_field(&report.rec[i], i == 0);
+        report_put("\n");
+    }
+    else {
+        report_put("{");
+        for (i = 0; i < report.num_rec; i++)
+            report_put_field(&report.rec[i], i == 0);
+        report_put("}\n");
+    }
+    /* one write per record, so processes appending to a shared file don't
+     * interleave */
+    if (report.len >= sizeof(report.buf)) {
+        report.len = sizeof(report.buf) - 1;
+        report.buf[report.len-1] = '\n';
+    }
+    fflush(stdout);
+    fwrite(report.buf, 1, report.len, report.f);
+    fflush(report.f);
+    pthread_mutex_unlock(&report.lock);
+}
+
+/* the meta record, describing the process and its setup */
+static void report_meta(const struct hg_comm_info *h, hg_bool_t listen)
+{
+    unsigned int major = 0, minor = 0, patch = 0;
+    char ver[48];
+
+    if (!report_enabled())
+        return;
+    report.class = h->class;
+    report.transport = h->transport;
+    HG_Version_get(&major, &minor, &patch);
+    snprintf(ver, sizeof(ver), "%u.%u.%u", major, minor, patch);
+
+    report_begin("meta");
+    report_str("program", program_invocation_short_name);
+    report_str("role", listen ? "server" : "client");
+    report_str("host", report.host);
+    report_int("pid", (long long) getpid());
+    report_int("start", (long long) report.start);
+    report_int("buf_size", (long long) h->buf_sz);
+    report_int("server_threads", hg_server_opts.num_threads);
+    report_int("server_shared_ctx", hg_server_opts.shared_context);
+    report_str("progress", progress_mode_names[hg_progress_opts.mode]);
+    report_int("spin_us", hg_progress_opts.spin_us);
+    report_int("trigger_batch", hg_progress_opts.trigger_batch);
+    report_str("mercury_version", ver);
+    report_str("git_hash", GIT_HASH);
+    report_str("timer", hg_timer.use_tsc ? "tsc" : "clock");
+    report_dbl("timer_ns_per_tick", hg_timer.ns_per_tick);
+    report_dbl("timer_overhead_ns", hg_timer.overhead_ns);
+    report_int("trace", TRACE);
+    report_end();
+}
+
+int parse_common_opt(int argc, char *argv[], int *arg)
+{
+    int rc;
+
+    rc = parse_server_opt(argc, argv, arg);
+    if (rc == 0)
+        rc = parse_cpu_opt(argc, argv, arg);
+    if (rc == 0)
+        rc = parse_progress_opt(argc, argv, arg);
+    if (rc == 0)
+        rc = parse_report_opt(argc, argv, arg);
+    if (rc == 0)
+        rc = parse_converge_opt(argc, argv, arg);
+    return rc;
+}
+
+void print_common_usage(FILE *f)
+{
+    fprintf(f, "%s", server_opts_usage);
+    fprintf(f, "%s", cpu_opts_usage);
+    fprintf(f, "%s", progress_opts_usage);
+    fprintf(f, "%s", report_opts_usage);
+    fprintf(f, "%s", converge_opts_usage);
+}
+
+hg_return_t trigger_ready(hg_context_t *ctx, unsigned int *num_cb)
+{
+    unsigned int n;
+    hg_return_t hret;
+
+    do {
+        hret = HG_Trigger(ctx, 0, hg_progress_opts.trigger_batch, &n);
+        if (hret == HG_SUCCESS && num_cb)
+            *num_cb += n;
+        trace_event(EV_TRIGGER, n);
+    } while (hret == HG_SUCCESS && n > 0);
+
+    return hret == HG_TIMEOUT ? HG_SUCCESS : hret;
+}
+
+hg_return_t wait_until(hg_context_t *ctx, int const *flag, int max_retries)
+{
+    hg_return_t hret;
+    unsigned int num_cb;
+
+    for (int retry = 0; retry < max_retries; retry++) {
+        do {
+            hret = HG_Trigger(ctx, 0, 1, &num_cb);
+        } while (hret == HG_SUCCESS && num_cb == 1);
+        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+            return hret;
+        if (flag && *flag)
+            return HG_SUCCESS;
+        hret = HG_Progress(ctx, 100);
+        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+            return hret;
+    }
+    return flag ? HG_TIMEOUT : HG_SUCCESS;
+}
+
+static void epoll_progress_close(struct epoll_progress *e)
+{
+    if (e->epfd >= 0)
+        close(e->epfd);
+    if (e->tfd >= 0)
+        close(e->tfd);
+    free(e);
+}
+
+/* thread exit: close everything the thread set up */
+static void epoll_thread_fini(void *arg)
+{
+    struct epoll_progress *e = arg, *next;
+
+    for (; e != NULL; e = next) {
+        next = e->next;
+        epoll_progress_close(e);
+    }
+}
+
+static void epoll_key_init(void)
+{
+    int rc = pthread_key_create(&epoll_key, epoll_thread_fini);
+    assert(rc == 0);
+}
+
+/* look up (or set up) the calling thread's epoll state for ctx, NULL if the
+ * context has no wait fd */
+static struct epoll_progress *get_epoll_progress(hg_context_t *ctx)
+{
+    struct epoll_progress *e;
+    struct epoll_event ev;
+    int wfd, rc;
+
+    for (e = epoll_state; e != NULL; e = e->next) {
+        if (e->ctx == ctx)
+            return e->epfd >= 0 ? e : NULL;
+    }
+    e = malloc(sizeof(*e));
+    assert(e);
+    e->ctx = ctx;
+    e->epfd = e->tfd = -1;
+    e->next = epoll_state;
+    epoll_state = e;
+    pthread_once(&epoll_key_once, epoll_key_init);
+    pthread_setspecific(epoll_key, epoll_state);
+
+    wfd = HG_Event_get_wait_fd(ctx);
+    if (wfd < 0) {
+        fprintf(stderr, "warning: no wait fd, epoll progress falls "
+                "back to blocking\n");
+        return NULL;
+    }
+    e->epfd = epoll_create1(EPOLL_CLOEXEC);
+    assert(e->epfd >= 0);
+    e->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(e->tfd >= 0);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wfd;
+    rc = epoll_ctl(e->epfd, EPOLL_CTL_ADD, wfd, &ev);
+    assert(rc == 0);
+    ev.data.fd = e->tfd;
+    rc = epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->tfd, &ev);
+    assert(rc == 0);
+    return e;
+}
+
+void progress_release(hg_context_t *ctx)
+{
+    struct epoll_progress **p, *e;
+
+    for (p = &epoll_state; *p != NULL; p = &(*p)->next) {
+        if ((*p)->ctx == ctx) {
+            e = *p;
+            *p = e->next;
+            epoll_progress_close(e);
+            pthread_setspecific(epoll_key, epoll_state);
+            break;
+        }
+    }
+}
+
+static hg_return_t progress_epoll(hg_context_t *ctx, unsigned int timeout)
+{
+    struct epoll_progress *e = get_epoll_progress(ctx);
+    struct epoll_event evs[2];
+    struct itimerspec its;
+    uint64_t expirations;
+    hg_return_t hret;
+    int n;
+
+    if (e == NULL)
+        return HG_Progress(ctx, timeout);
+
+    /* anything already pending (or not safe to sleep on) gets handled
+     * without touching epoll */
+    hret = HG_Progress(ctx, 0);
+    if (hret != HG_TIMEOUT || HG_Event_ready(ctx))
+        return hret;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = timeout / 1000;
+    its.it_value.tv_nsec = (long) (timeout % 1000) * 1000000L;
+    if (timeout == 0)
+        its.it_value.tv_nsec = 1; /* 0 would disarm it */
+    timerfd_settime(e->tfd, 0, &its, NULL);
+
+    do {
+        n = epoll_wait(e->epfd, evs, 2, -1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return HG_OTHER_ERROR;
+
+    /* drain the timer so it doesn't stay readable */
+    if (read(e->tfd, &expirations, sizeof(expirations)) < 0 &&
+            errno != EAGAIN)
+        return HG_OTHER_ERROR;
+
+    return HG_Progress(ctx, 0);
+}
+
+static hg_return_t progress_wait_mode(hg_context_t *ctx, unsigned int timeout)
+{
+    uint64_t start, spin_ns, spent_ns;
+    hg_return_t hret;
+
+    switch (hg_progress_opts.mode) {
+        case PROGRESS_BUSY:
+            return HG_Progress(ctx, 0);
+        case PROGRESS_SPIN:
+            /* the spin counts against timeout: block only for what's left */
+            spin_ns = hg_progress_opts.spin_us * 1000ULL;
+            if (spin_ns > timeout * 1000000ULL)
+                spin_ns = timeout * 1000000ULL;
+            start = ticks_now();
+            do {
+                hret = HG_Progress(ctx, 0);
+                if (hret != HG_TIMEOUT)
+                    return hret;
+                spent_ns = ticks_to_ns(ticks_now() - start);
+            } while (spent_ns < spin_ns);
+            if (spent_ns >= timeout * 1000000ULL)
+                return hret;
+            return HG_Progress(ctx,
+                    timeout - (unsigned int) (spent_ns / 1000000ULL));
+        case PROGRESS_EPOLL:
+            return progress_epoll(ctx, timeout);
+        case PROGRESS_BLOCK:
+        default:
+            return HG_Progress(ctx, timeout);
+    }
+}
+
+hg_return_t progress_wait(hg_context_t *ctx, unsigned int timeout)
+{
+    hg_return_t hret;
+
+    trace_event(EV_PROGRESS_ENTER, timeout);
+    hret = progress_wait_mode(ctx, timeout);
+    trace_event(EV_PROGRESS_EXIT, hret);
+    return hret;
+}
+
+/* the TSC is usable if it ticks at a constant rate through power state
+ * changes (CPUID 0x80000007 EDX bit 8) */
+static int tsc_is_invariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+            eax < 0x80000007)
+        return 0;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 1;
+#else
+    return 0;
+#endif
+}
+
+void timer_init(void)
+{
+    static int initialized = 0;
+    struct timespec ts0, ts1, nap = { 0, 20000000 };
+    uint64_t t0, t1;
+    char const *env;
+    int i;
+
+    if (initialized)
+        return;
+    initialized = 1;
+
+    env = getenv(TIMER_ENV);
+    if (tsc_is_invariant() && !(env && strcmp(env, "clock") == 0)) {
+        /* calibrate over a 20 ms nap */
+        hg_timer.use_tsc = 1;
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        t0 = ticks_now();
+        nanosleep(&nap, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &ts1);
+        t1 = ticks_now();
+        hg_timer.ns_per_tick =
+            (double) time_to_ns(timediff(ts0, ts1)) / (double) (t1 - t0);
+        hg_timer.mult = (uint64_t) (hg_timer.ns_per_tick *
+                (double) (1ULL << TIMER_SHIFT) + 0.5);
+    }
+
+    /* what a timestamp costs */
+    t0 = ticks_now();
+    for (i = 0; i < 100000; i++)
+        t1 = ticks_now();
+    hg_timer.overhead_ns = ticks_to_ns(t1 - t0) / 100000.0;
+}
+
+void timer_print(FILE *f, char const *prefix)
+{
+    fprintf(f, "%s timer %-5s %.3f %.1f\n", prefix,
+            hg_timer.use_tsc ? "tsc" : "clock", hg_timer.ns_per_tick,
+            hg_timer.overhead_ns);
+}
+
+void get_cpu_time(int thread_only, struct cpu_time *t)
+{
+    struct rusage ru;
+
+    getrusage(thread_only ? RUSAGE_THREAD : RUSAGE_SELF, &ru);
+    t->user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    t->sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+void progress_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct cpu_time *start,
+        const struct cpu_time *end)
+{
+    fprintf(f, "%s progress %s %s %u %u %.3e %.3e\n", prefix, label,
+            progress_mode_names[hg_progress_opts.mode],
+            hg_progress_opts.spin_us, hg_progress_opts.trigger_batch,
+            end->user - start->user, end->sys - start->sys);
+
+    report_begin("progress");
+    report_str("label", label);
+    report_str("mode", progress_mode_names[hg_progress_opts.mode]);
+    report_int("spin_us", hg_progress_opts.spin_us);
+    report_int("trigger_batch", hg_progress_opts.trigger_batch);
+    report_dbl("user", end->user - start->user);
+    report_dbl("sys", end->sys - start->sys);
+    report_end();
+}
+
+/* parse a size with an optional K/M/G (binary) suffix */
+static int parse_size(char const *str, char **end, size_t *sz)
+{
+    unsigned long long v;
+
+    if (!isdigit((unsigned char) *str))
+        return -1;
+    v = strtoull(str, end, 10);
+    switch (**end) {
+        case 'k': case 'K': v <<= 10; (*end)++; break;
+        case 'm': case 'M': v <<= 20; (*end)++; break;
+        case 'g': case 'G': v <<= 30; (*end)++; break;
+        default: break;
+    }
+    *sz = (size_t) v;
+    return 0;
+}
+
+int size_range_parse(char const *spec, struct size_range *r)
+{
+    char *p;
+
+    if (parse_size(spec, &p, &r->min) != 0 || *p != ':')
+        return -1;
+    if (parse_size(p+1, &p, &r->max) != 0 || *p != ':')
+        return -1;
+    p++;
+    if (*p == 'x' || *p == '*')
+        r->geometric = 1;
+    else if (*p == '+')
+        r->geometric = 0;
+    else
+        return -1;
+    if (parse_size(p+1, &p, &r->step) != 0 || *p != '\0')
+        return -1;
+    /* a step that doesn't move would never finish */
+    if (r->min > r->max || (r->geometric ? r->step < 2 : r->step < 1))
+        return -1;
+    return 0;
+}
+
+char const * const key_dist_names[] = { "rr", "uniform", "zipf" };
+
+int key_dist_parse(char const *spec, struct key_dist *d)
+{
+    char *end;
+    size_t n = strcspn(spec, ":");
+
+    d->theta = 0.0;
+    if (n == 2 && strncmp(spec, "rr", n) == 0)
+        d->type = KEY_DIST_RR;
+    else if (n == 7 && strncmp(spec, "uniform", n) == 0)
+        d->type = KEY_DIST_UNIFORM;
+    else if (n == 4 && strncmp(spec, "zipf", n) == 0) {
+        d->type = KEY_DIST_ZIPF;
+        d->theta = 0.99;
+    }
+    else
+        return -1;
+    if (spec[n] == '\0')
+        return 0;
+    if (d->type != KEY_DIST_ZIPF)
+        return -1;
+    d->theta = strtod(spec + n + 1, &end);
+    /* the generator's closed form breaks down at 1 */
+    if (end == spec + n + 1 || *end != '\0' ||
+            d->theta <= 0.0 || d->theta >= 1.0)
+        return -1;
+    return 0;
+}
+
+static double zeta(uint64_t n, double theta)
+{
+    double sum = 0.0;
+    for (uint64_t i = 1; i <= n; i++)
+        sum += 1.0 / pow((double) i, theta);
+    return sum;
+}
+
+void key_dist_init(struct key_dist *d, uint64_t num_keys, unsigned int seed)
+{
+    d->num_keys = num_keys;
+    d->next = 0;
+    d->seed[0] = 0x330e;
+    d->seed[1] = (unsigned short) seed;
+    d->seed[2] = (unsigned short) (seed >> 16);
+    if (d->type == KEY_DIST_ZIPF) {
+        d->zetan = zeta(num_keys, d->theta);
+        d->alpha = 1.0 / (1.0 - d->theta);
+        d->eta = (1.0 - pow(2.0 / num_keys, 1.0 - d->theta)) /
+            (1.0 - zeta(2, d->theta) / d->zetan);
+    }
+}
+
+/* scatter keys over servers (splitmix64's finalizer) */
+static inline uint64_t key_hash(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+int key_dist_next(struct key_dist *d, int num_servers)
+{
+    double u, uz;
+    uint64_t key;
+
+    switch (d->type) {
+        case KEY_DIST_RR:
+            return (int) (d->next++ % (uint64_t) num_servers);
+        case KEY_DIST_UNIFORM:
+            key = (uint64_t) (erand48(d->seed) * d->num_keys);
+            break;
+        case KEY_DIST_ZIPF:
+            /* rank 0 is the hottest key */
+            u = erand48(d->seed);
+            uz = u * d->zetan;
+            if (uz < 1.0)
+                key = 0;
+            else if (uz < 1.0 + pow(0.5, d->theta))
+                key = 1;
+            else
+                key = (uint64_t) (d->num_keys *
+                        pow(d->eta * u - d->eta + 1.0, d->alpha));
+            if (key >= d->num_keys)
+                key = d->num_keys - 1;
+            break;
+        default:
+            assert(0);
+            return 0;
+    }
+    return (int) (key_hash(key) % (uint64_t) num_servers);
+}
+
+char const * const converge_opts_usage =
+"  convergence options (hg-ctest1 / hg-ctest4 clients):\n"
+"    --converge REL[:MAX] runs each measurement until the 95% confidence\n"
+"      interval of its mean is within +-REL of it (e.g. 0.02), after an\n"
+"      automatically detected warmup, for at most MAX seconds (default\n"
+"      60), instead of fixed reps (hg-ctest1) or -t seconds (hg-ctest4)\n"
+"    --converge-pct P converges on the P-th percentile instead\n"
+"    --converge-batch N groups N samples per batch (default 32)\n";
+
+int parse_converge_opt(int argc, char *argv[], int *arg)
+{
+    char *end;
+
+    if (strcmp(argv[*arg], "--converge") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_converge_opts.rel_width = strtod(argv[*arg+1], &end);
+        if (end == argv[*arg+1] || hg_converge_opts.rel_width <= 0.0)
+            return -1;
+        if (*end == ':') {
+            hg_converge_opts.max_seconds = strtod(end+1, &end);
+            if (hg_converge_opts.max_seconds <= 0.0)
+                return -1;
+        }
+        if (*end != '\0')
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--converge-pct") == 0) {
+        if (*arg+1 >= argc)
+            return -1;
+        hg_converge_opts.pct = strtod(argv[*arg+1], NULL);
+        if (hg_converge_opts.pct <= 0.0 || hg_converge_opts.pct >= 100.0)
+            return -1;
+        *arg += 2;
+        return 1;
+    }
+    else if (strcmp(argv[*arg], "--converge-batch") == 0) {
+        if (*arg+1 >= argc || atoi(argv[*arg+1]) < 2)
+            return -1;
+        hg_converge_opts.batch = atoi(argv[*arg+1]);
+        *arg += 2;
+        return 1;
+    }
+    return 0;
+}
+
+void converge_init(struct converge *c)
+{
+    double tail;
+
+    memset(c, 0, sizeof(*c));
+    c->batch = hg_converge_opts.batch;
+    if (hg_converge_opts.pct > 0.0) {
+        tail = 1.0 - hg_converge_opts.pct / 100.0;
+        if (c->batch < (int) ceil(10.0 / tail))
+            c->batch = (int) ceil(10.0 / tail);
+    }
+    c->cur = malloc(c->batch * sizeof(*c->cur));
+    assert(c->cur);
+}
+
+void converge_fini(struct converge *c)
+{
+    free(c->cur);
+    c->cur = NULL;
+}
+
+static void batch_mean_var(const double *v, int n, double *mean, double *var)
+{
+    double m = 0.0, s = 0.0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        m += v[i];
+    m /= n;
+    for (i = 0; i < n; i++)
+        s += (v[i] - m) * (v[i] - m);
+    *mean = m;
+    *var = n > 1 ? s / (n - 1) : 0.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* two-sided 95% Student t quantile (Cornish-Fisher expansion, within 0.5%
+ * of the table for df >= 5) */
+static double t_975(double df)
+{
+    const double z = 1.959964;
+    double z3 = z * z * z, z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * df) +
+        (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * df * df);
+}
+
+int converge_warm(struct converge *c, double v)
+{
+    const int k = CONVERGE_WARMUP_BATCHES;
+    double m, var, xm, ym = 0.0, sxx = 0.0, sxy = 0.0, sse = 0.0, b, r;
+    int i;
+
+    if (c->steady)
+        return 1;
+    c->warmup_samples++;
+    c->cur[c->ncur++] = v;
+    if (c->ncur < hg_converge_opts.batch)
+        return 0;
+    c->ncur = 0;
+    batch_mean_var(c->cur, hg_converge_opts.batch, &m, &var);
+    c->warm[c->nwarm++ % k] = m;
+    if (c->nwarm < (unsigned long) k)
+        return 0;
+
+    /* least-squares slope over the window, oldest batch first */
+    xm = (k - 1) / 2.0;
+    for (i = 0; i < k; i++)
+        ym += c->warm[(c->nwarm + i) % k];
+    ym /= k;
+    for (i = 0; i < k; i++) {
+        sxx += (i - xm) * (i - xm);
+        sxy += (i - xm) * (c->warm[(c->nwarm + i) % k] - ym);
+    }
+    b = sxy / sxx;
+    for (i = 0; i < k; i++) {
+        r = c->warm[(c->nwarm + i) % k] - ym - b * (i - xm);
+        sse += r * r;
+    }
+    if (fabs(b) <= t_975(k - 2) * sqrt(sse / (k - 2) / sxx))
+        c->steady = 1;
+    return c->steady;
+}
+
+int converge_add(struct converge *c, double v)
+{
+    double s, var, d;
+
+    c->samples++;
+    c->cur[c->ncur++] = v;
+    if (c->ncur < c->batch)
+        return 0;
+    c->ncur = 0;
+
+    if (hg_converge_opts.pct > 0.0) {
+        int i = (int) ceil(hg_converge_opts.pct / 100.0 * c->batch) - 1;
+        qsort(c->cur, c->batch, sizeof(*c->cur), cmp_double);
+        s = c->cur[i < 0 ? 0 : i];
+    }
+    else
+        batch_mean_var(c->cur, c->batch, &s, &var);
+
+    c->nbatch++;
+    d = s - c->mean;
+    c->mean += d / c->nbatch;
+    c->m2 += d * (s - c->mean);
+
+    return c->nbatch >= CONVERGE_MIN_BATCHES &&
+        converge_rel_width(c) <= hg_converge_opts.rel_width;
+}
+
+double converge_rel_width(const struct converge *c)
+{
+    double hw;
+
+    if (c->nbatch < 2 || c->mean <= 0.0)
+        return INFINITY;
+    hw = t_975(c->nbatch - 1) * sqrt(c->m2 / (c->nbatch - 1) / c->nbatch);
+    return hw / c->mean;
+}
+
+void converge_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct converge *c)
+{
+    char stat[16];
+    double w = converge_rel_width(c);
+    int done = c->nbatch >= CONVERGE_MIN_BATCHES &&
+        w <= hg_converge_opts.rel_width;
+
+    if (hg_converge_opts.pct > 0.0)
+        snprintf(stat, sizeof(stat), "p%g", hg_converge_opts.pct);
+    else
+        snprintf(stat, sizeof(stat), "mean");
+    fprintf(f, "%s converge %-12s %s %8lu %8lu %5lu %.3e %.3e %d\n",
+            prefix, label, stat, c->warmup_samples, c->samples, c->nbatch,
+            c->mean, w, done);
+
+    report_begin("converge");
+    report_str("label", label);
+    report_str("stat", stat);
+    report_int("warmup_samples", (long long) c->warmup_samples);
+    report_int("samples", (long long) c->samples);
+    report_int("batches", (long long) c->nbatch);
+    report_dbl("estimate", c->mean);
+    report_dbl("rel_width", w);
+    report_int("converged", done);
+    report_end();
+}
+
+hg_bulk_t dup_hg_bulk(hg_class_t *cl, hg_bulk_t in)
+{
+    hg_bulk_t rtn;
+    hg_size_t sz;
+    hg_return_t hret;
+    void * buf;
+
+    sz = HG_Bulk_get_serialize_size(in, HG_FALSE);
+    buf = malloc(sz);
+    if (!buf)
+        return HG_BULK_NULL;
+    hret = HG_Bulk_serialize(buf, sz, HG_FALSE, in);
+    if (hret != HG_SUCCESS)
+        return HG_BULK_NULL;
+    hret = HG_Bulk_deserialize(cl, &rtn, buf, sz);
+    free(buf);
+    if (hret != HG_SUCCESS)
+        return HG_BULK_NULL;
+    else
+        return rtn;
+}
+
+typedef struct serv_addr_out
+{
+    hg_addr_t addr;
+    int set;
+} serv_addr_out_t;
+
+// helper for lookup_serv_addr
+static hg_return_t lookup_serv_addr_cb(const struct hg_cb_info *info)
+{
+    serv_addr_out_t *out = info->arg;
+    out->addr = info->info.lookup.addr;
+    out->set = 1;
+    return HG_SUCCESS;
+}
+
+hg_addr_t lookup_serv_addr(struct hg_comm_info *hg, const char *info_str)
+{
+    serv_addr_out_t out;
+    hg_return_t hret;
+
+    out.addr = HG_ADDR_NULL;
+    out.set = 0;
+
+    hret = HG_Addr_lookup(hg->hgctx, &lookup_serv_addr_cb, &out, info_str,
+            HG_OP_ID_IGNORE);
+    assert(hret == HG_SUCCESS);
+
+    // run the progress loop until we've got the output
+    do {
+        unsigned int count = 0;
         do {
             hret = HG_Trigger(hg->hgctx, 0, 1, &count);
         } while (hret == HG_SUCCESS && count > 0);
@@ -289,3 +3134,14 @@ hg_addr_t lookup_serv_addr(struct hg_comm_info *hg, const char *info_str)
 
     return out.addr;
 }
+
+void get_msg_limits(
+        struct hg_comm_info *hg,
+        size_t *max_unexpected,
+        size_t *max_expected)
+{
+    na_class_t *na = HG_Class_get_na(hg->hgcl);
+
+    *max_unexpected = NA_Msg_get_max_unexpected_size(na);
+    *max_expected = NA_Msg_get_max_expected_size(na);
+}
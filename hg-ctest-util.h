@@ -10,12 +10,19 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include <mercury.h>
 #include <mercury_bulk.h>
 #include <mercury_macros.h>
 #include <na_cci.h> /* need for CCI-specific grabbing of URI */
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "hg-ctest-trace.h"
+
 #if VERBOSE_LOG
 #   define dprintf(_fmt, ...) fprintf(stderr, _fmt, ##__VA_ARGS__)
 #   define init_verbose() \
@@ -33,6 +40,22 @@
 
 extern char const * const ADDR_FNAME;
 
+/* if set in a server's environment, the address is written to this (already
+ * open) file descriptor instead of ADDR_FNAME - see hg-ctest-launch */
+#define ADDR_FD_ENV "HG_CTEST_ADDR_FD"
+
+/* filename prefix that client latency histograms get written to */
+
+extern char const * const HIST_FNAME;
+
+/* filename prefix for op traces that only back the -a option */
+
+extern char const * const TRACE_FNAME;
+
+/* filename prefix that client barrier release times get written to */
+
+extern char const * const BARRIER_FNAME;
+
 /* timing utilities */
 
 static inline struct timespec timediff(
@@ -59,6 +82,132 @@ static inline double time_to_us_lf(struct timespec t){
 static inline double time_to_s_lf(struct timespec t){
         return (double) t.tv_sec + (double) t.tv_nsec / 1e9;
 }
+static inline uint64_t time_to_ns(struct timespec t){
+        return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+/* low-overhead timestamps
+ *
+ * ticks_now() reads the TSC (rdtscp) when it is invariant, otherwise it
+ * falls back to clock_gettime(CLOCK_MONOTONIC) nanoseconds. Hot paths keep
+ * raw ticks and convert at report time, ticks_to_ns being a few
+ * multiplies and shifts. timer_init (called by hg_init) picks the source and calibrates it
+ * against CLOCK_MONOTONIC; HG_CTEST_TIMER=clock forces the fallback */
+#define TIMER_ENV "HG_CTEST_TIMER"
+#define TIMER_SHIFT 32
+
+struct timer_info {
+    int use_tsc;
+    uint64_t mult; /* ns per tick << TIMER_SHIFT */
+    double ns_per_tick;
+    double overhead_ns; /* cost of one ticks_now() */
+};
+
+extern struct timer_info hg_timer;
+
+static inline uint64_t ticks_now(void)
+{
+    struct timespec ts;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    if (hg_timer.use_tsc)
+        return __rdtscp(&aux);
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* (t * mult) >> 32, split into 64x32 multiplies so 32-bit targets (no
+ * 128-bit integers) get the same exact result */
+static inline uint64_t ticks_to_ns(uint64_t t)
+{
+    uint64_t m_hi = hg_timer.mult >> TIMER_SHIFT;
+    uint64_t m_lo = hg_timer.mult & 0xffffffffULL;
+    uint64_t t_hi = t >> TIMER_SHIFT, t_lo = t & 0xffffffffULL;
+
+    return t * m_hi + t_hi * m_lo + ((t_lo * m_lo) >> TIMER_SHIFT);
+}
+
+static inline double ticks_to_s(uint64_t t)
+{
+    return t * hg_timer.ns_per_tick / 1e9;
+}
+
+void timer_init(void);
+
+/* prints "<prefix> timer <tsc | clock> <ns per tick> <overhead ns>" (the
+ * report meta record carries the same) */
+void timer_print(FILE *f, char const *prefix);
+
+#include "hg-ctest-evtrace.h"
+
+/* latency histograms
+ *
+ * log-linear (HDR-style) buckets over nanosecond values: values below
+ * 2*LAT_HIST_SUB_COUNT get a bucket each, above that every power of two is
+ * split into LAT_HIST_SUB_COUNT linear sub-buckets (~3% relative error).
+ * Fixed-size, so recording never allocates */
+
+#define LAT_HIST_SUB_BITS 5
+#define LAT_HIST_SUB_COUNT (1 << LAT_HIST_SUB_BITS)
+/* largest shift tracked - values past 2^(LAT_HIST_MAX_SHIFT+6) ns (~18
+ * minutes) land in the last bucket */
+#define LAT_HIST_MAX_SHIFT 34
+#define LAT_HIST_NUM_BUCKETS ((LAT_HIST_MAX_SHIFT + 2) * LAT_HIST_SUB_COUNT)
+
+struct lat_hist {
+    uint64_t counts[LAT_HIST_NUM_BUCKETS];
+    uint64_t total;
+    uint64_t min_ns, max_ns;
+};
+
+static inline int lat_hist_index(uint64_t ns)
+{
+    int msb, shift;
+    if (ns < 2 * LAT_HIST_SUB_COUNT)
+        return (int) ns;
+    msb = 63 - __builtin_clzll(ns);
+    shift = msb - LAT_HIST_SUB_BITS;
+    if (shift > LAT_HIST_MAX_SHIFT)
+        return LAT_HIST_NUM_BUCKETS - 1;
+    return (shift + 1) * LAT_HIST_SUB_COUNT +
+        (int) (ns >> shift) - LAT_HIST_SUB_COUNT;
+}
+
+static inline void lat_hist_record(struct lat_hist *h, uint64_t ns)
+{
+    h->counts[lat_hist_index(ns)]++;
+    h->total++;
+    if (ns < h->min_ns) h->min_ns = ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+static inline void lat_hist_record_ts(struct lat_hist *h, struct timespec t)
+{
+    lat_hist_record(h, time_to_ns(t));
+}
+
+static inline void lat_hist_record_ticks(struct lat_hist *h, uint64_t t)
+{
+    lat_hist_record(h, ticks_to_ns(t));
+}
+
+void lat_hist_init(struct lat_hist *h);
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+/* returns the (highest equivalent) value at percentile pct, in ns */
+uint64_t lat_hist_percentile(const struct lat_hist *h, double pct);
+/* prints "<prefix> lat <label> <count> <p50> <p90> <p99> <p99.9> <max>"
+ * with times in seconds */
+void lat_hist_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct lat_hist *h);
+/* prints a coarse (power of two) view of the histogram as comment lines */
+void lat_hist_print_buckets(FILE *f, const struct lat_hist *h);
+/* save / load-and-merge histograms so separate processes can be combined */
+int lat_hist_write(const struct lat_hist *h, char const *fname);
+int lat_hist_read_merge(struct lat_hist *dst, char const *fname);
 
 /* program running modes */
 enum mode_t {
@@ -87,6 +236,11 @@ struct hg_comm_info
     hg_id_t get_bulk_handle_rpc_id;
     hg_id_t shutdown_server_rpc_id;
     hg_id_t bulk_read_rpc_id;
+    hg_id_t sized_rpc_id;
+    hg_id_t get_stats_rpc_id;
+    hg_id_t barrier_join_rpc_id;
+    hg_id_t tree_arrive_rpc_id;
+    hg_id_t bulk_read_from_rpc_id;
 
     /* checkin state */
     int num_to_check_in;
@@ -100,9 +254,423 @@ struct hg_comm_info
     int is_separate_servers;
 };
 
+/* server threading options (see run_server) */
+struct server_opts {
+    /* number of progress/trigger threads */
+    int num_threads;
+    /* if set, all threads drive the one context rather than each getting
+     * its own */
+    int shared_context;
+    /* number of pre-registered regions bulk_read pulls into (0 -> register
+     * a target buffer on every call) */
+    int bulk_pool_count;
+    /* size of each region (0 -> the server's rdma size) */
+    size_t bulk_pool_size;
+    /* max concurrent bulk_read pulls when not pooled (0 -> no limit) */
+    int max_pulls;
+    /* bulk_read pulls are split into chunks of this size (0 -> one
+     * transfer), with up to pull_chunks_in_flight outstanding */
+    size_t pull_chunk_size;
+    int pull_chunks_in_flight;
+    /* proxy mode: noop and bulk_read are forwarded to this server and
+     * answered once it answers (NULL -> answer locally) */
+    char const *forward_to;
+    /* proxy bulk_read relay: pull into a slot and have the next hop pull
+     * from there (0), or pass the client's bulk handle on so the last hop
+     * pulls from the client itself (1) */
+    int forward_bulk_direct;
+};
+
+extern struct server_opts hg_server_opts;
+
+/* consumes a server option at argv[*arg] if there is one, returning 1 if
+ * so (0 if not, -1 on a malformed option) */
+int parse_server_opt(int argc, char *argv[], int *arg);
+
+/* usage text for ^ */
+extern char const * const server_opts_usage;
+
+/* placement (--cpu / --cpu-list options): thread idx of a process (0 is the
+ * main thread) is pinned to cpu list[idx % len], or to base cpu + idx with
+ * --cpu. hg_init pins the main thread and first-touches its buffer so the
+ * buffer lands on the local NUMA node */
+int parse_cpu_opt(int argc, char *argv[], int *arg);
+extern char const * const cpu_opts_usage;
+
+/* parse a cpu list ("0,2,4-7") onto the end of *list / *len, returning 0
+ * (-1 if malformed or empty). Inline so hg-ctest-launch, which doesn't link
+ * the rest of the utilities, shares it */
+static inline int parse_cpu_list(char const *str, int **list, int *len)
+{
+    char *end;
+    long lo, hi;
+    int *l;
+
+    for (; *str; str = end) {
+        lo = hi = strtol(str, &end, 10);
+        if (end == str || lo < 0)
+            return -1;
+        if (*end == '-') {
+            str = end + 1;
+            hi = strtol(str, &end, 10);
+            if (end == str || hi < lo)
+                return -1;
+        }
+        for (; lo <= hi; lo++) {
+            l = realloc(*list, (*len + 1) * sizeof(**list));
+            if (!l)
+                return -1;
+            *list = l;
+            (*list)[(*len)++] = (int) lo;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+    }
+    return *len > 0 ? 0 : -1;
+}
+
+/* pin the calling thread (no-op without --cpu / --cpu-list) */
+void pin_thread(int idx);
+
+/* cpu and NUMA node the calling thread is currently on (-1 if unknown) */
+void get_placement(int *cpu, int *node);
+
+/* progress strategies for the benchmark loops (--progress /
+ * --trigger-batch options) - how HG_Progress is driven between trigger
+ * passes. Setup and sync waits always block */
+enum progress_mode {
+    PROGRESS_BLOCK, /* HG_Progress with the loop's timeout (default) */
+    PROGRESS_BUSY,  /* HG_Progress with timeout 0, never sleeps */
+    PROGRESS_SPIN,  /* busy-poll for spin_us, then block */
+    PROGRESS_EPOLL  /* sleep in epoll on the wait fd plus a timerfd,
+                       progressing only once readable */
+};
+
+struct progress_opts {
+    enum progress_mode mode;
+    unsigned int spin_us;
+    /* max_count passed to HG_Trigger */
+    unsigned int trigger_batch;
+};
+
+extern struct progress_opts hg_progress_opts;
+
+int parse_progress_opt(int argc, char *argv[], int *arg);
+extern char const * const progress_opts_usage;
+
+/* run every callback that's ready, trigger_batch at a time, adding the
+ * number run to *num_cb if non-NULL. Returns HG_SUCCESS or an error */
+hg_return_t trigger_ready(hg_context_t *ctx, unsigned int *num_cb);
+
+/* make progress per the selected strategy, sleeping no more than timeout
+ * ms */
+hg_return_t progress_wait(hg_context_t *ctx, unsigned int timeout);
+
+/* setup / sync wait: trigger and block in HG_Progress (100 ms at a time, up
+ * to max_retries times) until *flag is set, returning HG_TIMEOUT if it never
+ * is. With flag NULL, just makes max_retries rounds of progress */
+hg_return_t wait_until(hg_context_t *ctx, int const *flag, int max_retries);
+
+/* close the calling thread's epoll progress state for ctx, before it's
+ * destroyed (a thread's states are closed anyway when it exits) */
+void progress_release(hg_context_t *ctx);
+
+/* cpu time used by the calling thread (or the whole process) */
+struct cpu_time {
+    double user, sys;
+};
+
+void get_cpu_time(int thread_only, struct cpu_time *t);
+
+/* prints "<prefix> progress <label> <mode> <spin us> <trigger batch>
+ * <user s> <sys s>" for the cpu time used between start and end */
+void progress_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct cpu_time *start,
+        const struct cpu_time *end);
+
+/* machine-readable results (--report / --report-file options)
+ *
+ * besides the text lines, results can be written as records of named
+ * fields, as JSON lines (one object per record) or CSV (a header row
+ * precedes each run of records whose columns differ from the last).
+ * Every record starts with its kind ("meta", "result", "lat", ...), a run
+ * id (<host>-<pid>-<start time>) joining it to the process's meta record,
+ * class and transport, then the context fields (the benchmark point's
+ * parameters, set with report_ctx_* and kept until report_ctx_clear), then
+ * its own fields. hg_init writes the meta record; lat_hist_print,
+ * progress_print and server_stats_print report themselves */
+enum report_format {
+    REPORT_NONE,
+    REPORT_JSON,
+    REPORT_CSV
+};
+
+extern enum report_format hg_report_format;
+
+int parse_report_opt(int argc, char *argv[], int *arg);
+extern char const * const report_opts_usage;
+
+static inline int report_enabled(void)
+{
+    return hg_report_format != REPORT_NONE;
+}
+
+void report_ctx_clear(void);
+void report_ctx_str(char const *key, char const *val);
+void report_ctx_int(char const *key, long long val);
+
+/* one record at a time (begin takes a lock, end writes it out and drops
+ * it). No-ops when reporting is off */
+void report_begin(char const *kind);
+void report_str(char const *key, char const *val);
+void report_int(char const *key, long long val);
+void report_dbl(char const *key, double val);
+void report_end(void);
+
+/* the option parsers above (server, placement, progress, report) and the
+ * convergence options below rolled into one, same return convention as
+ * parse_server_opt */
+int parse_common_opt(int argc, char *argv[], int *arg);
+void print_common_usage(FILE *f);
+
+/* in-process size sweeps: "MIN:MAX:xF" multiplies by F, "MIN:MAX:+S" adds
+ * S, sizes take an optional K/M/G suffix. MAX is always the last point */
+struct size_range {
+    size_t min, max;
+    size_t step;
+    int geometric;
+};
+
+/* returns 0 on success, -1 on a malformed spec */
+int size_range_parse(char const *spec, struct size_range *r);
+
+/* advance *sz to the next point, returning 0 once past the end */
+static inline int size_range_next(const struct size_range *r, size_t *sz)
+{
+    size_t n;
+    if (*sz >= r->max)
+        return 0;
+    if (r->geometric)
+        n = *sz ? *sz * r->step : 1;
+    else
+        n = *sz + r->step;
+    *sz = n > r->max ? r->max : n;
+    return 1;
+}
+
+/* key-to-server distributions for sharded clients: each op draws a key
+ * and goes to the server it maps to. "rr" takes keys in turn, key k going
+ * to server k mod S. "uniform" draws keys uniformly and "zipf[:THETA]"
+ * from a Zipfian (0 < THETA < 1, default 0.99 as in YCSB) over num_keys
+ * keys, both hashing keys onto servers so the hot keys land on arbitrary
+ * servers */
+enum key_dist_type {
+    KEY_DIST_RR,
+    KEY_DIST_UNIFORM,
+    KEY_DIST_ZIPF
+};
+
+extern char const * const key_dist_names[];
+
+struct key_dist {
+    enum key_dist_type type;
+    double theta;
+    uint64_t num_keys;
+    uint64_t next; /* rr: next key */
+    unsigned short seed[3];
+    /* zipf: constants of Gray et al.'s generator */
+    double zetan, alpha, eta;
+};
+
+/* parse NAME[:THETA] into d, returning 0 on success or -1 */
+int key_dist_parse(char const *spec, struct key_dist *d);
+
+/* set up for num_keys keys, seeding the random draws */
+void key_dist_init(struct key_dist *d, uint64_t num_keys, unsigned int seed);
+
+/* server (0 to num_servers-1) the next op goes to */
+int key_dist_next(struct key_dist *d, int num_servers);
+
+/* statistical convergence (--converge options): rather than a fixed number
+ * of reps / seconds, a measurement runs until the 95% confidence interval
+ * of its mean (or of a percentile) is within +-rel_width of the estimate,
+ * or max_seconds pass.
+ *
+ * Samples are grouped into batches, which soaks up the correlation between
+ * neighbouring ops. Warmup ends once a moving window of the last
+ * CONVERGE_WARMUP_BATCHES batch means shows no significant trend (the
+ * window's least-squares slope is within its 95% interval of zero); after
+ * that each batch contributes its mean / percentile and the interval comes
+ * from the spread of those (batch means method, Student t) over at least
+ * CONVERGE_MIN_BATCHES batches */
+#define CONVERGE_WARMUP_BATCHES 20
+#define CONVERGE_MIN_BATCHES 10
+
+struct converge_opts {
+    double rel_width;   /* target CI half-width / estimate, 0 = off */
+    double max_seconds; /* cap on a measurement, warmup included */
+    double pct;         /* percentile to converge on, 0 = the mean */
+    int batch;          /* samples per batch (measurement batches are
+                           raised for high percentiles so that a batch
+                           holds ~10 samples above pct) */
+};
+
+extern struct converge_opts hg_converge_opts;
+
+int parse_converge_opt(int argc, char *argv[], int *arg);
+extern char const * const converge_opts_usage;
+
+static inline int converge_enabled(void)
+{
+    return hg_converge_opts.rel_width > 0.0;
+}
+
+struct converge {
+    int batch;       /* measurement batch size */
+    double *cur;     /* samples of the batch being filled */
+    int ncur;
+    int steady;      /* warmup over */
+    /* warmup window, a ring of batch means */
+    double warm[CONVERGE_WARMUP_BATCHES];
+    unsigned long nwarm;
+    unsigned long warmup_samples, samples;
+    /* batch statistics since warmup (Welford) */
+    unsigned long nbatch;
+    double mean, m2;
+};
+
+void converge_init(struct converge *c);
+void converge_fini(struct converge *c);
+
+/* warmup: feed samples until this returns 1 (and keeps returning 1) */
+int converge_warm(struct converge *c, double v);
+
+/* measurement: feed samples until this returns 1, the interval being tight
+ * enough */
+int converge_add(struct converge *c, double v);
+
+/* half-width of the 95% interval relative to the estimate (inf if there
+ * aren't enough batches yet) */
+double converge_rel_width(const struct converge *c);
+
+/* prints "<prefix> converge <label> <mean | pNN> <warmup samples>
+ * <samples> <batches> <estimate> <rel half-width> <converged (bool)>" */
+void converge_print(
+        FILE *f,
+        char const *prefix,
+        char const *label,
+        const struct converge *c);
+
 /* RPC processing def (the proc fn is static so this is OK */
-MERCURY_GEN_PROC(get_bulk_handle_out_t, ((hg_bulk_t)(bh)))
+MERCURY_GEN_PROC(get_bulk_handle_out_t,
+        ((hg_bulk_t)(bh))((hg_uint32_t)(num_ctx))((hg_uint32_t)(num_clients)))
 MERCURY_GEN_PROC(bulk_read_in_t, ((hg_bulk_t)(bh)))
+/* bulk_read on behalf of another process: bh belongs to origin (an address
+ * string), which the server pulls from directly */
+MERCURY_GEN_PROC(bulk_read_from_in_t,
+        ((hg_bulk_t)(bh))((hg_const_string_t)(origin)))
+
+/* opaque variable-length payload, sent inline with the RPC. Decoding
+ * allocates buf, which HG_Free_input/HG_Free_output release */
+typedef struct {
+    hg_uint32_t len;
+    void *buf;
+} rpc_payload_t;
+
+hg_return_t hg_proc_rpc_payload_t(hg_proc_t proc, void *data);
+
+/* sized_rpc: the server answers with an out_len byte payload (clamped to
+ * its rdma size) */
+MERCURY_GEN_PROC(sized_rpc_in_t,
+        ((rpc_payload_t)(payload))((hg_uint32_t)(out_len)))
+MERCURY_GEN_PROC(sized_rpc_out_t, ((rpc_payload_t)(payload)))
+
+/* server statistics (get_stats RPC, SIGUSR1 dump) - handler accounting is
+ * by RPC, in this order */
+enum stat_rpc {
+    STAT_CHECK_IN,
+    STAT_NOOP,
+    STAT_GET_BULK_HANDLE,
+    STAT_SHUTDOWN,
+    STAT_BULK_READ,
+    STAT_SIZED_RPC,
+    STAT_GET_STATS,
+    STAT_BARRIER_JOIN,
+    STAT_NUM_RPCS
+};
+
+extern char const * const stat_rpc_names[STAT_NUM_RPCS];
+
+/* RPCs a proxy server (--forward-to) passes on to its next hop */
+enum fwd_rpc {
+    FWD_NOOP,
+    FWD_BULK_READ,
+    FWD_BULK_READ_FROM,
+    FWD_SHUTDOWN,
+    FWD_NUM_RPCS
+};
+
+extern char const * const fwd_rpc_names[FWD_NUM_RPCS];
+
+/* cumulative counters since server start, so two snapshots can be diffed.
+ * Handler time runs from handler entry to HG_Respond (for bulk_read, until
+ * the pull completes). busy is time spent running callbacks (trigger), idle
+ * time spent in progress - waiting on and polling the network. forwards
+ * counts RPCs a proxy passed on (--forward-to), by RPC, forward_ns the time
+ * from forwarding to the next hop's response. Handler time histograms stay on
+ * the server (see server_stats_print) */
+typedef struct {
+    hg_uint64_t uptime_ns;
+    hg_uint64_t count[STAT_NUM_RPCS];
+    hg_uint64_t handler_ns[STAT_NUM_RPCS];
+    hg_uint64_t bulk_bytes;
+    hg_uint64_t progress_calls;
+    hg_uint64_t callbacks;
+    hg_uint64_t busy_ns, idle_ns;
+    hg_uint64_t forwards[FWD_NUM_RPCS], forward_ns[FWD_NUM_RPCS];
+} server_stats_t;
+
+hg_return_t hg_proc_server_stats_t(hg_proc_t proc, void *data);
+
+MERCURY_GEN_PROC(get_stats_out_t, ((server_stats_t)(stats)))
+
+/* barrier_join: a client's id and (listening) address in, the address of
+ * its parent in the barrier tree ("" for the root) and its number of
+ * children out */
+MERCURY_GEN_PROC(barrier_join_in_t,
+        ((hg_uint32_t)(id))((hg_uint32_t)(fanout))((hg_const_string_t)(addr)))
+MERCURY_GEN_PROC(barrier_join_out_t,
+        ((hg_const_string_t)(parent))((hg_uint32_t)(num_children)))
+
+/* *d = *b - *a, counter by counter */
+void server_stats_diff(
+        const server_stats_t *a,
+        const server_stats_t *b,
+        server_stats_t *d);
+
+/* *d += *a, counter by counter (to total several servers) */
+void server_stats_add(server_stats_t *d, const server_stats_t *a);
+
+/* client side: the number of contexts svr spreads RPCs over (from
+ * get_bulk_handle), waiting up to max_retries progress calls of 100 ms - 1
+ * if it doesn't answer */
+unsigned int get_server_num_ctx(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int max_retries);
+
+/* client side: fetch a server's stats, waiting up to max_retries progress
+ * calls of 100 ms */
+hg_return_t get_server_stats(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int max_retries,
+        server_stats_t *st);
 
 /* init/fini code for ^ */
 void hg_init(
@@ -113,12 +681,51 @@ void hg_init(
         struct hg_comm_info *nh);
 void hg_fini(struct hg_comm_info *nh);
 
+/* tree barrier, an alternative to check_in for large client counts.
+ * Clients form a fanout-ary tree by id (the parent of i is (i-1)/fanout,
+ * client 0 is the root): a node forwards tree_arrive to its parent once it
+ * and all of its children have arrived, and responds to its children once
+ * its parent responds. Release then fans out over log_fanout(N) hops with
+ * at most fanout responds per node, rather than N serialized responds from
+ * one server thread. Clients must be initialized listening, as their
+ * children send them RPCs.
+ *
+ * tree_barrier_init joins the tree through svr's barrier_join - which
+ * itself waits for all of the server's clients to join - waiting up to
+ * max_retries progress calls of 100 ms. Returns HG_SUCCESS or an error */
+hg_return_t tree_barrier_init(
+        struct hg_comm_info *hg,
+        hg_addr_t svr,
+        int id,
+        int fanout,
+        int max_retries);
+
+/* wait on a round of the tree barrier, as ^ */
+hg_return_t tree_barrier(struct hg_comm_info *hg, int max_retries);
+
+void tree_barrier_fini(struct hg_comm_info *hg);
+
 /* server RPC handlers */
 hg_return_t check_in(hg_handle_t handle);
 hg_return_t noop(hg_handle_t handle);
 hg_return_t get_bulk_handle(hg_handle_t handle);
 hg_return_t shutdown_server(hg_handle_t handle);
 hg_return_t bulk_read(hg_handle_t handle);
+hg_return_t bulk_read_from(hg_handle_t handle);
+hg_return_t sized_rpc(hg_handle_t handle);
+hg_return_t get_stats(hg_handle_t handle);
+hg_return_t barrier_join(hg_handle_t handle);
+
+/* client RPC handlers (tree barrier) */
+hg_return_t tree_arrive(hg_handle_t handle);
+
+/* print the server's statistics since start, format:
+ *   server stats <uptime s> <# progress calls> <# callbacks> <busy s>
+ *     <idle s> <bulk bytes>
+ *   server stats rpc <name> <count> <total handler s> <avg handler s>
+ *   server lat <name> <count> <p50> <p90> <p99> <p99.9> <max>
+ * with one rpc / lat line pair per RPC that ran */
+void server_stats_print(FILE *f);
 
 /* main loop for server */
 void run_server(
@@ -130,6 +737,24 @@ void run_server(
 /* misc util */
 hg_bulk_t dup_hg_bulk(hg_class_t *cl, hg_bulk_t in);
 
+/* spread RPCs over a server's num_ctx contexts by key (no-op for one
+ * context) */
+static inline void set_handle_target_ctx(
+        hg_handle_t handle,
+        unsigned int num_ctx,
+        unsigned int key)
+{
+    if (num_ctx > 1)
+        HG_Set_target_id(handle, (hg_uint8_t) (key % num_ctx));
+}
+
 hg_addr_t lookup_serv_addr(struct hg_comm_info *hg, const char *info_str);
 
+/* NA message size limits - payloads past max_unexpected no longer fit the
+ * RPC request's eager message (for reporting where that cliff is) */
+void get_msg_limits(
+        struct hg_comm_info *hg,
+        size_t *max_unexpected,
+        size_t *max_expected);
+
 #endif /* end of include guard: HG_CTEST_UTIL_H */
@@ -12,6 +12,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <time.h>
+#include <math.h>
+#include <unistd.h>
 
 #include <mercury.h>
 #include <mercury_bulk.h>
@@ -24,14 +26,22 @@ const int NUM_REPS = 100;
 const int WARMUP = 20;
 int output_all_times = 0;
 
+/* in-process size sweep (--sizes option) - each size reuses the session and
+ * the buffer registered at the largest size */
+static struct size_range sizes;
+static int size_sweep = 0;
+
 /* this needs to be a global to pass around between callback functions and
  * whatnot */
 static struct hg_comm_info hcli;
 
+/* contexts the rpc server spreads RPCs over (--server-threads) */
+static unsigned int rpc_svr_num_ctx = 1;
+
 struct cli_cb_data {
     hg_bulk_t bulk_handle;
     int is_finished;
-    struct timespec ts;
+    uint64_t ts; /* ticks */
 };
 
 static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
@@ -48,7 +58,7 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
     hret = HG_Get_output(info->info.forward.handle, &out);
     assert(hret == HG_SUCCESS);
     if (out_cb) {
-        clock_gettime(CLOCK_MONOTONIC, &out_cb->ts);
+        out_cb->ts = ticks_now();
         out_cb->bulk_handle = dup_hg_bulk(hcli.hgcl, out.bh);
         out_cb->is_finished = 1;
     }
@@ -60,7 +70,7 @@ static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info)
 {
     struct cli_cb_data * out_cb = info->arg;
     assert(info->ret == HG_SUCCESS);
-    clock_gettime(CLOCK_MONOTONIC, &out_cb->ts);
+    out_cb->ts = ticks_now();
     dprintf("bulk callback entered\n");
     out_cb->is_finished = 1;
     return HG_SUCCESS;
@@ -74,14 +84,13 @@ static hg_return_t cli_wait_loop_all(
     hg_return_t hret;
 
     int retry;
-    unsigned int num_cb;
     int c;
 
     dprintf("progress/trigger loop entered\n");
 
     for(retry = 0; retry < max_retries; retry++) {
-        hret = HG_Trigger(hcli.hgctx, 0, 1, &num_cb);
-        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+        hret = trigger_ready(hcli.hgctx, NULL);
+        if (hret != HG_SUCCESS)
             return hret;
 
         /* check completions before progress so we don't get stuck in a wait */
@@ -94,262 +103,527 @@ static hg_return_t cli_wait_loop_all(
                 return HG_SUCCESS;
         }
 
-        hret = HG_Progress(hcli.hgctx, 100);
+        hret = progress_wait(hcli.hgctx, 100);
         if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
             return hret;
     }
     return HG_TIMEOUT;
 }
 
-static void run_client(
-        size_t rdma_size,
-        char const * info_str,
-        char const * rdma_svr,
-        char const * rpc_svr)
+struct cli_times {
+    double isolated_cb, isolated_call;
+    double first_cb, first_call;
+    double last_cb, last_call;
+};
+
+/* repetition control for one measurement loop: WARMUP discarded reps, then
+ * NUM_REPS measured ones - or with --converge, reps until the loop's
+ * completion times (one per op it runs) have converged. Measured reps are
+ * stored at the index rep_loop_record returns */
+struct rep_loop {
+    int r;     /* reps run */
+    int n;     /* reps measured */
+    int num;   /* measurements per rep */
+    int steady, done;
+    uint64_t start;
+    struct converge conv[2];
+};
+
+static void rep_loop_start(struct rep_loop *l, int num)
 {
-    /* servers */
-    hg_addr_t rdma_svr_addr = HG_ADDR_NULL;
-    hg_addr_t rpc_svr_addr = HG_ADDR_NULL;
+    memset(l, 0, sizeof(*l));
+    l->num = num;
+    l->start = ticks_now();
+    if (converge_enabled())
+        for (int i = 0; i < num; i++)
+            converge_init(&l->conv[i]);
+}
+
+static int rep_loop_more(const struct rep_loop *l)
+{
+    if (!converge_enabled())
+        return l->r < NUM_REPS + WARMUP;
+    return !l->done &&
+        ticks_to_s(ticks_now() - l->start) <= hg_converge_opts.max_seconds;
+}
 
+/* returns where to store the rep, -1 for warmup */
+static int rep_loop_record(struct rep_loop *l, const double *v)
+{
+    int i, all = 1;
+
+    l->r++;
+    if (!converge_enabled()) {
+        if (l->r <= WARMUP)
+            return -1;
+        return l->n++;
+    }
+    /* every measurement is fed, warmup lasts until all are steady */
+    if (!l->steady) {
+        for (i = 0; i < l->num; i++)
+            if (!converge_warm(&l->conv[i], v[i]))
+                all = 0;
+        l->steady = all;
+        return -1;
+    }
+    for (i = 0; i < l->num; i++)
+        if (!converge_add(&l->conv[i], v[i]))
+            all = 0;
+    l->done = all;
+    return l->n++;
+}
+
+/* grow the times arrays to hold rep idx */
+static void times_reserve(
+        struct cli_times **rpc,
+        struct cli_times **bulk,
+        int *cap,
+        int idx)
+{
+    if (idx < *cap)
+        return;
+    while (*cap <= idx)
+        *cap *= 2;
+    *rpc = realloc(*rpc, *cap * sizeof(**rpc));
+    *bulk = realloc(*bulk, *cap * sizeof(**bulk));
+    assert(*rpc && *bulk);
+}
+
+/* the loops filling each cli_times field: rpc-iso, bulk-iso, bulk-first +
+ * rpc-last, rpc-first + bulk-last */
+enum { LOOP_RPC_ISO, LOOP_BULK_ISO, LOOP_BULK_FIRST, LOOP_RPC_FIRST };
+
+/* rep r of a times array, NaN in the fields whose loop measured fewer than
+ * r+1 reps */
+static struct cli_times rep_times(
+        const struct cli_times *t,
+        int r,
+        int iso_n,
+        int first_n,
+        int last_n)
+{
+    struct cli_times v;
+
+    v.isolated_cb = r < iso_n ? t[r].isolated_cb : NAN;
+    v.isolated_call = r < iso_n ? t[r].isolated_call : NAN;
+    v.first_cb = r < first_n ? t[r].first_cb : NAN;
+    v.first_call = r < first_n ? t[r].first_call : NAN;
+    v.last_cb = r < last_n ? t[r].last_cb : NAN;
+    v.last_call = r < last_n ? t[r].last_call : NAN;
+    return v;
+}
+
+/* measure and report one size */
+static void run_point(
+        size_t sz,
+        hg_addr_t rdma_svr_addr,
+        hg_addr_t rpc_svr_addr,
+        hg_bulk_t bulk_handle)
+{
     /* RPC params */
     hg_handle_t handle;
-    hg_bulk_t bulk_handle;
     struct cli_cb_data cb_data[2];
     struct cli_cb_data *cb_data_bulk = &cb_data[0], *cb_data_rpc = &cb_data[1];
 
     /* timing params */
-    struct timespec ts_bulk_start, ts_bulk_end,
-                    ts_get_bulk_start, ts_get_bulk_end;
-
-    struct cli_times {
-        double isolated_cb, isolated_call;
-        double first_cb, first_call;
-        double last_cb, last_call;
-    };
+    uint64_t ts_bulk_start, ts_bulk_end,
+             ts_get_bulk_start, ts_get_bulk_end;
 
     struct cli_times *rpc_times, *bulk_times;
     struct cli_times
         rpc_avg  = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
         bulk_avg = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 
-    int r;
+    int r, i, cap = NUM_REPS;
+    int cpu, node;
+    struct cpu_time cpu_start, cpu_end;
 
-    /* return params */
-    hg_return_t hret;
+    /* the four measurement loops, and the most reps any of them measured */
+    struct rep_loop loops[4];
+    int num_reps, rpc_iso_n, rpc_first_n, rpc_last_n,
+        bulk_iso_n, bulk_first_n, bulk_last_n;
+    double v[2];
 
-    /* initialize */
-    hg_init(info_str, rdma_size, HG_FALSE, 0, &hcli);
+    /* percentile output */
+    static struct lat_hist hist;
+    char prefix[256];
 
-    rdma_svr_addr = lookup_serv_addr(&hcli, rdma_svr);
-    assert(rdma_svr_addr != HG_ADDR_NULL);
-    rpc_svr_addr = lookup_serv_addr(&hcli, rpc_svr);
-    assert(rpc_svr_addr != HG_ADDR_NULL);
-
-    if (strcmp(rdma_svr, rpc_svr) != 0)
-        hcli.is_separate_servers = 1;
+    /* return params */
+    hg_return_t hret;
 
     cb_data_bulk->is_finished = 0;
     cb_data_bulk->bulk_handle = HG_BULK_NULL;
     cb_data_rpc->is_finished = 0;
     cb_data_rpc->bulk_handle = HG_BULK_NULL;
 
-    /* create, run RPC to grab bulk handle from rdma server */
-
-    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
-            hcli.get_bulk_handle_rpc_id, &handle);
-    assert(hret == HG_SUCCESS);
-
-    HG_Forward(handle, get_bulk_handle_cli_cb, cb_data_rpc, NULL);
-
-    hret = cli_wait_loop_all(20, 1, cb_data_rpc);
-
-    assert(hret == HG_SUCCESS);
-
-    bulk_handle = cb_data_rpc->bulk_handle;
-
-    HG_Destroy(handle);
-
     /* allocate times */
-    rpc_times  = malloc(NUM_REPS * sizeof(*rpc_times));
-    bulk_times = malloc(NUM_REPS * sizeof(*bulk_times)); 
+    rpc_times  = malloc(cap * sizeof(*rpc_times));
+    bulk_times = malloc(cap * sizeof(*bulk_times));
+    assert(rpc_times && bulk_times);
+
+    get_cpu_time(0, &cpu_start);
 
     /* get our base timings: no concurrency */
 
     hret = HG_Create(hcli.hgctx, rpc_svr_addr,
             hcli.get_bulk_handle_rpc_id, &handle);
     assert(hret == HG_SUCCESS);
+    set_handle_target_ctx(handle, rpc_svr_num_ctx, (unsigned int) getpid());
 
-    for (r = 0 ; r < NUM_REPS+WARMUP; r++) {
+    for (r = 0, rep_loop_start(&loops[0], 1); rep_loop_more(&loops[0]);
+            r++) {
         cb_data_rpc->is_finished = 0;
         dprintf("rpc, iteration %d\n", r);
-        clock_gettime(CLOCK_MONOTONIC, &ts_get_bulk_start);
+        ts_get_bulk_start = ticks_now();
         hret = HG_Forward(handle, get_bulk_handle_cli_cb, cb_data_rpc, NULL);
         assert(hret == HG_SUCCESS);
-        clock_gettime(CLOCK_MONOTONIC, &ts_get_bulk_end);
+        ts_get_bulk_end = ticks_now();
         hret = cli_wait_loop_all(100, 1, cb_data_rpc);
         assert(hret == HG_SUCCESS);
-        if (r >= WARMUP) {
-            rpc_times[r-WARMUP].isolated_cb =
-                time_to_s_lf(timediff(ts_get_bulk_start, cb_data_rpc->ts));
-            rpc_times[r-WARMUP].isolated_call =
-                time_to_s_lf(timediff(ts_get_bulk_start, ts_get_bulk_end));
+        v[0] = ticks_to_s(cb_data_rpc->ts - ts_get_bulk_start);
+        if ((i = rep_loop_record(&loops[0], v)) >= 0) {
+            times_reserve(&rpc_times, &bulk_times, &cap, i);
+            rpc_times[i].isolated_cb = v[0];
+            rpc_times[i].isolated_call =
+                ticks_to_s(ts_get_bulk_end - ts_get_bulk_start);
         }
     }
-    for (r = 0; r < NUM_REPS+WARMUP; r++) {
+    for (r = 0, rep_loop_start(&loops[1], 1); rep_loop_more(&loops[1]);
+            r++) {
         cb_data_bulk->is_finished = 0;
         dprintf("bulk, iteration %d\n", r);
-        clock_gettime(CLOCK_MONOTONIC, &ts_bulk_start);
+        ts_bulk_start = ticks_now();
         hret = HG_Bulk_transfer(hcli.hgctx, cli_bulk_xfer_cb, cb_data_bulk,
                 HG_BULK_PUSH, rdma_svr_addr, bulk_handle, 0, hcli.bh,
-                0, hcli.buf_sz, HG_OP_ID_IGNORE);
-        clock_gettime(CLOCK_MONOTONIC, &ts_bulk_end);
+                0, sz, HG_OP_ID_IGNORE);
+        ts_bulk_end = ticks_now();
         assert(hret == HG_SUCCESS);
         hret = cli_wait_loop_all(100, 1, cb_data_bulk);
         assert(hret == HG_SUCCESS);
-        if (r >= WARMUP) {
-            bulk_times[r-WARMUP].isolated_cb =
-                time_to_s_lf(timediff(ts_bulk_start, cb_data_bulk->ts));
-            bulk_times[r-WARMUP].isolated_call =
-                time_to_s_lf(timediff(ts_bulk_start, ts_bulk_end));
+        v[0] = ticks_to_s(cb_data_bulk->ts - ts_bulk_start);
+        if ((i = rep_loop_record(&loops[1], v)) >= 0) {
+            times_reserve(&rpc_times, &bulk_times, &cap, i);
+            bulk_times[i].isolated_cb = v[0];
+            bulk_times[i].isolated_call =
+                ticks_to_s(ts_bulk_end - ts_bulk_start);
         }
     }
 
     /* now do bulk first, rpc second */
-    for (r = 0; r < NUM_REPS+WARMUP; r++) {
+    for (r = 0, rep_loop_start(&loops[2], 2); rep_loop_more(&loops[2]);
+            r++) {
         cb_data_rpc->is_finished = 0;
         cb_data_bulk->is_finished = 0;
         dprintf("bulk*+rpc, iteration %d\n", r);
-        clock_gettime(CLOCK_MONOTONIC, &ts_bulk_start);
+        ts_bulk_start = ticks_now();
         hret = HG_Bulk_transfer(hcli.hgctx, cli_bulk_xfer_cb, cb_data_bulk,
                 HG_BULK_PUSH, rdma_svr_addr, bulk_handle, 0, hcli.bh,
-                0, hcli.buf_sz, HG_OP_ID_IGNORE);
+                0, sz, HG_OP_ID_IGNORE);
         assert(hret == HG_SUCCESS);
-        clock_gettime(CLOCK_MONOTONIC, &ts_get_bulk_start);
+        ts_get_bulk_start = ticks_now();
         ts_bulk_end = ts_get_bulk_start;
         dprintf("bulk+rpc*, iteration %d\n", r);
         hret = HG_Forward(handle, get_bulk_handle_cli_cb, cb_data_rpc, NULL);
         assert(hret == HG_SUCCESS);
-        clock_gettime(CLOCK_MONOTONIC, &ts_get_bulk_end);
+        ts_get_bulk_end = ticks_now();
         hret = cli_wait_loop_all(100, 2, cb_data);
         assert(hret == HG_SUCCESS);
-        if (r >= WARMUP) {
-            rpc_times[r-WARMUP].last_cb =
-                time_to_s_lf(timediff(ts_get_bulk_start, cb_data_rpc->ts));
-            rpc_times[r-WARMUP].last_call =
-                time_to_s_lf(timediff(ts_get_bulk_start, ts_get_bulk_end));
-            bulk_times[r-WARMUP].first_cb =
-                time_to_s_lf(timediff(ts_bulk_start, cb_data_bulk->ts));
-            bulk_times[r-WARMUP].first_call =
-                time_to_s_lf(timediff(ts_bulk_start, ts_bulk_end));
+        v[0] = ticks_to_s(cb_data_rpc->ts - ts_get_bulk_start);
+        v[1] = ticks_to_s(cb_data_bulk->ts - ts_bulk_start);
+        if ((i = rep_loop_record(&loops[2], v)) >= 0) {
+            times_reserve(&rpc_times, &bulk_times, &cap, i);
+            rpc_times[i].last_cb = v[0];
+            rpc_times[i].last_call =
+                ticks_to_s(ts_get_bulk_end - ts_get_bulk_start);
+            bulk_times[i].first_cb = v[1];
+            bulk_times[i].first_call =
+                ticks_to_s(ts_bulk_end - ts_bulk_start);
         }
     }
 
     /* finally, do rpc first, bulk second */
-    for (r = 0; r < NUM_REPS+WARMUP; r++) {
+    for (r = 0, rep_loop_start(&loops[3], 2); rep_loop_more(&loops[3]);
+            r++) {
         cb_data_rpc->is_finished = 0;
         cb_data_bulk->is_finished = 0;
         dprintf("rpc*+bulk, iteration %d\n", r);
-        clock_gettime(CLOCK_MONOTONIC, &ts_get_bulk_start);
+        ts_get_bulk_start = ticks_now();
         hret = HG_Forward(handle, get_bulk_handle_cli_cb, cb_data_rpc, NULL);
         assert(hret == HG_SUCCESS);
         dprintf("rpc+bulk*, iteration %d\n", r);
-        clock_gettime(CLOCK_MONOTONIC, &ts_bulk_start);
+        ts_bulk_start = ticks_now();
         ts_get_bulk_end = ts_bulk_start;
         hret = HG_Bulk_transfer(hcli.hgctx, cli_bulk_xfer_cb, cb_data_bulk,
                 HG_BULK_PUSH, rdma_svr_addr, bulk_handle, 0, hcli.bh,
-                0, hcli.buf_sz, HG_OP_ID_IGNORE);
+                0, sz, HG_OP_ID_IGNORE);
         assert(hret == HG_SUCCESS);
-        clock_gettime(CLOCK_MONOTONIC, &ts_bulk_end);
+        ts_bulk_end = ticks_now();
         hret = cli_wait_loop_all(100, 2, cb_data);
         assert(hret == HG_SUCCESS);
-        if (r >= WARMUP) {
-            rpc_times[r-WARMUP].first_cb =
-                time_to_s_lf(timediff(ts_get_bulk_start, cb_data_rpc->ts));
-            rpc_times[r-WARMUP].first_call =
-                time_to_s_lf(timediff(ts_get_bulk_start, ts_get_bulk_end));
-            bulk_times[r-WARMUP].last_cb =
-                time_to_s_lf(timediff(ts_bulk_start, cb_data_bulk->ts));
-            bulk_times[r-WARMUP].last_call =
-                time_to_s_lf(timediff(ts_bulk_start, ts_bulk_end));
+        v[0] = ticks_to_s(cb_data_rpc->ts - ts_get_bulk_start);
+        v[1] = ticks_to_s(cb_data_bulk->ts - ts_bulk_start);
+        if ((i = rep_loop_record(&loops[3], v)) >= 0) {
+            times_reserve(&rpc_times, &bulk_times, &cap, i);
+            rpc_times[i].first_cb = v[0];
+            rpc_times[i].first_call =
+                ticks_to_s(ts_get_bulk_end - ts_get_bulk_start);
+            bulk_times[i].last_cb = v[1];
+            bulk_times[i].last_call =
+                ticks_to_s(ts_bulk_end - ts_bulk_start);
         }
     }
 
-    /* shutdown the servers (don't bother checking) */
-    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
-            hcli.shutdown_server_rpc_id, &handle);
-    assert(hret == HG_SUCCESS);
-    HG_Forward(handle, NULL, NULL, NULL);
-    hret = cli_wait_loop_all(10, 0, NULL);
-    HG_Destroy(handle);
-
-    if (hcli.is_separate_servers) {
-        hret = HG_Create(hcli.hgctx, rpc_svr_addr,
-                hcli.shutdown_server_rpc_id, &handle);
-        assert(hret == HG_SUCCESS);
-        HG_Forward(handle, NULL, NULL, NULL);
-        hret = cli_wait_loop_all(10, 0, NULL);
-        HG_Destroy(handle);
+    get_cpu_time(0, &cpu_end);
+    get_placement(&cpu, &node);
+
+    /* each measurement is reported over the reps its own loop measured
+     * (all NUM_REPS without --converge). A loop that never got past warmup
+     * leaves nothing to report for the size */
+    num_reps = 0;
+    for (i = 0; i < 4; i++) {
+        if (loops[i].n == 0) {
+            fprintf(stderr, "warning: size %lu never got past warmup, "
+                    "skipping it\n", (unsigned long) sz);
+            goto done;
+        }
+        if (loops[i].n > num_reps)
+            num_reps = loops[i].n;
     }
+    rpc_iso_n = loops[LOOP_RPC_ISO].n;
+    rpc_first_n = loops[LOOP_RPC_FIRST].n;
+    rpc_last_n = loops[LOOP_BULK_FIRST].n;
+    bulk_iso_n = loops[LOOP_BULK_ISO].n;
+    bulk_first_n = loops[LOOP_BULK_FIRST].n;
+    bulk_last_n = loops[LOOP_RPC_FIRST].n;
 
 #define PRINT_RECORD(_rpc, _bulk) \
     printf("%-8s %-8s %1d %12lu %3d " \
            "%1.3e %1.3e %1.3e %1.3e %1.3e %1.3e " \
-           "%1.3e %1.3e %1.3e %1.3e %1.3e %1.3e\n", \
+           "%1.3e %1.3e %1.3e %1.3e %1.3e %1.3e %3d %2d\n", \
             hcli.class ? hcli.class : "default", hcli.transport, \
-            hcli.is_separate_servers, hcli.buf_sz, NUM_REPS, \
+            hcli.is_separate_servers, sz, num_reps, \
             _rpc.isolated_call, _rpc.isolated_cb, \
             _rpc.first_call, _rpc.first_cb, \
             _rpc.last_call, _rpc.last_cb, \
             _bulk.isolated_call, _bulk.isolated_cb, \
             _bulk.first_call, _bulk.first_cb, \
-            _bulk.last_call, _bulk.last_cb)
+            _bulk.last_call, _bulk.last_cb, cpu, node)
+    /* same as a report record, rep -1 being the average */
+#define REPORT_RECORD(_rep, _rpc, _bulk) \
+    do { \
+        report_begin("result"); \
+        report_int("rep", _rep); \
+        report_dbl("rpc_iso_call", _rpc.isolated_call); \
+        report_dbl("rpc_iso", _rpc.isolated_cb); \
+        report_dbl("rpc_first_call", _rpc.first_call); \
+        report_dbl("rpc_first", _rpc.first_cb); \
+        report_dbl("rpc_last_call", _rpc.last_call); \
+        report_dbl("rpc_last", _rpc.last_cb); \
+        report_dbl("bulk_iso_call", _bulk.isolated_call); \
+        report_dbl("bulk_iso", _bulk.isolated_cb); \
+        report_dbl("bulk_first_call", _bulk.first_call); \
+        report_dbl("bulk_first", _bulk.first_cb); \
+        report_dbl("bulk_last_call", _bulk.last_call); \
+        report_dbl("bulk_last", _bulk.last_cb); \
+        report_int("cpu", cpu); \
+        report_int("node", node); \
+        report_end(); \
+    } while (0)
     /* finally, print out the results, format:
      * class, transport, separate servers used (bool)
-     * size, repetitions,
+     * size, repetitions (of the longest loop),
      * isolated, concurrent (me-first), concurrent (me-last) rpc time,
      * "                                                   " bulk time
+     * cpu, NUMA node
      * each measurement includes both the async call time and the full time
-     * including callback */
+     * including callback, averaged over its own loop's reps (with -a, reps
+     * a loop didn't run are nan) */
+    report_ctx_clear();
+    report_ctx_int("separate_servers", hcli.is_separate_servers);
+    report_ctx_int("size", (long long) sz);
+    report_ctx_int("reps", num_reps);
     if (output_all_times) {
-        for (r = 0; r < NUM_REPS; r++) {
-            PRINT_RECORD(rpc_times[r], bulk_times[r]);
+        for (r = 0; r < num_reps; r++) {
+            struct cli_times rt = rep_times(rpc_times, r, rpc_iso_n,
+                    rpc_first_n, rpc_last_n);
+            struct cli_times bt = rep_times(bulk_times, r, bulk_iso_n,
+                    bulk_first_n, bulk_last_n);
+            PRINT_RECORD(rt, bt);
+            REPORT_RECORD(r, rt, bt);
         }
     }
     else {
-        for (r = 0; r < NUM_REPS; r++) {
-            rpc_avg.isolated_cb += rpc_times[r].isolated_cb;
-            rpc_avg.isolated_call += rpc_times[r].isolated_call;
-            rpc_avg.first_cb += rpc_times[r].first_cb;
-            rpc_avg.first_call += rpc_times[r].first_call;
-            rpc_avg.last_cb += rpc_times[r].last_cb;
-            rpc_avg.last_call += rpc_times[r].last_call;
-            bulk_avg.isolated_cb += bulk_times[r].isolated_cb;
-            bulk_avg.isolated_call += bulk_times[r].isolated_call;
-            bulk_avg.first_cb += bulk_times[r].first_cb;
-            bulk_avg.first_call += bulk_times[r].first_call;
-            bulk_avg.last_cb += bulk_times[r].last_cb;
-            bulk_avg.last_call += bulk_times[r].last_call;
-        }
-        rpc_avg.isolated_cb /= NUM_REPS;
-        rpc_avg.isolated_call /= NUM_REPS;
-        rpc_avg.first_cb /= NUM_REPS;
-        rpc_avg.first_call /= NUM_REPS;
-        rpc_avg.last_cb /= NUM_REPS;
-        rpc_avg.last_call /= NUM_REPS;
-        bulk_avg.isolated_cb /= NUM_REPS;
-        bulk_avg.isolated_call /= NUM_REPS;
-        bulk_avg.first_cb /= NUM_REPS;
-        bulk_avg.first_call /= NUM_REPS;
-        bulk_avg.last_cb /= NUM_REPS;
-        bulk_avg.last_call /= NUM_REPS;
+#define AVERAGE(_avg, _times, _field, _n) \
+    do { \
+        for (r = 0; r < (_n); r++) \
+            _avg._field += _times[r]._field; \
+        _avg._field /= (_n); \
+    } while (0)
+        AVERAGE(rpc_avg, rpc_times, isolated_cb, rpc_iso_n);
+        AVERAGE(rpc_avg, rpc_times, isolated_call, rpc_iso_n);
+        AVERAGE(rpc_avg, rpc_times, first_cb, rpc_first_n);
+        AVERAGE(rpc_avg, rpc_times, first_call, rpc_first_n);
+        AVERAGE(rpc_avg, rpc_times, last_cb, rpc_last_n);
+        AVERAGE(rpc_avg, rpc_times, last_call, rpc_last_n);
+        AVERAGE(bulk_avg, bulk_times, isolated_cb, bulk_iso_n);
+        AVERAGE(bulk_avg, bulk_times, isolated_call, bulk_iso_n);
+        AVERAGE(bulk_avg, bulk_times, first_cb, bulk_first_n);
+        AVERAGE(bulk_avg, bulk_times, first_call, bulk_first_n);
+        AVERAGE(bulk_avg, bulk_times, last_cb, bulk_last_n);
+        AVERAGE(bulk_avg, bulk_times, last_call, bulk_last_n);
+#undef AVERAGE
 
         PRINT_RECORD(rpc_avg, bulk_avg);
+        REPORT_RECORD(-1, rpc_avg, bulk_avg);
     }
 
 #undef PRINT_RECORD
+#undef REPORT_RECORD
+
+    /* latency distributions of each measurement, format:
+     * class, transport, separate servers used (bool), size, repetitions,
+     * lat <which> <count> <p50> <p90> <p99> <p99.9> <max> (count being the
+     * reps of the measurement's own loop) */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %1d %12lu %3d",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            hcli.is_separate_servers, sz, num_reps);
+#define PRINT_HIST(_times, _field, _n, _label) \
+    do { \
+        lat_hist_init(&hist); \
+        for (r = 0; r < (_n); r++) \
+            lat_hist_record(&hist, (uint64_t) (_times[r]._field * 1e9)); \
+        lat_hist_print(stdout, prefix, _label, &hist); \
+    } while (0)
+
+    PRINT_HIST(rpc_times, isolated_call, rpc_iso_n, "rpc-iso-call");
+    PRINT_HIST(rpc_times, isolated_cb, rpc_iso_n, "rpc-iso");
+    PRINT_HIST(rpc_times, first_call, rpc_first_n, "rpc-first-call");
+    PRINT_HIST(rpc_times, first_cb, rpc_first_n, "rpc-first");
+    PRINT_HIST(rpc_times, last_call, rpc_last_n, "rpc-last-call");
+    PRINT_HIST(rpc_times, last_cb, rpc_last_n, "rpc-last");
+    PRINT_HIST(bulk_times, isolated_call, bulk_iso_n, "bulk-iso-call");
+    PRINT_HIST(bulk_times, isolated_cb, bulk_iso_n, "bulk-iso");
+    PRINT_HIST(bulk_times, first_call, bulk_first_n, "bulk-first-call");
+    PRINT_HIST(bulk_times, first_cb, bulk_first_n, "bulk-first");
+    PRINT_HIST(bulk_times, last_call, bulk_last_n, "bulk-last-call");
+    PRINT_HIST(bulk_times, last_cb, bulk_last_n, "bulk-last");
+
+#undef PRINT_HIST
+
+    /* format: ... progress all <mode> <spin us> <trigger batch>
+     *   <user cpu s> <sys cpu s> (over all four loops) */
+    progress_print(stdout, prefix, "all", &cpu_start, &cpu_end);
+
+    /* how each loop converged, format: ... converge <which>
+     *   <mean | pNN> <warmup reps> <reps> <batches> <estimate>
+     *   <rel half-width> <converged (bool)> */
+    if (converge_enabled()) {
+        converge_print(stdout, prefix, "rpc-iso", &loops[0].conv[0]);
+        converge_print(stdout, prefix, "bulk-iso", &loops[1].conv[0]);
+        converge_print(stdout, prefix, "rpc-last", &loops[2].conv[0]);
+        converge_print(stdout, prefix, "bulk-first", &loops[2].conv[1]);
+        converge_print(stdout, prefix, "rpc-first", &loops[3].conv[0]);
+        converge_print(stdout, prefix, "bulk-last", &loops[3].conv[1]);
+    }
 
+done:
+    if (converge_enabled()) {
+        for (i = 0; i < 4; i++) {
+            converge_fini(&loops[i].conv[0]);
+            converge_fini(&loops[i].conv[1]);
+        }
+    }
     free(rpc_times);
     free(bulk_times);
+    HG_Destroy(handle);
+}
+
+static void run_client(
+        size_t rdma_size,
+        char const * info_str,
+        char const * rdma_svr,
+        char const * rpc_svr)
+{
+    /* servers */
+    hg_addr_t rdma_svr_addr = HG_ADDR_NULL;
+    hg_addr_t rpc_svr_addr = HG_ADDR_NULL;
+
+    /* RPC params */
+    hg_handle_t handle;
+    hg_bulk_t bulk_handle;
+    struct cli_cb_data cb_data_rpc;
+    size_t sz;
+    char prefix[64];
+
+    /* return params */
+    hg_return_t hret;
+
+    /* initialize - a sweep registers its largest size once */
+    hg_init(info_str, size_sweep && sizes.max > rdma_size ? sizes.max
+                                                         : rdma_size,
+            HG_FALSE, 0, &hcli);
+
+    rdma_svr_addr = lookup_serv_addr(&hcli, rdma_svr);
+    assert(rdma_svr_addr != HG_ADDR_NULL);
+    rpc_svr_addr = lookup_serv_addr(&hcli, rpc_svr);
+    assert(rpc_svr_addr != HG_ADDR_NULL);
+
+    if (strcmp(rdma_svr, rpc_svr) != 0)
+        hcli.is_separate_servers = 1;
+
+    /* spread clients' RPCs over the rpc server's contexts */
+    rpc_svr_num_ctx = get_server_num_ctx(&hcli, rpc_svr_addr, 20);
+
+    /* format: <class> <protocol> timer <tsc | clock> <ns per tick>
+     *   <overhead ns> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s",
+            hcli.class ? hcli.class : "default", hcli.transport);
+    timer_print(stdout, prefix);
+
+    cb_data_rpc.is_finished = 0;
+    cb_data_rpc.bulk_handle = HG_BULK_NULL;
+
+    /* create, run RPC to grab bulk handle from rdma server */
+
+    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
+            hcli.get_bulk_handle_rpc_id, &handle);
+    assert(hret == HG_SUCCESS);
+
+    HG_Forward(handle, get_bulk_handle_cli_cb, &cb_data_rpc, NULL);
+
+    hret = wait_until(hcli.hgctx, &cb_data_rpc.is_finished, 20);
+
+    assert(hret == HG_SUCCESS);
+
+    bulk_handle = cb_data_rpc.bulk_handle;
+
+    HG_Destroy(handle);
+
+    if (size_sweep) {
+        sz = sizes.min;
+        do {
+            run_point(sz, rdma_svr_addr, rpc_svr_addr, bulk_handle);
+        } while (size_range_next(&sizes, &sz));
+    }
+    else
+        run_point(rdma_size, rdma_svr_addr, rpc_svr_addr, bulk_handle);
+
+    /* shutdown the servers (don't bother checking) */
+    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
+            hcli.shutdown_server_rpc_id, &handle);
+    assert(hret == HG_SUCCESS);
+    HG_Forward(handle, NULL, NULL, NULL);
+    hret = wait_until(hcli.hgctx, NULL, 10);
+    HG_Destroy(handle);
+
+    if (hcli.is_separate_servers) {
+        hret = HG_Create(hcli.hgctx, rpc_svr_addr,
+                hcli.shutdown_server_rpc_id, &handle);
+        assert(hret == HG_SUCCESS);
+        HG_Forward(handle, NULL, NULL, NULL);
+        hret = wait_until(hcli.hgctx, NULL, 10);
+        HG_Destroy(handle);
+    }
 
     HG_Addr_free(hcli.hgcl, rdma_svr_addr);
     HG_Addr_free(hcli.hgcl, rpc_svr_addr);
@@ -373,11 +647,40 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    /* leading server / placement / progress options */
+    while (argc > 1) {
+        int opt_arg = 1;
+        int rc = parse_common_opt(argc, argv, &opt_arg);
+        if (rc < 0) {
+            usage();
+            exit(1);
+        }
+        else if (rc == 0)
+            break;
+        argc -= opt_arg - 1;
+        argv += opt_arg - 1;
+    }
+
+    if (argc < 2) {
+        usage();
+        exit(1);
+    }
+
     if (strcmp(argv[1], "-a") == 0) {
         output_all_times = 1;
         argv++;
     }
 
+    if (argc > 2 && strcmp(argv[1], "--sizes") == 0) {
+        if (size_range_parse(argv[2], &sizes) != 0 || sizes.min == 0) {
+            usage();
+            exit(1);
+        }
+        size_sweep = 1;
+        argc -= 2;
+        argv += 2;
+    }
+
     if (strcmp(argv[1], "client") == 0)
         mode = CLIENT;
     else if (strcmp(argv[1], "server") == 0)
@@ -421,8 +724,11 @@ int main(int argc, char *argv[])
 
 
 const char * usage_str =
-"Usage: hg-ctest1 [--all] (client | server) OPTIONS\n"
+"Usage: hg-ctest1 [--all] [--sizes SPEC] (client | server) OPTIONS\n"
 "  --all prints out every measurement, rather than an average\n"
+"  --sizes MIN:MAX:xF (or MIN:MAX:+STEP) measures each size from MIN to MAX\n"
+"    in one client session (sizes take K/M/G suffixes, e.g. 4K:64M:x2);\n"
+"    the server's <rdma size max> should be at least MAX\n"
 "  in client mode, OPTIONS are:\n"
 "    <rdma size> <class>+<protocol> <rdma server> <rpc server>\n"
 "  in server mode, OPTIONS are:\n"
@@ -435,6 +741,7 @@ const char * usage_str =
 "      $(cat ctest1-server-addr.tmp-foo) $(cat ctest1-server-addr.tmp-foo)\n";
 
 static void usage() {
-    fprintf(stderr, usage_str);
+    fprintf(stderr, "%s", usage_str);
+    print_common_usage(stderr);
 }
 
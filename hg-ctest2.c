@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include <pthread.h>
+#include <unistd.h>
 
 #include <mercury.h>
 #include <mercury_bulk.h>
@@ -36,6 +37,8 @@ static struct hg_comm_info hcli;
 /* servers */
 static hg_addr_t rdma_svr_addr = HG_ADDR_NULL;
 static hg_addr_t rpc_svr_addr = HG_ADDR_NULL;
+/* contexts each spreads RPCs over (--server-threads) */
+static unsigned int rdma_svr_num_ctx = 1, rpc_svr_num_ctx = 1;
 
 struct bulk_thread_args {
     hg_context_t *bulk_ctx;
@@ -44,9 +47,13 @@ struct bulk_thread_args {
 
 struct cli_cb_loop {
     int num_complete;
-    struct timespec start;
-    struct timespec start_call;
-    double total_time, total_time_call;
+    uint64_t start; /* ticks */
+    uint64_t start_call;
+    uint64_t end; /* last completion (generalised mode) */
+    uint64_t total_ticks, total_ticks_call;
+    struct lat_hist call_hist, complete_hist;
+    int cpu, node; /* where the thread ran */
+    struct cpu_time cpu_start, cpu_end; /* thread cpu time */
     union {
         hg_handle_t handle; /* RPC */
         struct bulk_thread_args bargs; /* bulk */
@@ -57,31 +64,34 @@ static hg_return_t cli_rpc_cb(const struct hg_cb_info *info)
 {
     hg_return_t hret;
     struct cli_cb_loop *loop;
-    struct timespec end;
+    uint64_t end, d;
     pthread_t self;
 
     dprintf("rpc callback entered, ");
 
     assert(info->ret == HG_SUCCESS);
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    end = ticks_now();
 
     self = pthread_self();
     assert(pthread_equal(self, rpc_thread));
 
     loop = (struct cli_cb_loop*) info->arg;
 
-    loop->total_time += time_to_s_lf(timediff(loop->start_call, end));
+    d = end - loop->start_call;
+    loop->total_ticks += d;
+    lat_hist_record_ticks(&loop->complete_hist, d);
 
     loop->num_complete++;
     /* call the next one */
-    if (time_to_s_lf(timediff(loop->start, end)) < benchmark_seconds) {
+    if (ticks_to_s(end - loop->start) < benchmark_seconds) {
         loop->start_call = end;
         dprintf("calling next\n");
         hret = HG_Forward(loop->u.handle, cli_rpc_cb, loop, NULL);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        loop->total_time_call +=
-            time_to_s_lf(timediff(loop->start_call, end));
+        end = ticks_now();
+        d = end - loop->start_call;
+        loop->total_ticks_call += d;
+        lat_hist_record_ticks(&loop->call_hist, d);
         return hret;
     }
     else {
@@ -93,52 +103,59 @@ static hg_return_t cli_rpc_cb(const struct hg_cb_info *info)
 
 static void * rpc_thread_run(void * arg)
 {
-    struct timespec end_call;
+    uint64_t end_call;
     hg_return_t hret;
     struct cli_cb_loop *loop;
-    unsigned int num_cb;
     int rc;
 
     (void)arg;
 
+    pin_thread(1);
+
     loop = malloc(sizeof(*loop));
     assert(loop);
+    get_placement(&loop->cpu, &loop->node);
 
     hret = HG_Create(hcli.hgctx, rdma_svr_addr,
             hcli.get_bulk_handle_rpc_id, &loop->u.handle);
     if (hret != HG_SUCCESS)
         goto done;
+    set_handle_target_ctx(loop->u.handle, rdma_svr_num_ctx,
+            (unsigned int) getpid());
 
-    loop->total_time = 0;
-    loop->total_time_call = 0;
+    loop->total_ticks = 0;
+    loop->total_ticks_call = 0;
     loop->num_complete = 0;
+    lat_hist_init(&loop->call_hist);
+    lat_hist_init(&loop->complete_hist);
 
     /* sync the start time */
     rc = pthread_barrier_wait(barrier);
     assert(rc == 0 || rc == PTHREAD_BARRIER_SERIAL_THREAD);
+    get_cpu_time(1, &loop->cpu_start);
 
     /* initial forward */
-    clock_gettime(CLOCK_MONOTONIC, &loop->start_call);
+    loop->start_call = ticks_now();
     loop->start = loop->start_call;
     dprintf("initial rpc call\n");
     hret = HG_Forward(loop->u.handle, cli_rpc_cb, loop, NULL);
     if (hret != HG_SUCCESS)
         goto done;
-    clock_gettime(CLOCK_MONOTONIC, &end_call);
-    loop->total_time_call += time_to_s_lf(timediff(loop->start_call, end_call));
+    end_call = ticks_now() - loop->start_call;
+    loop->total_ticks_call += end_call;
+    lat_hist_record_ticks(&loop->call_hist, end_call);
 
     stop_rpc_loop = 0;
     /* wait loop until the benchmark is over */
     do {
-        do {
-            hret = HG_Trigger(hcli.hgctx, 0, 1, &num_cb);
-        } while (hret == HG_SUCCESS && num_cb > 0);
-        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+        hret = trigger_ready(hcli.hgctx, NULL);
+        if (hret != HG_SUCCESS)
             goto done;
-        hret = HG_Progress(hcli.hgctx, 100);
+        hret = progress_wait(hcli.hgctx, 100);
         if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
             goto done;
     } while (!stop_rpc_loop);
+    get_cpu_time(1, &loop->cpu_end);
 
 done:
     return stop_rpc_loop ? loop : NULL;
@@ -146,7 +163,7 @@ done:
 
 static hg_return_t cli_bulk_cb(const struct hg_cb_info *info)
 {
-    struct timespec end;
+    uint64_t end, d;
     hg_return_t hret;
     struct cli_cb_loop *loop;
     pthread_t self;
@@ -155,7 +172,7 @@ static hg_return_t cli_bulk_cb(const struct hg_cb_info *info)
 
     assert(info->ret == HG_SUCCESS);
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    end = ticks_now();
 
     /* sanity check */
     self = pthread_self();
@@ -163,18 +180,21 @@ static hg_return_t cli_bulk_cb(const struct hg_cb_info *info)
 
     loop = (struct cli_cb_loop*) info->arg;
 
-    loop->total_time += time_to_s_lf(timediff(loop->start_call, end));
+    d = end - loop->start_call;
+    loop->total_ticks += d;
+    lat_hist_record_ticks(&loop->complete_hist, d);
     /* call the next one */
     loop->num_complete++;
-    if (time_to_s_lf(timediff(loop->start, end)) < benchmark_seconds) {
+    if (ticks_to_s(end - loop->start) < benchmark_seconds) {
         loop->start_call = end;
         dprintf("calling next\n");
         hret = HG_Bulk_transfer(loop->u.bargs.bulk_ctx, cli_bulk_cb, loop,
                 HG_BULK_PUSH, rdma_svr_addr, loop->u.bargs.bulk_remote, 0,
                 loop->u.bargs.bulk_local, 0, hcli.buf_sz, NULL);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        loop->total_time_call +=
-            time_to_s_lf(timediff(loop->start_call, end));
+        end = ticks_now();
+        d = end - loop->start_call;
+        loop->total_ticks_call += d;
+        lat_hist_record_ticks(&loop->call_hist, d);
         return hret;
     }
     else {
@@ -186,27 +206,32 @@ static hg_return_t cli_bulk_cb(const struct hg_cb_info *info)
 
 static void * bulk_thread_run(void * arg)
 {
-    struct timespec end_call;
+    uint64_t end_call;
     hg_return_t hret;
     struct cli_cb_loop *loop;
-    unsigned int num_cb;
     int rc;
 
+    pin_thread(2);
+
     loop = malloc(sizeof(*loop));
     assert(loop);
+    get_placement(&loop->cpu, &loop->node);
 
     loop->u.bargs = *(struct bulk_thread_args*)arg;
 
-    loop->total_time = 0;
-    loop->total_time_call = 0;
+    loop->total_ticks = 0;
+    loop->total_ticks_call = 0;
     loop->num_complete = 0;
+    lat_hist_init(&loop->call_hist);
+    lat_hist_init(&loop->complete_hist);
 
     /* sync the start time */
     rc = pthread_barrier_wait(barrier);
     assert(rc == 0 || rc == PTHREAD_BARRIER_SERIAL_THREAD);
+    get_cpu_time(1, &loop->cpu_start);
 
     /* initial bulk */
-    clock_gettime(CLOCK_MONOTONIC, &loop->start);
+    loop->start = ticks_now();
     loop->start_call = loop->start;
     dprintf("initial bulk call\n");
     hret = HG_Bulk_transfer(loop->u.bargs.bulk_ctx, cli_bulk_cb, loop,
@@ -214,27 +239,137 @@ static void * bulk_thread_run(void * arg)
             loop->u.bargs.bulk_local, 0, hcli.buf_sz, NULL);
     if (hret != HG_SUCCESS)
         goto done;
-    clock_gettime(CLOCK_MONOTONIC, &end_call);
-    loop->total_time_call += time_to_s_lf(timediff(loop->start_call, end_call));
+    end_call = ticks_now() - loop->start_call;
+    loop->total_ticks_call += end_call;
+    lat_hist_record_ticks(&loop->call_hist, end_call);
 
     stop_bulk_loop = 0;
     /* wait loop until all expected ops are over */
     do {
-        do {
-            hret = HG_Trigger(loop->u.bargs.bulk_ctx, 0, 1,
-                    &num_cb);
-        } while (hret == HG_SUCCESS && num_cb > 0);
-        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+        hret = trigger_ready(loop->u.bargs.bulk_ctx, NULL);
+        if (hret != HG_SUCCESS)
             goto done;
-        hret = HG_Progress(loop->u.bargs.bulk_ctx, 100);
+        hret = progress_wait(loop->u.bargs.bulk_ctx, 100);
         if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
             goto done;
     } while (!stop_bulk_loop);
+    get_cpu_time(1, &loop->cpu_end);
 
 done:
     return stop_bulk_loop ? loop : NULL;
 }
 
+/* generalised mode: T rpc threads and B bulk threads, each driving its own
+ * context (or all sharing the client's context) */
+struct gen_thread {
+    pthread_t tid;
+    int idx;
+    int is_bulk;
+    int stop;
+    hg_context_t *ctx;
+    struct cli_cb_loop loop;
+};
+
+/* -1 rpc threads: run the original rpc/bulk pair benchmark */
+static int gen_rpc_threads = -1;
+static int gen_bulk_threads = 0;
+static int gen_sweep = 0;
+static int gen_shared_ctx = 0;
+static pthread_barrier_t gen_barrier;
+
+static hg_return_t gen_cb(const struct hg_cb_info *info);
+
+/* issue the next operation of a generalised thread and time the call */
+static hg_return_t gen_issue(struct gen_thread *t)
+{
+    struct cli_cb_loop *loop = &t->loop;
+    uint64_t end, d;
+    hg_return_t hret;
+
+    loop->start_call = ticks_now();
+    trace_event(t->is_bulk ? EV_BULK : EV_FORWARD, t->idx);
+    if (t->is_bulk)
+        hret = HG_Bulk_transfer(t->ctx, gen_cb, t,
+                HG_BULK_PUSH, rdma_svr_addr, loop->u.bargs.bulk_remote, 0,
+                loop->u.bargs.bulk_local, 0, hcli.buf_sz, NULL);
+    else
+        hret = HG_Forward(loop->u.handle, gen_cb, t, NULL);
+    end = ticks_now();
+    d = end - loop->start_call;
+    loop->total_ticks_call += d;
+    lat_hist_record_ticks(&loop->call_hist, d);
+    return hret;
+}
+
+/* with a shared context, any thread may run this callback, so there is no
+ * thread identity check as in cli_rpc_cb / cli_bulk_cb */
+static hg_return_t gen_cb(const struct hg_cb_info *info)
+{
+    struct gen_thread *t;
+    struct cli_cb_loop *loop;
+    uint64_t end, d;
+
+    assert(info->ret == HG_SUCCESS);
+
+    end = ticks_now();
+
+    t = (struct gen_thread*) info->arg;
+    loop = &t->loop;
+    trace_event(EV_CALLBACK, t->idx);
+
+    d = end - loop->start_call;
+    loop->total_ticks += d;
+    lat_hist_record_ticks(&loop->complete_hist, d);
+
+    loop->num_complete++;
+    if (ticks_to_s(end - loop->start) < benchmark_seconds)
+        return gen_issue(t);
+    else {
+        loop->end = end;
+        t->stop = 1;
+        return HG_SUCCESS;
+    }
+}
+
+static void * gen_thread_run(void * arg)
+{
+    struct gen_thread *t = arg;
+    struct cli_cb_loop *loop = &t->loop;
+    hg_return_t hret;
+    int rc;
+
+    pin_thread(t->idx + 1);
+    get_placement(&loop->cpu, &loop->node);
+
+    loop->total_ticks = 0;
+    loop->total_ticks_call = 0;
+    loop->num_complete = 0;
+    lat_hist_init(&loop->call_hist);
+    lat_hist_init(&loop->complete_hist);
+
+    /* sync the start time with the other threads and the main thread */
+    rc = pthread_barrier_wait(&gen_barrier);
+    assert(rc == 0 || rc == PTHREAD_BARRIER_SERIAL_THREAD);
+    get_cpu_time(1, &loop->cpu_start);
+
+    loop->start = ticks_now();
+    hret = gen_issue(t);
+    if (hret != HG_SUCCESS)
+        return NULL;
+
+    do {
+        hret = trigger_ready(t->ctx, NULL);
+        if (hret != HG_SUCCESS)
+            return NULL;
+        hret = progress_wait(t->ctx, 100);
+        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+            return NULL;
+    } while (!t->stop);
+    get_cpu_time(1, &loop->cpu_end);
+
+    return t;
+}
+
 struct cli_init_cb {
     int is_finished;
     hg_bulk_t bulk_handle;
@@ -296,56 +431,16 @@ static hg_return_t init_get_handle_cb(const struct hg_cb_info *info)
     return HG_SUCCESS;
 }
 
-static void run_client(
-        size_t rdma_size,
-        char const * info_str,
-        char const * rdma_svr,
-        char const * rpc_svr)
+/* the original benchmark: one rpc and one bulk thread, run in isolation and
+ * then concurrently */
+static void run_pair(struct bulk_thread_args *bargs)
 {
-    /* return codes, params */
-    hg_return_t hret;
     int rc;
 
-    /* handle etc for initial call to get bulk handle - gotta get for bulk calls */
-    hg_handle_t handle;
-    struct cli_init_cb cb_data;
-
-    /* paramters for bulk thread */
-    struct bulk_thread_args bargs;
-
     /* results */
     struct cli_cb_loop *rpc_isolated, *bulk_isolated, *rpc_concurrent,
                        *bulk_concurrent;
-
-    /* initialize */
-    hg_init(info_str, rdma_size, HG_FALSE, 0, &hcli);
-
-    rdma_svr_addr = lookup_serv_addr(&hcli, rdma_svr);
-    assert(rdma_svr_addr != HG_ADDR_NULL);
-    rpc_svr_addr = lookup_serv_addr(&hcli, rpc_svr);
-    assert(rpc_svr_addr != HG_ADDR_NULL);
-
-    if (strcmp(rdma_svr, rpc_svr) != 0)
-        hcli.is_separate_servers = 1;
-
-    /* get the bulk handle */
-    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
-            hcli.get_bulk_handle_rpc_id, &handle);
-    assert(hret == HG_SUCCESS);
-    cb_data.is_finished = 0;
-    cb_data.bulk_handle = HG_BULK_NULL;
-    HG_Forward(handle, init_get_handle_cb, &cb_data, NULL);
-    hret = cli_wait_loop_all(20, 1, &cb_data);
-    assert(hret == HG_SUCCESS);
-    HG_Destroy(handle);
-
-    /* create a separate bulk context / handle for the bulk thread to iterate on */
-    bargs.bulk_remote = cb_data.bulk_handle;
-    bargs.bulk_ctx = HG_Context_create(hcli.hgcl);
-    assert(bargs.bulk_ctx != NULL);
-    hret = HG_Bulk_create(hcli.hgcl, 1, &hcli.buf, &hcli.buf_sz,
-            HG_BULK_READWRITE, &bargs.bulk_local);
-    assert(hret == HG_SUCCESS);
+    char prefix[256];
 
     /* initialize benchmark barriers */
     rc = pthread_barrier_init(&barrier_single, NULL, 1);
@@ -362,7 +457,7 @@ static void run_client(
 
     /* start up and run bulk thread by itself */
     barrier = &barrier_single;
-    rc = pthread_create(&bulk_thread, NULL, bulk_thread_run, &bargs);
+    rc = pthread_create(&bulk_thread, NULL, bulk_thread_run, bargs);
     assert(!rc);
     rc = pthread_join(bulk_thread, (void**)&bulk_isolated);
     assert(!rc && bulk_isolated != NULL);
@@ -371,7 +466,7 @@ static void run_client(
     barrier = &barrier_concurrent;
     rc = pthread_create(&rpc_thread, NULL, rpc_thread_run, NULL);
     assert(!rc);
-    rc = pthread_create(&bulk_thread, NULL, bulk_thread_run, &bargs);
+    rc = pthread_create(&bulk_thread, NULL, bulk_thread_run, bargs);
     assert(!rc);
     rc = pthread_join(rpc_thread, (void**)&rpc_concurrent);
     assert(!rc && rpc_concurrent != NULL);
@@ -385,22 +480,322 @@ static void run_client(
      *     rpc  concurrent <count> <avg time call> <avg time complete>
      *     bulk isolated   <count> <avg time call> <avg time complete>
      *     bulk concurrent <count> <avg time call> <avg time complete>
+     *     <rpc thread cpu> <numa node> <bulk thread cpu> <numa node>
      */
 #define PR_STAT(_loop) \
     _loop->num_complete, \
-    _loop->total_time_call/_loop->num_complete, \
-    _loop->total_time/_loop->num_complete
+    ticks_to_s(_loop->total_ticks_call)/_loop->num_complete, \
+    ticks_to_s(_loop->total_ticks)/_loop->num_complete
 
     printf( "%-8s %-8s %d %12lu %d "
             "%7d %.3e %.3e %7d %.3e %.3e "
-            "%7d %.3e %.3e %7d %.3e %.3e\n",
+            "%7d %.3e %.3e %7d %.3e %.3e "
+            "%3d %2d %3d %2d\n",
             hcli.class ? hcli.class : "default", hcli.transport,
             hcli.is_separate_servers, hcli.buf_sz, benchmark_seconds,
             PR_STAT(rpc_isolated), PR_STAT(rpc_concurrent),
-            PR_STAT(bulk_isolated), PR_STAT(bulk_concurrent));
+            PR_STAT(bulk_isolated), PR_STAT(bulk_concurrent),
+            rpc_concurrent->cpu, rpc_concurrent->node,
+            bulk_concurrent->cpu, bulk_concurrent->node);
 
 #undef PR_STAT
 
+    report_ctx_clear();
+    report_ctx_int("separate_servers", hcli.is_separate_servers);
+    report_ctx_int("size", (long long) hcli.buf_sz);
+    report_ctx_int("seconds", benchmark_seconds);
+#define REPORT_LOOP(_loop, _name) \
+    do { \
+        report_int(_name "_count", _loop->num_complete); \
+        report_dbl(_name "_call", \
+                ticks_to_s(_loop->total_ticks_call)/_loop->num_complete); \
+        report_dbl(_name "_complete", \
+                ticks_to_s(_loop->total_ticks)/_loop->num_complete); \
+    } while (0)
+    report_begin("result");
+    REPORT_LOOP(rpc_isolated, "rpc_iso");
+    REPORT_LOOP(rpc_concurrent, "rpc_conc");
+    REPORT_LOOP(bulk_isolated, "bulk_iso");
+    REPORT_LOOP(bulk_concurrent, "bulk_conc");
+    report_int("rpc_cpu", rpc_concurrent->cpu);
+    report_int("rpc_node", rpc_concurrent->node);
+    report_int("bulk_cpu", bulk_concurrent->cpu);
+    report_int("bulk_node", bulk_concurrent->node);
+    report_end();
+#undef REPORT_LOOP
+
+    /* latency distributions, format:
+     *   <class> <protocol> <separate rpc/bulk svrs> <bulk size> <bench time>
+     *     lat <which> <count> <p50> <p90> <p99> <p99.9> <max> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %d %12lu %d",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            hcli.is_separate_servers, hcli.buf_sz, benchmark_seconds);
+    lat_hist_print(stdout, prefix, "rpc-iso", &rpc_isolated->complete_hist);
+    lat_hist_print(stdout, prefix, "rpc-conc", &rpc_concurrent->complete_hist);
+    lat_hist_print(stdout, prefix, "bulk-iso", &bulk_isolated->complete_hist);
+    lat_hist_print(stdout, prefix, "bulk-conc",
+            &bulk_concurrent->complete_hist);
+    lat_hist_print(stdout, prefix, "rpc-iso-call", &rpc_isolated->call_hist);
+    lat_hist_print(stdout, prefix, "rpc-conc-call",
+            &rpc_concurrent->call_hist);
+    lat_hist_print(stdout, prefix, "bulk-iso-call", &bulk_isolated->call_hist);
+    lat_hist_print(stdout, prefix, "bulk-conc-call",
+            &bulk_concurrent->call_hist);
+
+    /* cpu time of each benchmark thread, format:
+     *   <class> <protocol> <separate rpc/bulk svrs> <bulk size> <bench time>
+     *     progress <which> <mode> <spin us> <trigger batch> <user s> <sys s> */
+#define PR_PROGRESS(_loop, _label) \
+    progress_print(stdout, prefix, _label, &_loop->cpu_start, &_loop->cpu_end)
+    PR_PROGRESS(rpc_isolated, "rpc-iso");
+    PR_PROGRESS(rpc_concurrent, "rpc-conc");
+    PR_PROGRESS(bulk_isolated, "bulk-iso");
+    PR_PROGRESS(bulk_concurrent, "bulk-conc");
+#undef PR_PROGRESS
+
+    pthread_barrier_destroy(&barrier_single);
+    pthread_barrier_destroy(&barrier_concurrent);
+    free(rpc_isolated);
+    free(bulk_isolated);
+    free(rpc_concurrent);
+    free(bulk_concurrent);
+}
+
+/* thread counts visited by --thread-sweep: 0, 1, 2, 4, ... up to max
+ * (max itself included), -1 once done */
+static int next_thread_count(int n, int max)
+{
+    if (n >= max)
+        return -1;
+    n = n == 0 ? 1 : n * 2;
+    return n > max ? max : n;
+}
+
+/* generalised benchmark: nrpc rpc threads and nbulk bulk threads running
+ * concurrently for benchmark_seconds */
+static void run_threads(struct bulk_thread_args *bargs, int nrpc, int nbulk)
+{
+    int nthreads = nrpc + nbulk;
+    struct gen_thread *threads;
+    struct lat_hist rpc_hist, bulk_hist;
+    uint64_t start, end;
+    double wall, secs;
+    long rpc_ops = 0, bulk_ops = 0;
+    hg_return_t hret;
+    char prefix[256], label[64];
+    int i, rc;
+
+    threads = calloc(nthreads, sizeof(*threads));
+    assert(threads);
+
+    for (i = 0; i < nthreads; i++) {
+        struct gen_thread *t = &threads[i];
+        t->idx = i;
+        t->is_bulk = i >= nrpc;
+        if (gen_shared_ctx)
+            t->ctx = hcli.hgctx;
+        else {
+            t->ctx = HG_Context_create(hcli.hgcl);
+            assert(t->ctx != NULL);
+        }
+        if (t->is_bulk) {
+            t->loop.u.bargs = *bargs;
+            t->loop.u.bargs.bulk_ctx = t->ctx;
+        }
+        else {
+            hret = HG_Create(t->ctx, rpc_svr_addr,
+                    hcli.get_bulk_handle_rpc_id, &t->loop.u.handle);
+            assert(hret == HG_SUCCESS);
+            set_handle_target_ctx(t->loop.u.handle, rpc_svr_num_ctx,
+                    (unsigned int) getpid() + i);
+        }
+    }
+
+    /* the main thread takes part in the barrier to time the whole run */
+    rc = pthread_barrier_init(&gen_barrier, NULL, nthreads + 1);
+    assert(!rc);
+    for (i = 0; i < nthreads; i++) {
+        rc = pthread_create(&threads[i].tid, NULL, gen_thread_run,
+                &threads[i]);
+        assert(!rc);
+    }
+    rc = pthread_barrier_wait(&gen_barrier);
+    assert(rc == 0 || rc == PTHREAD_BARRIER_SERIAL_THREAD);
+    start = ticks_now();
+    for (i = 0; i < nthreads; i++) {
+        void *ret;
+        rc = pthread_join(threads[i].tid, &ret);
+        assert(!rc && ret != NULL);
+    }
+    end = ticks_now();
+    wall = ticks_to_s(end - start);
+    pthread_barrier_destroy(&gen_barrier);
+
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %d %12lu %d",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            hcli.is_separate_servers, hcli.buf_sz, benchmark_seconds);
+    report_ctx_clear();
+    report_ctx_int("separate_servers", hcli.is_separate_servers);
+    report_ctx_int("size", (long long) hcli.buf_sz);
+    report_ctx_int("seconds", benchmark_seconds);
+    report_ctx_int("rpc_threads", nrpc);
+    report_ctx_int("bulk_threads", nbulk);
+    report_ctx_int("shared_ctx", gen_shared_ctx);
+
+    /* per-thread results, format:
+     *   <class> <protocol> <separate rpc/bulk svrs> <bulk size> <bench time>
+     *     thread <#rpc thr> <#bulk thr> <idx> <rpc|bulk> <count>
+     *     <avg time call> <avg time complete> <p50> <p99> <ops/s>
+     *     <cpu> <numa node> <user s> <sys s> */
+    lat_hist_init(&rpc_hist);
+    lat_hist_init(&bulk_hist);
+    for (i = 0; i < nthreads; i++) {
+        struct cli_cb_loop *loop = &threads[i].loop;
+        if (threads[i].is_bulk) {
+            bulk_ops += loop->num_complete;
+            lat_hist_merge(&bulk_hist, &loop->complete_hist);
+        }
+        else {
+            rpc_ops += loop->num_complete;
+            lat_hist_merge(&rpc_hist, &loop->complete_hist);
+        }
+        secs = ticks_to_s(loop->end - loop->start);
+        printf("%s thread %3d %3d %3d %-4s %7d %.3e %.3e %.3e %.3e %.3e "
+                "%3d %2d %.3f %.3f\n",
+                prefix, nrpc, nbulk, i, threads[i].is_bulk ? "bulk" : "rpc",
+                loop->num_complete,
+                ticks_to_s(loop->total_ticks_call)/loop->num_complete,
+                ticks_to_s(loop->total_ticks)/loop->num_complete,
+                lat_hist_percentile(&loop->complete_hist, 50.0) / 1e9,
+                lat_hist_percentile(&loop->complete_hist, 99.0) / 1e9,
+                loop->num_complete / secs,
+                loop->cpu, loop->node,
+                loop->cpu_end.user - loop->cpu_start.user,
+                loop->cpu_end.sys - loop->cpu_start.sys);
+        report_begin("thread");
+        report_int("thread", i);
+        report_str("op", threads[i].is_bulk ? "bulk" : "rpc");
+        report_int("count", loop->num_complete);
+        report_dbl("call", ticks_to_s(loop->total_ticks_call) /
+                loop->num_complete);
+        report_dbl("complete", ticks_to_s(loop->total_ticks) /
+                loop->num_complete);
+        report_dbl("p50", lat_hist_percentile(&loop->complete_hist, 50.0)
+                / 1e9);
+        report_dbl("p99", lat_hist_percentile(&loop->complete_hist, 99.0)
+                / 1e9);
+        report_dbl("ops_per_s", loop->num_complete / secs);
+        report_int("cpu", loop->cpu);
+        report_int("node", loop->node);
+        report_dbl("user", loop->cpu_end.user - loop->cpu_start.user);
+        report_dbl("sys", loop->cpu_end.sys - loop->cpu_start.sys);
+        report_end();
+    }
+
+    /* aggregate results, format:
+     *   <class> <protocol> <separate rpc/bulk svrs> <bulk size> <bench time>
+     *     threads <#rpc thr> <#bulk thr> <shared ctx> <wall s>
+     *     <rpc ops> <rpc ops/s> <bulk ops> <bulk ops/s> */
+    printf("%s threads %3d %3d %d %.3f %8ld %.3e %8ld %.3e\n",
+            prefix, nrpc, nbulk, gen_shared_ctx, wall,
+            rpc_ops, rpc_ops / wall, bulk_ops, bulk_ops / wall);
+    report_begin("threads");
+    report_dbl("wall", wall);
+    report_int("rpc_ops", rpc_ops);
+    report_dbl("rpc_ops_per_s", rpc_ops / wall);
+    report_int("bulk_ops", bulk_ops);
+    report_dbl("bulk_ops_per_s", bulk_ops / wall);
+    report_end();
+
+    /* merged latency distributions, labelled rpc-<T>-<B> / bulk-<T>-<B> */
+    if (nrpc > 0) {
+        snprintf(label, sizeof(label), "rpc-%d-%d", nrpc, nbulk);
+        lat_hist_print(stdout, prefix, label, &rpc_hist);
+    }
+    if (nbulk > 0) {
+        snprintf(label, sizeof(label), "bulk-%d-%d", nrpc, nbulk);
+        lat_hist_print(stdout, prefix, label, &bulk_hist);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (!threads[i].is_bulk)
+            HG_Destroy(threads[i].loop.u.handle);
+        if (!gen_shared_ctx)
+            HG_Context_destroy(threads[i].ctx);
+    }
+    free(threads);
+}
+
+static void run_client(
+        size_t rdma_size,
+        char const * info_str,
+        char const * rdma_svr,
+        char const * rpc_svr)
+{
+    /* return codes, params */
+    hg_return_t hret;
+
+    /* handle etc for initial call to get bulk handle - gotta get for bulk calls */
+    hg_handle_t handle;
+    struct cli_init_cb cb_data;
+
+    /* paramters for bulk thread */
+    struct bulk_thread_args bargs;
+    char prefix[64];
+
+    /* initialize */
+    hg_init(info_str, rdma_size, HG_FALSE, 0, &hcli);
+
+    rdma_svr_addr = lookup_serv_addr(&hcli, rdma_svr);
+    assert(rdma_svr_addr != HG_ADDR_NULL);
+    rpc_svr_addr = lookup_serv_addr(&hcli, rpc_svr);
+    assert(rpc_svr_addr != HG_ADDR_NULL);
+
+    if (strcmp(rdma_svr, rpc_svr) != 0)
+        hcli.is_separate_servers = 1;
+
+    /* spread clients' (and threads') RPCs over the servers' contexts */
+    rdma_svr_num_ctx = get_server_num_ctx(&hcli, rdma_svr_addr, 20);
+    rpc_svr_num_ctx = hcli.is_separate_servers ?
+        get_server_num_ctx(&hcli, rpc_svr_addr, 20) : rdma_svr_num_ctx;
+
+    /* format: <class> <protocol> timer <tsc | clock> <ns per tick>
+     *   <overhead ns> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s",
+            hcli.class ? hcli.class : "default", hcli.transport);
+    timer_print(stdout, prefix);
+
+    /* get the bulk handle */
+    hret = HG_Create(hcli.hgctx, rdma_svr_addr,
+            hcli.get_bulk_handle_rpc_id, &handle);
+    assert(hret == HG_SUCCESS);
+    cb_data.is_finished = 0;
+    cb_data.bulk_handle = HG_BULK_NULL;
+    HG_Forward(handle, init_get_handle_cb, &cb_data, NULL);
+    hret = cli_wait_loop_all(20, 1, &cb_data);
+    assert(hret == HG_SUCCESS);
+    HG_Destroy(handle);
+
+    /* create a separate bulk context / handle for the bulk thread to iterate on */
+    bargs.bulk_remote = cb_data.bulk_handle;
+    bargs.bulk_ctx = HG_Context_create(hcli.hgcl);
+    assert(bargs.bulk_ctx != NULL);
+    hret = HG_Bulk_create(hcli.hgcl, 1, &hcli.buf, &hcli.buf_sz,
+            HG_BULK_READWRITE, &bargs.bulk_local);
+    assert(hret == HG_SUCCESS);
+
+    if (gen_rpc_threads < 0)
+        run_pair(&bargs);
+    else if (!gen_sweep)
+        run_threads(&bargs, gen_rpc_threads, gen_bulk_threads);
+    else {
+        int t, b;
+        for (t = 0; t >= 0; t = next_thread_count(t, gen_rpc_threads))
+            for (b = 0; b >= 0; b = next_thread_count(b, gen_bulk_threads))
+                if (t + b > 0)
+                    run_threads(&bargs, t, b);
+    }
+
     /* clean up */
 
     /* shutdown the servers (don't bother checking) */
@@ -420,12 +815,7 @@ static void run_client(
         HG_Destroy(handle);
     }
 
-    pthread_barrier_destroy(&barrier_single);
-    pthread_barrier_destroy(&barrier_concurrent);
-    free(rpc_isolated);
-    free(bulk_isolated);
-    free(rpc_concurrent);
-    free(bulk_concurrent);
+    HG_Bulk_free(bargs.bulk_local);
     HG_Bulk_free(cb_data.bulk_handle);
     HG_Context_destroy(bargs.bulk_ctx);
     HG_Addr_free(hcli.hgcl, rdma_svr_addr);
@@ -443,6 +833,7 @@ int main(int argc, char *argv[])
     char const * rdma_svr, * rpc_svr, * info_str;
     char const * svr_id;
     int arg = 1;
+    int rc;
 
     init_verbose();
 
@@ -466,6 +857,29 @@ int main(int argc, char *argv[])
                 arg += 2;
             }
         }
+        else if (strcmp(argv[arg], "--threads") == 0 ||
+                 strcmp(argv[arg], "--thread-sweep") == 0) {
+            if (arg+1 >= argc ||
+                    sscanf(argv[arg+1], "%d:%d", &gen_rpc_threads,
+                        &gen_bulk_threads) != 2 ||
+                    gen_rpc_threads < 0 || gen_bulk_threads < 0 ||
+                    gen_rpc_threads + gen_bulk_threads == 0) {
+                usage();
+                exit(1);
+            }
+            gen_sweep = strcmp(argv[arg], "--thread-sweep") == 0;
+            arg += 2;
+        }
+        else if (strcmp(argv[arg], "--shared-ctx") == 0) {
+            gen_shared_ctx = 1;
+            arg++;
+        }
+        else if ((rc = parse_common_opt(argc, argv, &arg)) != 0) {
+            if (rc < 0) {
+                usage();
+                exit(1);
+            }
+        }
         else
             break;
     }
@@ -518,9 +932,16 @@ int main(int argc, char *argv[])
 
 
 const char * usage_str =
-"Usage: hg-ctest2 [--all] [-t TIME] (client | server) OPTIONS\n"
+"Usage: hg-ctest2 [--all] [-t TIME] [--threads T:B | --thread-sweep T:B]\n"
+"                [--shared-ctx] (client | server) OPTIONS\n"
 "  --all prints out every measurement, rather than an average in client mode\n"
 "  -t is the time to run the benchmark in client mode\n"
+"  --threads runs T rpc threads and B bulk threads concurrently instead of\n"
+"    the single rpc/bulk thread pair, each thread with its own context\n"
+"  --thread-sweep runs every combination of 0,1,2,4,...,T rpc threads and\n"
+"    0,1,2,4,...,B bulk threads\n"
+"  --shared-ctx makes all --threads/--thread-sweep threads share the client\n"
+"    context\n"
 "  in client mode, OPTIONS are:\n"
 "    <rdma size> <class+protocol> <rdma server> <rpc server>\n"
 "  in server mode, OPTIONS are:\n"
@@ -533,6 +954,7 @@ const char * usage_str =
 "      $(cat ctest-server-addr.tmp-foo) $(cat ctest-server-addr.tmp-foo)\n";
 
 static void usage() {
-    fprintf(stderr, usage_str);
+    fprintf(stderr, "%s", usage_str);
+    print_common_usage(stderr);
 }
 
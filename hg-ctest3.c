@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <mercury.h>
 #include <mercury_bulk.h>
@@ -38,6 +39,8 @@ static struct hg_comm_info nhcli;
 /* servers (need to be global for now) */
 hg_addr_t rdma_svr_addr = HG_ADDR_NULL;
 hg_addr_t rpc_svr_addr = HG_ADDR_NULL;
+/* contexts the rpc server spreads RPCs over (--server-threads) */
+static unsigned int rpc_svr_num_ctx = 1;
 
 /* gets passed throughout benchmark */
 struct cli_cb_data {
@@ -47,8 +50,9 @@ struct cli_cb_data {
     union {
         struct {
             int num_complete;
-            struct timespec start_call;
-            double total_time, total_time_call;
+            uint64_t start_call; /* ticks */
+            uint64_t total_ticks, total_ticks_call;
+            struct lat_hist call_hist, complete_hist;
         } times;
         int is_finished;
     } u;
@@ -59,19 +63,19 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info);
 /* call an iteration of the rpc bench */
 static hg_return_t call_next_rpc(
         struct cli_cb_data *c,
-        struct timespec *start)
+        uint64_t *start)
 {
     hg_return_t hret;
-    struct timespec t;
+    uint64_t t;
 
     dprintf("calling next rpc\n");
-    clock_gettime(CLOCK_MONOTONIC, &c->u.times.start_call);
+    c->u.times.start_call = ticks_now();
     hret = HG_Forward(c->handle, get_bulk_handle_cli_cb, c, NULL);
     if (hret == HG_SUCCESS) {
         op_cnt++;
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        c->u.times.total_time_call +=
-            time_to_s_lf(timediff(c->u.times.start_call, t));
+        t = ticks_now() - c->u.times.start_call;
+        c->u.times.total_ticks_call += t;
+        lat_hist_record_ticks(&c->u.times.call_hist, t);
         if (start) *start = c->u.times.start_call;
     }
     return hret;
@@ -82,7 +86,7 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
     get_bulk_handle_out_t out;
     struct cli_cb_data *cb_dat;
     hg_return_t hret;
-    struct timespec t;
+    uint64_t t;
 
     dprintf("rpc callback entered\n");
 
@@ -100,10 +104,10 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
     }
     else {
         op_cnt--;
-        clock_gettime(CLOCK_MONOTONIC, &t);
+        t = ticks_now() - cb_dat->u.times.start_call;
         cb_dat->u.times.num_complete++;
-        cb_dat->u.times.total_time +=
-            time_to_s_lf(timediff(cb_dat->u.times.start_call, t));
+        cb_dat->u.times.total_ticks += t;
+        lat_hist_record_ticks(&cb_dat->u.times.complete_hist, t);
         if (!is_finished){
             hret = call_next_rpc(cb_dat, NULL);
             assert(hret == HG_SUCCESS);
@@ -116,21 +120,21 @@ static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info);
 
 static hg_return_t call_next_bulk(
         struct cli_cb_data *c,
-        struct timespec *start)
+        uint64_t *start)
 {
-    struct timespec t;
+    uint64_t t;
     hg_return_t hret;
 
     dprintf("calling next bulk\n");
-    clock_gettime(CLOCK_MONOTONIC, &c->u.times.start_call);
+    c->u.times.start_call = ticks_now();
     hret = HG_Bulk_transfer(nhcli.hgctx, cli_bulk_xfer_cb, c, HG_BULK_PUSH,
             rdma_svr_addr, c->bulk, 0, nhcli.bh, 0, nhcli.buf_sz,
             HG_OP_ID_IGNORE);
     if (hret == HG_SUCCESS) {
         op_cnt++;
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        c->u.times.total_time_call +=
-            time_to_s_lf(timediff(c->u.times.start_call, t));
+        t = ticks_now() - c->u.times.start_call;
+        c->u.times.total_ticks_call += t;
+        lat_hist_record_ticks(&c->u.times.call_hist, t);
         if (start) *start = c->u.times.start_call;
     }
     return hret;
@@ -139,17 +143,17 @@ static hg_return_t call_next_bulk(
 static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info)
 {
     struct cli_cb_data * cb_dat = info->arg;
-    struct timespec t;
+    uint64_t t;
     hg_return_t hret;
 
     assert(info->ret == HG_SUCCESS);
     assert(!cb_dat->is_init);
     dprintf("bulk callback entered\n");
 
-    clock_gettime(CLOCK_MONOTONIC, &t);
+    t = ticks_now() - cb_dat->u.times.start_call;
     cb_dat->u.times.num_complete++;
-    cb_dat->u.times.total_time +=
-        time_to_s_lf(timediff(cb_dat->u.times.start_call, t));
+    cb_dat->u.times.total_ticks += t;
+    lat_hist_record_ticks(&cb_dat->u.times.complete_hist, t);
     op_cnt--;
     if (!is_finished) {
         hret = call_next_bulk(cb_dat, NULL);
@@ -159,11 +163,9 @@ static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info)
     return HG_SUCCESS;
 }
 
-static hg_return_t cli_wait_timed(struct timespec start)
+static hg_return_t cli_wait_timed(uint64_t start)
 {
     hg_return_t hret = HG_SUCCESS;
-    unsigned int num_cb;
-    struct timespec t;
     /* wait a bit of time for processes to wind down */
     int time_cond = 1;
 
@@ -171,18 +173,15 @@ static hg_return_t cli_wait_timed(struct timespec start)
 
     while (time_cond || op_cnt > 0) {
         if (!time_cond) { is_finished = 1; dprintf("time over\n"); }
-        do {
-            hret = HG_Trigger(nhcli.hgctx, 0, 1, &num_cb);
-        } while(hret == HG_SUCCESS && num_cb);
-        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+        hret = trigger_ready(nhcli.hgctx, NULL);
+        if (hret != HG_SUCCESS)
             break;
 
-        hret = HG_Progress(nhcli.hgctx, 100);
+        hret = progress_wait(nhcli.hgctx, 100);
         if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
             break;
 
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        time_cond = (time_to_s_lf(timediff(start,t)) <= benchmark_seconds);
+        time_cond = (ticks_to_s(ticks_now() - start) <= benchmark_seconds);
     }
 
     if (hret == HG_TIMEOUT) hret = HG_SUCCESS;
@@ -243,7 +242,10 @@ static void run_client(
     hg_return_t hret;
 
     /* benchmark times */
-    struct timespec start_time;
+    uint64_t start_time;
+    char prefix[256];
+    int cpu, node;
+    struct cpu_time cpu_start, cpu_end;
 
     /* initialize */
     hg_init(info_str, rdma_size, HG_FALSE, 0, &nhcli);
@@ -257,10 +259,21 @@ static void run_client(
     if (strcmp(rdma_svr, rpc_svr) != 0)
         nhcli.is_separate_servers = 1;
 
+    /* spread clients' RPCs over the rpc server's contexts */
+    rpc_svr_num_ctx = get_server_num_ctx(&nhcli, rpc_svr_addr, 20);
+
     memset(&bulk_isolated, 0, sizeof(bulk_isolated));
     memset(&rpc_isolated, 0, sizeof(rpc_isolated));
     memset(&bulk_concurrent, 0, sizeof(bulk_concurrent));
     memset(&rpc_concurrent, 0, sizeof(rpc_concurrent));
+    lat_hist_init(&bulk_isolated.u.times.call_hist);
+    lat_hist_init(&bulk_isolated.u.times.complete_hist);
+    lat_hist_init(&rpc_isolated.u.times.call_hist);
+    lat_hist_init(&rpc_isolated.u.times.complete_hist);
+    lat_hist_init(&bulk_concurrent.u.times.call_hist);
+    lat_hist_init(&bulk_concurrent.u.times.complete_hist);
+    lat_hist_init(&rpc_concurrent.u.times.call_hist);
+    lat_hist_init(&rpc_concurrent.u.times.complete_hist);
 
     /* create, run RPC to grab bulk handle from rdma server */
 
@@ -285,10 +298,14 @@ static void run_client(
     hret = HG_Create(nhcli.hgctx, rpc_svr_addr,
             nhcli.get_bulk_handle_rpc_id, &rpc_isolated.handle);
     assert(hret == HG_SUCCESS);
+    set_handle_target_ctx(rpc_isolated.handle, rpc_svr_num_ctx,
+            (unsigned int) getpid());
     rpc_concurrent.handle = rpc_isolated.handle;
 
     is_finished = 0;
 
+    get_cpu_time(0, &cpu_start);
+
     /* first up, time rpcs / bulks in isolation */
     hret = call_next_rpc(&rpc_isolated, &start_time);
     assert(hret == HG_SUCCESS);
@@ -309,6 +326,8 @@ static void run_client(
     hret = cli_wait_timed(start_time);
     assert(hret == HG_SUCCESS);
 
+    get_cpu_time(0, &cpu_end);
+
     /* shutdown the servers (don't bother checking) */
     hret = HG_Create(nhcli.hgctx, rdma_svr_addr,
             nhcli.shutdown_server_rpc_id, &handle);
@@ -333,22 +352,74 @@ static void run_client(
      *     rpc  concurrent <count> <avg time call> <avg time complete>
      *     bulk isolated   <count> <avg time call> <avg time complete>
      *     bulk concurrent <count> <avg time call> <avg time complete>
+     *     <cpu> <numa node>
      */
 #define PR_STAT(_cb) \
     _cb.u.times.num_complete, \
-    _cb.u.times.total_time_call/_cb.u.times.num_complete, \
-    _cb.u.times.total_time/_cb.u.times.num_complete
+    ticks_to_s(_cb.u.times.total_ticks_call)/_cb.u.times.num_complete, \
+    ticks_to_s(_cb.u.times.total_ticks)/_cb.u.times.num_complete
 
+    get_placement(&cpu, &node);
     printf( "%-8s %-8s %d %12lu %d "
             "%7d %.3e %.3e %7d %.3e %.3e "
-            "%7d %.3e %.3e %7d %.3e %.3e\n",
+            "%7d %.3e %.3e %7d %.3e %.3e %3d %2d\n",
             nhcli.class ? nhcli.class : "default", nhcli.transport,
             nhcli.is_separate_servers, nhcli.buf_sz, benchmark_seconds,
             PR_STAT(rpc_isolated), PR_STAT(rpc_concurrent),
-            PR_STAT(bulk_isolated), PR_STAT(bulk_concurrent));
+            PR_STAT(bulk_isolated), PR_STAT(bulk_concurrent), cpu, node);
 
 #undef PR_STAT
 
+    report_ctx_clear();
+    report_ctx_int("separate_servers", nhcli.is_separate_servers);
+    report_ctx_int("size", (long long) nhcli.buf_sz);
+    report_ctx_int("seconds", benchmark_seconds);
+#define REPORT_STAT(_cb, _name) \
+    do { \
+        report_int(_name "_count", _cb.u.times.num_complete); \
+        report_dbl(_name "_call", ticks_to_s(_cb.u.times.total_ticks_call) / \
+                _cb.u.times.num_complete); \
+        report_dbl(_name "_complete", ticks_to_s(_cb.u.times.total_ticks) / \
+                _cb.u.times.num_complete); \
+    } while (0)
+    report_begin("result");
+    REPORT_STAT(rpc_isolated, "rpc_iso");
+    REPORT_STAT(rpc_concurrent, "rpc_conc");
+    REPORT_STAT(bulk_isolated, "bulk_iso");
+    REPORT_STAT(bulk_concurrent, "bulk_conc");
+    report_int("cpu", cpu);
+    report_int("node", node);
+    report_end();
+#undef REPORT_STAT
+
+    /* latency distributions, format:
+     *   <class> <protocol> <separate rpc/bulk svrs> <bulk size> <bench time>
+     *     lat <which> <count> <p50> <p90> <p99> <p99.9> <max> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %d %12lu %d",
+            nhcli.class ? nhcli.class : "default", nhcli.transport,
+            nhcli.is_separate_servers, nhcli.buf_sz, benchmark_seconds);
+    lat_hist_print(stdout, prefix, "rpc-iso",
+            &rpc_isolated.u.times.complete_hist);
+    lat_hist_print(stdout, prefix, "rpc-conc",
+            &rpc_concurrent.u.times.complete_hist);
+    lat_hist_print(stdout, prefix, "bulk-iso",
+            &bulk_isolated.u.times.complete_hist);
+    lat_hist_print(stdout, prefix, "bulk-conc",
+            &bulk_concurrent.u.times.complete_hist);
+    lat_hist_print(stdout, prefix, "rpc-iso-call",
+            &rpc_isolated.u.times.call_hist);
+    lat_hist_print(stdout, prefix, "rpc-conc-call",
+            &rpc_concurrent.u.times.call_hist);
+    lat_hist_print(stdout, prefix, "bulk-iso-call",
+            &bulk_isolated.u.times.call_hist);
+    lat_hist_print(stdout, prefix, "bulk-conc-call",
+            &bulk_concurrent.u.times.call_hist);
+    /* format: ... progress all <mode> <spin us> <trigger batch>
+     *   <user cpu s> <sys cpu s> (over all three phases) */
+    progress_print(stdout, prefix, "all", &cpu_start, &cpu_end);
+    /* format: ... timer <tsc | clock> <ns per tick> <overhead ns> */
+    timer_print(stdout, prefix);
+
     HG_Destroy(rpc_isolated.handle);
     HG_Bulk_free(bulk_isolated.bulk);
     HG_Addr_free(nhcli.hgcl, rdma_svr_addr);
@@ -366,6 +437,7 @@ int main(int argc, char *argv[])
     char const * rdma_svr, * rpc_svr, * info_str;
     char const * svr_id;
     int arg = 1;
+    int rc;
 
     init_verbose();
 
@@ -389,6 +461,12 @@ int main(int argc, char *argv[])
                 arg += 2;
             }
         }
+        else if ((rc = parse_common_opt(argc, argv, &arg)) != 0) {
+            if (rc < 0) {
+                usage();
+                exit(1);
+            }
+        }
         else
             break;
     }
@@ -456,6 +534,7 @@ const char * usage_str =
 "      $(cat ctest-server-addr.tmp-foo) $(cat ctest-server-addr.tmp-foo)\n";
 
 static void usage() {
-    fprintf(stderr, usage_str);
+    fprintf(stderr, "%s", usage_str);
+    print_common_usage(stderr);
 }
 
@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <time.h>
 #include <ctype.h>
+#include <math.h>
 
 #include <mercury.h>
 #include <mercury_bulk.h>
@@ -23,6 +24,18 @@
 
 static int benchmark_seconds = 10;
 
+/* number of operations kept in flight per client (-w option) */
+static int window_depth = 1;
+
+/* logical clients (-L option): the process drives num_logical clients over
+ * its one class and context, each with its own window of slots (handles,
+ * server bulk handle, exposed region) and statistics. Slot s belongs to
+ * logical client s / window_depth, whose id is
+ * bench_client_id * num_logical + s / window_depth */
+static int num_logical = 1;
+static int num_slots;
+static struct lat_hist *logical_hist;
+
 /* checked by callbacks, set by progress/trigger loop */
 static int is_finished = 0;
 
@@ -37,43 +50,281 @@ static struct hg_comm_info hcli;
 /* global id for client process */
 static int bench_client_id = -1;
 
-/* servers (need to be global for now) */
+/* number of client processes, as the servers were started with (from their
+ * get_bulk_handle replies) */
+static int num_bench_clients = 1;
+
+/* servers (need to be global for now) - svr_addr is the first, which
+ * also runs the barrier */
 hg_addr_t svr_addr = HG_ADDR_NULL;
 
+/* sharded runs (several servers on the command line): each op goes to the
+ * server key_dist picks (--dist / --keys options), and completions are
+ * also broken down by server */
+static hg_addr_t *svr_addrs;
+static int num_servers = 1;
+/* contexts each server spreads RPCs over (from its get_bulk_handle reply) */
+static unsigned int *svr_num_ctx;
+static struct key_dist key_dist = { KEY_DIST_RR, 0.0, 0, 0, {0, 0, 0},
+                                    0.0, 0.0, 0.0 };
+static uint64_t num_keys = 1000000;
+/* the benchmark's RPC, for retargeting handles */
+static hg_id_t bench_rpc_id;
+struct shard_stats {
+    unsigned long num_complete;
+    uint64_t total_ticks;
+    struct lat_hist hist;
+};
+static struct shard_stats *shards;
+
 enum cli_mode_t {
     RPC_MODE = 20,
     BULK_MODE,
-    RPCBULK_MODE
+    RPCBULK_MODE,
+    RPCDATA_MODE
+};
+
+static char const * const mode_names[] = {
+    "rpc", "bulk", "rpcbulk", "rpcdata"
 };
 
 static enum cli_mode_t cli_mode;
 
-/* individual call/complete times */
-struct cli_times {
-    double call;
-    double complete;
+/* rpcdata mode: request payload is the current size, response payload is
+ * rpc_out_size bytes (-o option, default: same as the request) */
+static long rpc_out_size = -1;
+
+/* in-process size sweep (--sizes / -S options): one buffer of the largest
+ * size is registered up front and each point runs within the same session,
+ * clients syncing through check_in between points. cur_size is the bulk
+ * size / rpc payload of the point being run */
+static struct size_range sizes;
+static int size_sweep = 0;
+static size_t cur_size;
+
+/* latency distributions of the async call and the full op, shared by all
+ * window slots */
+static struct lat_hist call_hist, complete_hist;
+
+/* open-loop mode (-r option): ops are issued on a fixed schedule at
+ * open_loop_rate ops/s rather than from the previous op's callback. Window
+ * slots not currently in flight sit on the free list; ops that come due
+ * while the list is empty wait for a slot, and that wait is charged to the
+ * corrected latency (measured from the scheduled rather than actual issue
+ * time). Ops still waiting when the run ends are recorded as dropped, with
+ * the time they waited until then */
+static double open_loop_rate = 0.0;
+static int open_loop_poisson = 0;
+static unsigned short open_loop_seed[3];
+static uint64_t open_loop_next_ns;
+static struct cli_cb_data **open_loop_free;
+static int open_loop_num_free;
+static struct lat_hist corrected_hist;
+static unsigned long open_loop_dropped;
+
+/* per-op trace, streamed to disk (-a / -T options) */
+static struct op_trace *trace = NULL;
+static char const * trace_fname = NULL;
+static int print_all_times = 0;
+
+/* chunked bulk mode (-c / -k options): each op's buffer is pushed as a
+ * pipeline of chunk_size transfers, up to chunks_in_flight at a time per
+ * window slot. The op completes when its last chunk does */
+static hg_size_t chunk_size = 0;
+static int chunks_in_flight = 1;
+static struct lat_hist chunk_hist;
+static unsigned long num_chunks = 0;
+static unsigned long chunk_bytes = 0;
+static uint64_t chunk_ticks = 0;
+
+/* tree barrier (--tree-barrier option): clients sync through a fanout-ary
+ * tree of themselves rather than the server's check_in (0 -> check_in).
+ * Either way each client notes when the start-of-point barrier released
+ * it, and client 0 reports the spread */
+static int tree_fanout = 0;
+
+struct cli_cb_data;
+
+/* a single chunk transfer of an op */
+struct chunk_op {
+    struct cli_cb_data *op;
+    uint64_t start;
+    hg_size_t len;
+    struct chunk_op *next;
 };
 
-/* for "all" option - array of times */
-static struct cli_times * all_times = NULL; 
-static int time_idx = 0;
-
 /* gets passed throughout benchmark */
 struct cli_cb_data {
     hg_handle_t handle;
     hg_bulk_t svr_bulk; // for BULK_MODE
     bulk_read_in_t cli_bulk_in; // for RPCBULK_MODE
+    sized_rpc_in_t rpc_in; // for RPCDATA_MODE
     int is_init;
+    int slot; /* index in the window */
+    int lc; /* logical client the slot belongs to */
+    int srv; /* server of the op in flight */
+    hg_bulk_t *svr_bulks; /* BULK_MODE: per server, svr_bulk is current */
+    uint64_t intended_ns; /* open-loop: scheduled issue time */
+    uint64_t call_ns; /* async call time of the op in flight, for tracing */
+    hg_size_t next_off; /* chunked bulk: next offset to push */
+    int chunks_pending; /* chunked bulk: chunk transfers in flight */
+    struct chunk_op *free_chunks; /* chunked bulk: idle chunk descriptors */
     union {
         struct {
             int num_complete;
-            struct timespec start_call;
-            double total_time, total_time_call;
+            uint64_t start_call; /* ticks */
+            uint64_t total_ticks, total_ticks_call;
         } times;
         int is_finished;
     } u;
 };
 
+/* ticks_now() when the trace was opened */
+static uint64_t trace_epoch_ticks;
+
+/* --converge: completions of the point being run feed conv, its
+ * accounting restarting when warmup ends, and the point stops once conv
+ * is tight (conv_done) */
+static struct converge conv;
+static int conv_done;
+static struct cli_cb_data *cur_slots;
+/* the measured part of the point (after warmup, in converge mode) */
+static uint64_t measure_start, measure_end;
+
+static void shards_reset(void)
+{
+    int i;
+
+    for (i = 0; num_servers > 1 && i < num_servers; i++) {
+        shards[i].num_complete = 0;
+        shards[i].total_ticks = 0;
+        lat_hist_init(&shards[i].hist);
+    }
+}
+
+/* a completion in a sharded run */
+static inline void shard_record(struct cli_cb_data *c, uint64_t d)
+{
+    struct shard_stats *sh = &shards[c->srv];
+
+    sh->num_complete++;
+    sh->total_ticks += d;
+    lat_hist_record_ticks(&sh->hist, d);
+}
+
+/* sharded runs: send the next op to the server its key maps to,
+ * retargeting the slot if that's a different one than last time */
+static inline void pick_server(struct cli_cb_data *c)
+{
+    hg_return_t hret;
+    int srv;
+
+    if (num_servers == 1)
+        return;
+    srv = key_dist_next(&key_dist, num_servers);
+    if (srv == c->srv)
+        return;
+    c->srv = srv;
+    if (cli_mode == BULK_MODE)
+        c->svr_bulk = c->svr_bulks[srv];
+    else {
+        hret = HG_Reset(c->handle, svr_addrs[srv], bench_rpc_id);
+        assert(hret == HG_SUCCESS);
+        set_handle_target_ctx(c->handle, svr_num_ctx[srv],
+                (unsigned int) (bench_client_id * num_slots + c->slot));
+    }
+}
+
+/* drop everything recorded so far for the point */
+static void measure_reset(uint64_t now)
+{
+    int s;
+
+    for (s = 0; s < num_slots; s++) {
+        cur_slots[s].u.times.num_complete = 0;
+        cur_slots[s].u.times.total_ticks = 0;
+        cur_slots[s].u.times.total_ticks_call = 0;
+    }
+    lat_hist_init(&call_hist);
+    lat_hist_init(&complete_hist);
+    lat_hist_init(&corrected_hist);
+    lat_hist_init(&chunk_hist);
+    for (s = 0; num_logical > 1 && s < num_logical; s++)
+        lat_hist_init(&logical_hist[s]);
+    shards_reset();
+    num_chunks = chunk_bytes = 0;
+    chunk_ticks = 0;
+    measure_start = now;
+}
+
+/* feed a completed op's latency to the convergence tracker */
+static inline void converge_op(uint64_t d)
+{
+    double v;
+
+    if (!converge_enabled() || conv_done)
+        return;
+    v = ticks_to_s(d);
+    if (!conv.steady) {
+        if (converge_warm(&conv, v))
+            measure_reset(ticks_now());
+    }
+    else if (converge_add(&conv, v))
+        conv_done = 1;
+}
+
+/* stream out a completed op (complete = ticks from call to callback) */
+static inline void trace_op(struct cli_cb_data *c, uint64_t complete)
+{
+    op_trace_append(trace,
+            ticks_to_ns(c->u.times.start_call - trace_epoch_ticks),
+            c->call_ns, ticks_to_ns(complete), (uint32_t) c->slot);
+}
+
+/* -a output: one line per op, read back from the trace */
+static void print_trace_rec(
+        const struct op_trace_hdr *h,
+        const struct op_trace_rec *r,
+        void *arg)
+{
+    (void)h;
+    printf("%s %.3e %.3e\n", (char const *) arg,
+            r->call_ns / 1e9, r->complete_ns / 1e9);
+}
+
+/* open-loop: advance the schedule by one inter-arrival time */
+static void open_loop_advance(void)
+{
+    /* each logical client offers the rate, their merged schedule being
+     * num_logical times as dense (still Poisson with -p) */
+    double gap = 1.0 / (open_loop_rate * num_logical);
+    if (open_loop_poisson)
+        gap = -log(1.0 - erand48(open_loop_seed)) * gap;
+    open_loop_next_ns += (uint64_t) (gap * 1e9);
+}
+
+/* open-loop completion: record latency against the schedule and give the
+ * slot back */
+static void open_loop_complete(struct cli_cb_data *c, uint64_t now)
+{
+    lat_hist_record(&corrected_hist, ticks_to_ns(now) - c->intended_ns);
+    open_loop_free[open_loop_num_free++] = c;
+}
+
+/* open-loop: the run is over - ops that came due but never got a slot
+ * would have waited at least until now, so record that (a lower bound) as
+ * their corrected latency rather than leaving them out */
+static void open_loop_drop(uint64_t end)
+{
+    uint64_t end_ns = ticks_to_ns(end);
+
+    while (open_loop_next_ns <= end_ns) {
+        lat_hist_record(&corrected_hist, end_ns - open_loop_next_ns);
+        open_loop_dropped++;
+        open_loop_advance();
+    }
+}
+
 static hg_return_t cli_sync_cb(const struct hg_cb_info *info)
 {
     dprintf("cli recv sync cb: arg:%p\n", info->arg);
@@ -89,20 +340,24 @@ static hg_return_t rpc_cli_cb(const struct hg_cb_info *info);
 /* call an iteration of the rpc bench */
 static hg_return_t call_next_rpc(
         struct cli_cb_data *c,
-        struct timespec *start)
+        uint64_t *start)
 {
     hg_return_t hret;
-    struct timespec t;
+    uint64_t d;
 
     dprintf("calling next rpc\n");
-    clock_gettime(CLOCK_MONOTONIC, &c->u.times.start_call);
-    hret = HG_Forward(c->handle, rpc_cli_cb, c, &c->cli_bulk_in);
+    pick_server(c);
+    c->u.times.start_call = ticks_now();
+    trace_event(EV_FORWARD, c->slot);
+    hret = HG_Forward(c->handle, rpc_cli_cb, c,
+            cli_mode == RPCDATA_MODE ? (void*) &c->rpc_in
+                                     : (void*) &c->cli_bulk_in);
     if (hret == HG_SUCCESS) {
         op_cnt++;
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        double tlf = time_to_s_lf(timediff(c->u.times.start_call, t));
-        c->u.times.total_time_call += tlf;
-        if (all_times!=NULL) all_times[time_idx].call = tlf;
+        d = ticks_now() - c->u.times.start_call;
+        lat_hist_record_ticks(&call_hist, d);
+        c->u.times.total_ticks_call += d;
+        if (trace) c->call_ns = ticks_to_ns(d);
         if (start) *start = c->u.times.start_call;
     }
     return hret;
@@ -112,17 +367,33 @@ static hg_return_t rpc_cli_cb(const struct hg_cb_info *info)
 {
     hg_return_t hret;
     struct cli_cb_data *cb_dat = (struct cli_cb_data*) info->arg;
-    double tlf;
-    struct timespec t;
+    uint64_t t, d;
+    sized_rpc_out_t out;
 
+    trace_event(EV_CALLBACK, cb_dat->slot);
     op_cnt--;
 
-    clock_gettime(CLOCK_MONOTONIC, &t);
+    /* decoding the response payload is part of the op */
+    if (cli_mode == RPCDATA_MODE) {
+        hret = HG_Get_output(info->info.forward.handle, &out);
+        assert(hret == HG_SUCCESS);
+        HG_Free_output(info->info.forward.handle, &out);
+    }
+
+    t = ticks_now();
     cb_dat->u.times.num_complete++;
-    tlf = time_to_s_lf(timediff(cb_dat->u.times.start_call, t));
-    cb_dat->u.times.total_time += tlf;
-    if (all_times!=NULL) all_times[time_idx++].complete = tlf;
-    if (!is_finished){
+    d = t - cb_dat->u.times.start_call;
+    lat_hist_record_ticks(&complete_hist, d);
+    if (num_logical > 1)
+        lat_hist_record_ticks(&logical_hist[cb_dat->lc], d);
+    if (num_servers > 1)
+        shard_record(cb_dat, d);
+    cb_dat->u.times.total_ticks += d;
+    if (trace) trace_op(cb_dat, d);
+    converge_op(d);
+    if (open_loop_rate > 0.0)
+        open_loop_complete(cb_dat, t);
+    else if (!is_finished){
         hret = call_next_rpc(cb_dat, NULL);
         assert(hret == HG_SUCCESS);
     }
@@ -135,7 +406,7 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
     get_bulk_handle_out_t out;
     struct cli_cb_data *cb_dat;
     hg_return_t hret;
-    struct timespec t;
+    uint64_t t, d;
 
     dprintf("rpc callback entered\n");
 
@@ -147,18 +418,30 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
         if (cb_dat) {
             /* sadly, have to copyout the bulk handle, which is awkward */
             cb_dat->svr_bulk = dup_hg_bulk(hcli.hgcl, out.bh);
+            svr_num_ctx[cb_dat->srv] = out.num_ctx;
+            if ((int) out.num_clients > num_bench_clients)
+                num_bench_clients = (int) out.num_clients;
             cb_dat->u.is_finished = 1;
         }
         HG_Free_output(info->info.forward.handle, &out);
     }
     else {
+        trace_event(EV_CALLBACK, cb_dat->slot);
         op_cnt--;
-        clock_gettime(CLOCK_MONOTONIC, &t);
+        t = ticks_now();
         cb_dat->u.times.num_complete++;
-        double tlf = time_to_s_lf(timediff(cb_dat->u.times.start_call, t));
-        cb_dat->u.times.total_time += tlf;
-        if (all_times!=NULL) all_times[time_idx++].complete = tlf;
-        if (!is_finished){
+        d = t - cb_dat->u.times.start_call;
+        lat_hist_record_ticks(&complete_hist, d);
+        if (num_logical > 1)
+            lat_hist_record_ticks(&logical_hist[cb_dat->lc], d);
+        if (num_servers > 1)
+            shard_record(cb_dat, d);
+        cb_dat->u.times.total_ticks += d;
+        if (trace) trace_op(cb_dat, d);
+        converge_op(d);
+        if (open_loop_rate > 0.0)
+            open_loop_complete(cb_dat, t);
+        else if (!is_finished){
             hret = call_next_rpc(cb_dat, NULL);
             assert(hret == HG_SUCCESS);
         }
@@ -167,61 +450,170 @@ static hg_return_t get_bulk_handle_cli_cb(const struct hg_cb_info *info)
 }
 
 static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info);
+static hg_return_t cli_chunk_xfer_cb(const struct hg_cb_info *info);
+
+/* post chunks of the current op until the buffer or the slot's chunk
+ * descriptors run out */
+static hg_return_t issue_chunks(struct cli_cb_data *c)
+{
+    hg_return_t hret = HG_SUCCESS;
+    struct chunk_op *k;
+
+    while (c->free_chunks != NULL && c->next_off < cur_size) {
+        k = c->free_chunks;
+        k->len = cur_size - c->next_off;
+        if (k->len > chunk_size)
+            k->len = chunk_size;
+        k->start = ticks_now();
+        trace_event(EV_BULK, c->slot);
+        hret = HG_Bulk_transfer(hcli.hgctx, cli_chunk_xfer_cb, k,
+                HG_BULK_PUSH, svr_addrs[c->srv], c->svr_bulk, c->next_off,
+                hcli.bh,
+                c->next_off, k->len, HG_OP_ID_IGNORE);
+        if (hret != HG_SUCCESS)
+            break;
+        c->free_chunks = k->next;
+        c->next_off += k->len;
+        c->chunks_pending++;
+    }
+    return hret;
+}
 
 static hg_return_t call_next_bulk(
         struct cli_cb_data *c,
-        struct timespec *start)
+        uint64_t *start)
 {
-    struct timespec t;
+    uint64_t d;
     hg_return_t hret;
 
     dprintf("calling next bulk\n");
-    clock_gettime(CLOCK_MONOTONIC, &c->u.times.start_call);
-    hret = HG_Bulk_transfer(hcli.hgctx, cli_bulk_xfer_cb, c, HG_BULK_PUSH,
-            svr_addr, c->svr_bulk, 0, hcli.bh, 0, hcli.buf_sz,
-            HG_OP_ID_IGNORE);
+    pick_server(c);
+    c->u.times.start_call = ticks_now();
+    if (chunk_size > 0 && cur_size > chunk_size) {
+        c->next_off = 0;
+        hret = issue_chunks(c);
+    }
+    else {
+        trace_event(EV_BULK, c->slot);
+        hret = HG_Bulk_transfer(hcli.hgctx, cli_bulk_xfer_cb, c,
+                HG_BULK_PUSH, svr_addrs[c->srv], c->svr_bulk, 0, hcli.bh, 0,
+                cur_size, HG_OP_ID_IGNORE);
+    }
     if (hret == HG_SUCCESS) {
         op_cnt++;
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        double tlf = time_to_s_lf(timediff(c->u.times.start_call, t));
-        c->u.times.total_time_call += tlf;
-        if (all_times!=NULL) all_times[time_idx].call = tlf;
+        d = ticks_now() - c->u.times.start_call;
+        lat_hist_record_ticks(&call_hist, d);
+        c->u.times.total_ticks_call += d;
+        if (trace) c->call_ns = ticks_to_ns(d);
         if (start) *start = c->u.times.start_call;
     }
     return hret;
 }
 
+/* a whole bulk op (all of its chunks, if chunked) has completed */
+static void bulk_op_done(struct cli_cb_data *cb_dat, uint64_t t)
+{
+    hg_return_t hret;
+    uint64_t d;
+
+    cb_dat->u.times.num_complete++;
+    d = t - cb_dat->u.times.start_call;
+    lat_hist_record_ticks(&complete_hist, d);
+    if (num_logical > 1)
+        lat_hist_record_ticks(&logical_hist[cb_dat->lc], d);
+    if (num_servers > 1)
+        shard_record(cb_dat, d);
+    cb_dat->u.times.total_ticks += d;
+    if (trace) trace_op(cb_dat, d);
+    converge_op(d);
+    op_cnt--;
+    if (open_loop_rate > 0.0)
+        open_loop_complete(cb_dat, t);
+    else if (!is_finished) {
+        hret = call_next_bulk(cb_dat, NULL);
+        assert(hret == HG_SUCCESS);
+    }
+}
+
 static hg_return_t cli_bulk_xfer_cb(const struct hg_cb_info *info)
 {
     struct cli_cb_data * cb_dat = info->arg;
-    struct timespec t;
-    hg_return_t hret;
 
     assert(info->ret == HG_SUCCESS);
     assert(!cb_dat->is_init);
     dprintf("bulk callback entered\n");
+    trace_event(EV_CALLBACK, cb_dat->slot);
 
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    cb_dat->u.times.num_complete++;
-    double tlf = time_to_s_lf(timediff(cb_dat->u.times.start_call, t));
-    cb_dat->u.times.total_time += tlf;
-    if (all_times!=NULL) all_times[time_idx++].complete = tlf;
-    op_cnt--;
-    if (!is_finished) {
-        hret = call_next_bulk(cb_dat, NULL);
+    bulk_op_done(cb_dat, ticks_now());
+
+    return HG_SUCCESS;
+}
+
+static hg_return_t cli_chunk_xfer_cb(const struct hg_cb_info *info)
+{
+    struct chunk_op *k = info->arg;
+    struct cli_cb_data *cb_dat = k->op;
+    uint64_t t, d;
+    hg_return_t hret;
+
+    assert(info->ret == HG_SUCCESS);
+    dprintf("chunk callback entered\n");
+    trace_event(EV_CALLBACK, cb_dat->slot);
+
+    t = ticks_now();
+    d = t - k->start;
+    lat_hist_record_ticks(&chunk_hist, d);
+    chunk_ticks += d;
+    chunk_bytes += k->len;
+    num_chunks++;
+
+    cb_dat->chunks_pending--;
+    k->next = cb_dat->free_chunks;
+    cb_dat->free_chunks = k;
+
+    if (cb_dat->next_off < cur_size) {
+        hret = issue_chunks(cb_dat);
         assert(hret == HG_SUCCESS);
     }
+    else if (cb_dat->chunks_pending == 0)
+        bulk_op_done(cb_dat, t);
 
     return HG_SUCCESS;
 }
 
-static hg_return_t cli_wait_timed(struct timespec start)
+/* open-loop: issue every op that is due and has a free slot, returning the
+ * progress timeout (ms) until the next one comes due */
+static unsigned int open_loop_issue(uint64_t now)
+{
+    uint64_t now_ns = ticks_to_ns(now);
+    hg_return_t hret;
+
+    while (!is_finished && open_loop_num_free > 0 &&
+            open_loop_next_ns <= now_ns) {
+        struct cli_cb_data *c = open_loop_free[--open_loop_num_free];
+        c->intended_ns = open_loop_next_ns;
+        if (cli_mode == BULK_MODE)
+            hret = call_next_bulk(c, NULL);
+        else
+            hret = call_next_rpc(c, NULL);
+        assert(hret == HG_SUCCESS);
+        open_loop_advance();
+    }
+
+    /* behind schedule (or waiting on a slot) - just poll */
+    if (open_loop_next_ns <= now_ns)
+        return 0;
+    else
+        return (unsigned int) ((open_loop_next_ns - now_ns) / 1000000);
+}
+
+static hg_return_t cli_wait_timed(uint64_t start)
 {
     hg_return_t hret = HG_SUCCESS;
-    unsigned int num_cb;
-    struct timespec t;
     /* wait a bit of time for processes to wind down */
     int time_cond = 1;
+    unsigned int timeout = 100;
+    uint64_t now;
 
     dprintf("progress/trigger loop entered\n");
 
@@ -230,19 +622,30 @@ static hg_return_t cli_wait_timed(struct timespec start)
             is_finished = 1;
             dprintf("time over, op_cnt=%d\n", op_cnt);
         }
-        do {
-            hret = HG_Trigger(hcli.hgctx, 0, 1, &num_cb);
-        } while(hret == HG_SUCCESS && num_cb);
-        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+        hret = trigger_ready(hcli.hgctx, NULL);
+        if (hret != HG_SUCCESS)
             break;
 
-        hret = HG_Progress(hcli.hgctx, 100);
+        if (open_loop_rate > 0.0) {
+            timeout = open_loop_issue(ticks_now());
+            if (timeout > 100) timeout = 100;
+        }
+
+        hret = progress_wait(hcli.hgctx, timeout);
         if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
             break;
 
-        clock_gettime(CLOCK_MONOTONIC, &t);
-
-        time_cond = (time_to_s_lf(timediff(start,t)) <= benchmark_seconds);
+        now = ticks_now();
+        if (converge_enabled())
+            time_cond = !conv_done &&
+                ticks_to_s(now - start) <= hg_converge_opts.max_seconds;
+        else
+            time_cond = (ticks_to_s(now - start) <= benchmark_seconds);
+        if (!time_cond && !is_finished) {
+            measure_end = now;
+            if (open_loop_rate > 0.0)
+                open_loop_drop(now);
+        }
     }
 
     if (hret == HG_TIMEOUT) hret = HG_SUCCESS;
@@ -284,119 +687,687 @@ static hg_return_t cli_wait_loop_all(
     return HG_TIMEOUT;
 }
 
-static void run_client(
-        size_t rdma_size,
-        enum cli_mode_t mode,
-        char const * info_str,
-        char const * svr)
+/* sync all clients through the server's check_in (or the tree barrier) */
+static void cli_sync(int max_retries)
 {
-
-    /* RPC params */
+    struct cli_cb_data cb_sync;
     hg_handle_t handle;
-    hg_bulk_t rdbulk;
-    struct cli_cb_data cb_init,
-                       cb_sync,
-                       bulk_isolated,
-                       rpc_isolated;
+    hg_return_t hret;
 
-    /* return params */
+    if (tree_fanout > 0) {
+        hret = tree_barrier(&hcli, max_retries);
+        assert(hret == HG_SUCCESS);
+        return;
+    }
+
+    cb_sync.is_init = 1;
+    cb_sync.u.is_finished = 0;
+    hret = HG_Create(hcli.hgctx, svr_addr,
+            hcli.check_in_id, &handle);
+    assert(hret == HG_SUCCESS);
+    hret = HG_Forward(handle, cli_sync_cb, &cb_sync, NULL);
+    assert(hret == HG_SUCCESS);
+    hret = cli_wait_loop_all(max_retries, 1, &cb_sync);
+    assert(hret == HG_SUCCESS);
+    HG_Destroy(handle);
+}
+
+/* stash / read back a client's barrier release time (CLOCK_REALTIME ns),
+ * one file per client like the latency histograms */
+static int release_write(int id, int64_t ns)
+{
+    char fname[256];
+    FILE *f;
+
+    snprintf(fname, sizeof(fname), "%s-%d", BARRIER_FNAME, id);
+    f = fopen(fname, "w");
+    if (f == NULL)
+        return -1;
+    fprintf(f, "%lld\n", (long long) ns);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static int release_read(int id, int64_t *ns)
+{
+    char fname[256];
+    long long v;
+    FILE *f;
+    int rc;
+
+    snprintf(fname, sizeof(fname), "%s-%d", BARRIER_FNAME, id);
+    f = fopen(fname, "r");
+    if (f == NULL)
+        return -1;
+    rc = fscanf(f, "%lld", &v) == 1 ? 0 : -1;
+    fclose(f);
+    remove(fname);
+    *ns = v;
+    return rc;
+}
+
+/* run and report one data point of the benchmark at size sz */
+static void run_point(
+        enum cli_mode_t mode,
+        struct cli_cb_data *slots,
+        size_t sz,
+        int first)
+{
     hg_return_t hret;
+    /* one exposed region per logical client */
+    hg_bulk_t *rdbulk = NULL;
+    hg_size_t rdbulk_sz = sz;
+    int s, l;
 
     /* benchmark times */
-    struct timespec start_time;
+    uint64_t start_time = ticks_now();
+
+    /* output */
+    char hist_fname[256];
+    char prefix[256];
+    char trace_path[256];
+    struct op_trace trace_state;
+    struct cpu_time cpu_start, cpu_end;
+    /* server stats around the run - nobody else is running ops at either
+     * snapshot, so the difference covers exactly this point */
+    server_stats_t *svr_start, svr_end, svr, d;
+    int svc_rpc = mode == RPC_MODE ? STAT_NOOP :
+                  mode == RPCBULK_MODE ? STAT_BULK_READ :
+                  mode == RPCDATA_MODE ? STAT_SIZED_RPC : -1;
+    double svc_time, elapsed, secs;
+    /* start barrier: how long we waited in it, and when it let us go */
+    uint64_t sync_start;
+    double sync_wait;
+    struct timespec release;
+
+    cur_size = sz;
+    cur_slots = slots;
+    conv_done = 0;
+    measure_end = 0;
+    if (converge_enabled())
+        converge_init(&conv);
+    op_cnt = 0;
+    lat_hist_init(&call_hist);
+    lat_hist_init(&complete_hist);
+    lat_hist_init(&corrected_hist);
+    lat_hist_init(&chunk_hist);
+    for (l = 0; num_logical > 1 && l < num_logical; l++)
+        lat_hist_init(&logical_hist[l]);
+    shards_reset();
+    num_chunks = chunk_bytes = 0;
+    chunk_ticks = 0;
+    for (s = 0; s < num_slots; s++) {
+        memset(&slots[s].u, 0, sizeof(slots[s].u));
+        slots[s].rpc_in.payload.len = (hg_uint32_t) sz;
+        slots[s].rpc_in.out_len =
+            (hg_uint32_t) (rpc_out_size >= 0 ? (size_t) rpc_out_size : sz);
+    }
 
-    /* initialize */
-    hg_init(info_str, rdma_size, HG_FALSE, 0, &hcli);
+    /* the server pulls the whole exposed region, so expose just this
+     * point's worth of the buffer */
+    if (mode == RPCBULK_MODE) {
+        rdbulk = malloc(num_logical * sizeof(*rdbulk));
+        assert(rdbulk);
+        for (l = 0; l < num_logical; l++) {
+            hret = HG_Bulk_create(hcli.hgcl, 1, &hcli.buf, &rdbulk_sz,
+                    HG_BULK_READ_ONLY, &rdbulk[l]);
+            assert(hret == HG_SUCCESS);
+        }
+        for (s = 0; s < num_slots; s++)
+            slots[s].cli_bulk_in.bh = rdbulk[slots[s].lc];
+    }
 
-    svr_addr = lookup_serv_addr(&hcli, svr);
-    assert(svr_addr != HG_ADDR_NULL);
+    svr_start = malloc(num_servers * sizeof(*svr_start));
+    assert(svr_start);
+    for (l = 0; l < num_servers; l++) {
+        hret = get_server_stats(&hcli, svr_addrs[l], 100, &svr_start[l]);
+        assert(hret == HG_SUCCESS);
+    }
 
-    hcli.is_separate_servers = 0;
+    /* do a sync before beginning the benchmark - the first one waits for
+     * up to two minutes for other clients to start up */
+    sync_start = ticks_now();
+    cli_sync(first ? 1200 : 20);
+    clock_gettime(CLOCK_REALTIME, &release);
+    sync_wait = ticks_to_s(ticks_now() - sync_start);
 
-    memset(&bulk_isolated, 0, sizeof(bulk_isolated));
-    memset(&rpc_isolated, 0, sizeof(rpc_isolated));
+    dprintf("client running benchmark...\n");
 
-    /* create, run RPC to grab bulk handle from rdma server
-     * (used in bulk mode) */
+    is_finished = 0;
 
-    cb_init.is_init = 1;
-    cb_init.u.is_finished = 0;
-    hret = HG_Create(hcli.hgctx, svr_addr,
-            hcli.get_bulk_handle_rpc_id, &cb_init.handle);
-    assert(hret == HG_SUCCESS);
+    if (trace_fname || print_all_times) {
+        if (trace_fname && !size_sweep)
+            snprintf(trace_path, sizeof(trace_path), "%s", trace_fname);
+        else if (trace_fname)
+            snprintf(trace_path, sizeof(trace_path), "%s-%lu", trace_fname,
+                    (unsigned long) sz);
+        else
+            snprintf(trace_path, sizeof(trace_path), "%s-%d", TRACE_FNAME,
+                    bench_client_id);
+        if (op_trace_open(&trace_state, trace_path, bench_client_id,
+                    num_slots, sz, mode_names[mode - RPC_MODE]) != 0) {
+            fprintf(stderr, "error: unable to open trace %s\n", trace_path);
+            exit(1);
+        }
+        trace = &trace_state;
+        trace_epoch_ticks = ticks_now();
+    }
 
-    HG_Forward(cb_init.handle, get_bulk_handle_cli_cb, &cb_init, NULL);
+    get_cpu_time(0, &cpu_start);
+    if (open_loop_rate > 0.0) {
+        /* every slot starts out free, first op is due immediately */
+        for (s = 0; s < num_slots; s++)
+            open_loop_free[s] = &slots[num_slots-1-s];
+        open_loop_num_free = num_slots;
+        open_loop_dropped = 0;
+        open_loop_seed[0] = 0x330e;
+        open_loop_seed[1] = (unsigned short) bench_client_id;
+        open_loop_seed[2] = (unsigned short) (bench_client_id >> 16);
+        start_time = ticks_now();
+        open_loop_next_ns = ticks_to_ns(start_time);
+        open_loop_issue(start_time);
+    }
+    else {
+        /* fill the window - the benchmark clock starts at the first issue */
+        for (s = 0; s < num_slots; s++) {
+            if (mode == BULK_MODE)
+                hret = call_next_bulk(&slots[s], s == 0 ? &start_time : NULL);
+            else
+                hret = call_next_rpc(&slots[s], s == 0 ? &start_time : NULL);
+            assert(hret == HG_SUCCESS);
+        }
+    }
+    measure_start = start_time;
+    hret = cli_wait_timed(start_time);
+    assert(hret == HG_SUCCESS);
+    get_cpu_time(0, &cpu_end);
+    elapsed = ticks_to_s(measure_end - measure_start);
+    /* rates are over the measured part when converging, -t otherwise */
+    secs = converge_enabled() ? elapsed : (double) benchmark_seconds;
+
+    if (trace) {
+        if (op_trace_close(trace) != 0)
+            fprintf(stderr, "warning: error closing trace %s\n", trace_path);
+        trace = NULL;
+    }
 
-    hret = cli_wait_loop_all(20, 1, &cb_init);
+    dprintf("client finished benchmark, waiting for others...\n");
 
-    assert(hret == HG_SUCCESS);
+    /* stash our latency histogram so client 0 can merge everyone's after
+     * the sync below */
+    snprintf(hist_fname, sizeof(hist_fname), "%s-%d", HIST_FNAME,
+            bench_client_id);
+    if (lat_hist_write(open_loop_rate > 0.0 ? &corrected_hist : &complete_hist,
+                hist_fname) != 0)
+        fprintf(stderr, "warning: unable to write %s\n", hist_fname);
+    if (release_write(bench_client_id,
+                release.tv_sec * 1000000000LL + release.tv_nsec) != 0)
+        fprintf(stderr, "warning: unable to write %s-%d\n", BARRIER_FNAME,
+                bench_client_id);
 
-    bulk_isolated.svr_bulk = cb_init.svr_bulk;
+    /* wait on a sync for others to complete */
+    cli_sync(20);
 
-    HG_Destroy(cb_init.handle);
+    /* totalled over the servers */
+    memset(&svr, 0, sizeof(svr));
+    for (l = 0; l < num_servers; l++) {
+        hret = get_server_stats(&hcli, svr_addrs[l], 100, &svr_end);
+        assert(hret == HG_SUCCESS);
+        server_stats_diff(&svr_start[l], &svr_end, &d);
+        server_stats_add(&svr, &d);
+    }
+    free(svr_start);
+    /* average server handler time of the benchmark's RPC (0 for bulk) */
+    svc_time = svc_rpc >= 0 && svr.count[svc_rpc] > 0 ?
+        svr.handler_ns[svc_rpc] / 1e9 / svr.count[svc_rpc] : 0.0;
 
-    /* create our own bulk handle if needed */
     if (mode == RPCBULK_MODE) {
-        hret = HG_Bulk_create(hcli.hgcl, 1, &hcli.buf, &hcli.buf_sz,
-                HG_BULK_READ_ONLY, &rdbulk);
-        assert(hret == HG_SUCCESS);
+        for (l = 0; l < num_logical; l++)
+            HG_Bulk_free(rdbulk[l]);
+        free(rdbulk);
+    }
+
+    /* print out resulting times (summed over all window slots) */
 
-        rpc_isolated.cli_bulk_in.bh = rdbulk;
+    struct cli_cb_data cbd;
+    const char * type = mode_names[mode - RPC_MODE];
+    int cpu, node;
+    memset(&cbd, 0, sizeof(cbd));
+    for (s = 0; s < num_slots; s++) {
+        cbd.u.times.num_complete += slots[s].u.times.num_complete;
+        cbd.u.times.total_ticks += slots[s].u.times.total_ticks;
+        cbd.u.times.total_ticks_call += slots[s].u.times.total_ticks_call;
+    }
+    get_placement(&cpu, &node);
+    report_ctx_clear();
+    report_ctx_int("size", (long long) sz);
+    report_ctx_int("seconds", benchmark_seconds);
+    report_ctx_str("type", type);
+    report_ctx_int("client", bench_client_id);
+    report_ctx_int("logical_clients", num_logical);
+    report_ctx_int("servers", num_servers);
+    report_begin("result");
+    report_int("count", cbd.u.times.num_complete);
+    report_dbl("call", ticks_to_s(cbd.u.times.total_ticks_call) /
+            cbd.u.times.num_complete);
+    report_dbl("complete", ticks_to_s(cbd.u.times.total_ticks) /
+            cbd.u.times.num_complete);
+    report_int("window", window_depth);
+    report_int("cpu", cpu);
+    report_int("node", node);
+    report_dbl("svc_time", svc_time);
+    report_dbl("elapsed", elapsed);
+    report_end();
+    if (!print_all_times) {
+        printf("%-8s %-8s %12lu %3d %4s %3d %7d %.3e %.3e %3d %3d %2d "
+                "%.3e %.3f\n",
+                hcli.class ? hcli.class : "default", hcli.transport,
+                sz, benchmark_seconds, type,
+                bench_client_id, cbd.u.times.num_complete,
+                ticks_to_s(cbd.u.times.total_ticks_call) /
+                    cbd.u.times.num_complete,
+                ticks_to_s(cbd.u.times.total_ticks) / cbd.u.times.num_complete,
+                window_depth, cpu, node, svc_time, elapsed);
+    }
+    else {
+        snprintf(prefix, sizeof(prefix), "%-8s %-8s %12lu %3d %4s %3d",
+                hcli.class ? hcli.class : "default", hcli.transport,
+                sz, benchmark_seconds, type, bench_client_id);
+        if (op_trace_foreach(trace_path, print_trace_rec, prefix) != 0)
+            fprintf(stderr, "error: unable to read back trace %s\n",
+                    trace_path);
+        /* the trace only existed to feed -a */
+        if (trace_fname == NULL)
+            remove(trace_path);
     }
 
-    /* init rpc handle for benchmark */
-    hret = HG_Create(hcli.hgctx, svr_addr,
-            mode == RPC_MODE ? hcli.noop_rpc_id : hcli.bulk_read_rpc_id,
-            &rpc_isolated.handle);
-    assert(hret == HG_SUCCESS);
+    /* latency distributions, format:
+     *   <class> <protocol> <bulk size> <bench time> <type> <id>
+     *     lat <which> <count> <p50> <p90> <p99> <p99.9> <max> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %12lu %3d %4s %3d",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            sz, benchmark_seconds, type, bench_client_id);
+    lat_hist_print(stdout, prefix, "call", &call_hist);
+    lat_hist_print(stdout, prefix, "complete", &complete_hist);
+    /* format: ... progress client <mode> <spin us> <trigger batch>
+     *   <user cpu s> <sys cpu s> */
+    progress_print(stdout, prefix, "client", &cpu_start, &cpu_end);
+    /* format: ... barrier <server | tree> <fanout> <wait s> */
+    printf("%s barrier %s %d %.3e\n", prefix,
+            tree_fanout > 0 ? "tree" : "server", tree_fanout, sync_wait);
+    report_begin("barrier");
+    report_str("barrier", tree_fanout > 0 ? "tree" : "server");
+    report_int("fanout", tree_fanout);
+    report_dbl("wait", sync_wait);
+    report_end();
+    /* per logical client, format: ... logical <logical id> <# ops>
+     *   <call avg> <complete avg> <p50> <p99> <max> */
+    for (l = 0; num_logical > 1 && l < num_logical; l++) {
+        unsigned long n = 0;
+        uint64_t call = 0, complete = 0;
+        const struct lat_hist *h = &logical_hist[l];
+
+        for (s = l * window_depth; s < (l + 1) * window_depth; s++) {
+            n += slots[s].u.times.num_complete;
+            call += slots[s].u.times.total_ticks_call;
+            complete += slots[s].u.times.total_ticks;
+        }
+        printf("%s logical %d %lu %.3e %.3e %.3e %.3e %.3e\n", prefix,
+                bench_client_id * num_logical + l, n,
+                n ? ticks_to_s(call) / n : 0.0,
+                n ? ticks_to_s(complete) / n : 0.0,
+                lat_hist_percentile(h, 50.0) / 1e9,
+                lat_hist_percentile(h, 99.0) / 1e9, h->max_ns / 1e9);
+        report_begin("logical");
+        report_int("logical_client", bench_client_id * num_logical + l);
+        report_int("count", (long long) n);
+        report_dbl("call", n ? ticks_to_s(call) / n : 0.0);
+        report_dbl("complete", n ? ticks_to_s(complete) / n : 0.0);
+        report_dbl("p50", lat_hist_percentile(h, 50.0) / 1e9);
+        report_dbl("p99", lat_hist_percentile(h, 99.0) / 1e9);
+        report_dbl("max", h->max_ns / 1e9);
+        report_end();
+    }
+    /* per server, format: ... shard <server index> <# ops> <complete avg>
+     *   <p50> <p99> <p99.9> <max> */
+    for (l = 0; num_servers > 1 && l < num_servers; l++) {
+        const struct shard_stats *sh = &shards[l];
+        double avg = sh->num_complete ?
+            ticks_to_s(sh->total_ticks) / sh->num_complete : 0.0;
+
+        printf("%s shard %d %lu %.3e %.3e %.3e %.3e %.3e\n", prefix, l,
+                sh->num_complete, avg,
+                lat_hist_percentile(&sh->hist, 50.0) / 1e9,
+                lat_hist_percentile(&sh->hist, 99.0) / 1e9,
+                lat_hist_percentile(&sh->hist, 99.9) / 1e9,
+                sh->hist.max_ns / 1e9);
+        report_begin("shard");
+        report_int("server", l);
+        report_int("count", (long long) sh->num_complete);
+        report_dbl("complete", avg);
+        report_dbl("p50", lat_hist_percentile(&sh->hist, 50.0) / 1e9);
+        report_dbl("p99", lat_hist_percentile(&sh->hist, 99.0) / 1e9);
+        report_dbl("p99.9", lat_hist_percentile(&sh->hist, 99.9) / 1e9);
+        report_dbl("max", sh->hist.max_ns / 1e9);
+        report_end();
+    }
+    if (converge_enabled()) {
+        /* format: ... converge complete <mean | pNN> <warmup ops> <ops>
+         *   <batches> <estimate> <rel half-width> <converged> */
+        converge_print(stdout, prefix, "complete", &conv);
+        converge_fini(&conv);
+    }
+    if (open_loop_rate > 0.0) {
+        /* format: ... rate <offered ops/s> <achieved ops/s> <dist>
+         *   <# dropped> */
+        lat_hist_print(stdout, prefix, "corrected", &corrected_hist);
+        printf("%s rate %.3e %.3e %s %lu\n", prefix,
+                open_loop_rate * num_logical,
+                cbd.u.times.num_complete / secs,
+                open_loop_poisson ? "poisson" : "const", open_loop_dropped);
+        report_begin("rate");
+        report_dbl("offered", open_loop_rate * num_logical);
+        report_dbl("achieved",
+                cbd.u.times.num_complete / secs);
+        report_str("dist", open_loop_poisson ? "poisson" : "const");
+        report_int("dropped", (long long) open_loop_dropped);
+        report_end();
+    }
+    /* only if ops were actually split (bigger than the chunk size) */
+    if (mode == BULK_MODE && chunk_size > 0 && num_chunks > 0) {
+        /* format: ... chunk <chunk size> <in flight> <# chunks>
+         *   <per-chunk bw> <end-to-end bw> (bytes/s) */
+        lat_hist_print(stdout, prefix, "chunk", &chunk_hist);
+        printf("%s chunk %lu %d %lu %.3e %.3e\n", prefix,
+                (unsigned long) chunk_size, chunks_in_flight, num_chunks,
+                chunk_ticks > 0 ? chunk_bytes / ticks_to_s(chunk_ticks) : 0.0,
+                (double) sz * cbd.u.times.num_complete / secs);
+        report_begin("chunk");
+        report_int("chunk_size", (long long) chunk_size);
+        report_int("in_flight", chunks_in_flight);
+        report_int("chunks", (long long) num_chunks);
+        report_dbl("chunk_bw",
+                chunk_ticks > 0 ? chunk_bytes / ticks_to_s(chunk_ticks) : 0.0);
+        report_dbl("bw", (double) sz * cbd.u.times.num_complete / secs);
+        report_end();
+    }
 
-    /* do a sync before beginning the benchmark */
-    cb_sync.is_init = 1;
-    cb_sync.u.is_finished = 0;
-    hret = HG_Create(hcli.hgctx, svr_addr,
-            hcli.check_in_id, &handle);
-    assert(hret == HG_SUCCESS);
-    hret = HG_Forward(handle, cli_sync_cb, &cb_sync, NULL);
-    assert(hret == HG_SUCCESS);
-    /* wait for up to two minutes for other clients to start up */
-    hret = cli_wait_loop_all(1200, 1, &cb_sync);
-    assert(hret == HG_SUCCESS);
-    HG_Destroy(handle);
+    /* client ids are 0..N-1, so client 0 merges N histogram files */
+    if (bench_client_id == 0) {
+        struct lat_hist merged;
+        int i;
+
+        /* server side of the point, format:
+         *   ... server <# progress calls> <# callbacks> <busy s> <idle s>
+         *     <bulk bytes>
+         *   ... server rpc <name> <count> <avg handler time>
+         * (one rpc line per RPC the server handled, summed over the
+         * servers of sharded runs) */
+        printf("%s server %10lu %10lu %.3e %.3e %lu\n", prefix,
+                (unsigned long) svr.progress_calls,
+                (unsigned long) svr.callbacks, svr.busy_ns / 1e9,
+                svr.idle_ns / 1e9, (unsigned long) svr.bulk_bytes);
+        report_begin("server");
+        report_int("progress_calls", (long long) svr.progress_calls);
+        report_int("callbacks", (long long) svr.callbacks);
+        report_dbl("busy", svr.busy_ns / 1e9);
+        report_dbl("idle", svr.idle_ns / 1e9);
+        report_int("bulk_bytes", (long long) svr.bulk_bytes);
+        report_end();
+        for (i = 0; i < STAT_NUM_RPCS; i++) {
+            if (svr.count[i] == 0)
+                continue;
+            printf("%s server rpc %-15s %10lu %.3e\n", prefix,
+                    stat_rpc_names[i], (unsigned long) svr.count[i],
+                    svr.handler_ns[i] / 1e9 / svr.count[i]);
+            report_begin("server_rpc");
+            report_str("rpc", stat_rpc_names[i]);
+            report_int("count", (long long) svr.count[i]);
+            report_dbl("handler_avg", svr.handler_ns[i] / 1e9 / svr.count[i]);
+            report_end();
+        }
+        /* a missing file is most likely a client that doesn't share our
+         * cwd (another node) - "all" then leaves it out */
+        lat_hist_init(&merged);
+        for (i = 0; i < num_bench_clients; i++) {
+            snprintf(hist_fname, sizeof(hist_fname), "%s-%d", HIST_FNAME, i);
+            if (lat_hist_read_merge(&merged, hist_fname) != 0) {
+                fprintf(stderr, "warning: no histogram from client %d (%s), "
+                        "left out of \"all\"\n", i, hist_fname);
+                continue;
+            }
+            remove(hist_fname);
+        }
+        snprintf(prefix, sizeof(prefix), "%-8s %-8s %12lu %3d %4s %3s",
+                hcli.class ? hcli.class : "default", hcli.transport,
+                sz, benchmark_seconds, type, "all");
+        /* merged over all clients, reported as client -1 */
+        report_ctx_int("client", -1);
+        lat_hist_print(stdout, prefix,
+                open_loop_rate > 0.0 ? "corrected" : "complete", &merged);
+        lat_hist_print_buckets(stdout, &merged);
+
+        /* start skew - release times are wall clock, so across nodes this
+         * is only as good as their clock sync */
+        int64_t t, first_ns = 0, last_ns = 0;
+        double sum = 0.0;
+        int n, last = 0;
+        for (n = 0; release_read(n, &t) == 0; n++) {
+            if (n == 0 || t < first_ns)
+                first_ns = t;
+            if (n == 0 || t > last_ns) {
+                last_ns = t;
+                last = n;
+            }
+            sum += (double) t;
+            report_begin("barrier_client");
+            report_int("release_client", n);
+            report_int("release_ns", t);
+            report_end();
+        }
+        if (n > 0) {
+            /* format: ... all barrier skew <# clients> <max - min release s>
+             *   <mean release - min s> <last released client> */
+            printf("%s barrier skew %d %.3e %.3e %d\n", prefix, n,
+                    (last_ns - first_ns) / 1e9,
+                    (sum / n - (double) first_ns) / 1e9, last);
+            report_begin("barrier_skew");
+            report_int("clients", n);
+            report_dbl("skew", (last_ns - first_ns) / 1e9);
+            report_dbl("mean_offset", (sum / n - (double) first_ns) / 1e9);
+            report_int("last", last);
+            report_end();
+        }
+    }
+}
 
-    dprintf("client running benchmark...\n");
+static void run_client(
+        size_t rdma_size,
+        enum cli_mode_t mode,
+        char const * info_str,
+        char * const * svrs,
+        int nsvrs)
+{
 
-    is_finished = 0;
+    /* RPC params */
+    hg_handle_t handle;
+    /* one get_bulk_handle per logical client */
+    struct cli_cb_data *cb_init;
+    /* and its results, [logical client][server] */
+    hg_bulk_t *svr_bulks;
+    /* one slot per in-flight op */
+    struct cli_cb_data *slots;
+    struct chunk_op *chunks = NULL;
+    int s, k;
+    size_t sz;
 
-    if (mode == RPC_MODE || mode == RPCBULK_MODE) {
-        hret = call_next_rpc(&rpc_isolated, &start_time);
-        assert(hret == HG_SUCCESS);
-        hret = cli_wait_timed(start_time);
-        assert(hret == HG_SUCCESS);
+    /* return params */
+    hg_return_t hret;
+
+    /* initialize - a sweep registers its largest size once */
+    hg_init(info_str, size_sweep && sizes.max > rdma_size ? sizes.max
+                                                         : rdma_size,
+            tree_fanout > 0 ? HG_TRUE : HG_FALSE, 0, &hcli);
+
+    num_servers = nsvrs;
+    svr_addrs = malloc(num_servers * sizeof(*svr_addrs));
+    svr_num_ctx = malloc(num_servers * sizeof(*svr_num_ctx));
+    assert(svr_addrs && svr_num_ctx);
+    for (k = 0; k < num_servers; k++) {
+        svr_addrs[k] = lookup_serv_addr(&hcli, svrs[k]);
+        assert(svr_addrs[k] != HG_ADDR_NULL);
+        svr_num_ctx[k] = 1;
     }
-    else {
-        hret = call_next_bulk(&bulk_isolated, &start_time);
+    svr_addr = svr_addrs[0];
+    if (num_servers > 1) {
+        shards = malloc(num_servers * sizeof(*shards));
+        assert(shards);
+        key_dist_init(&key_dist, num_keys, (unsigned int) bench_client_id);
+    }
+
+    /* joining waits on every client, so allow for stragglers starting up
+     * like the first check_in does */
+    if (tree_fanout > 0) {
+        hret = tree_barrier_init(&hcli, svr_addr, bench_client_id,
+                tree_fanout, 1200);
         assert(hret == HG_SUCCESS);
-        hret = cli_wait_timed(start_time);
+    }
+
+    hcli.is_separate_servers = 0;
+
+    num_slots = window_depth * num_logical;
+    slots = calloc(num_slots, sizeof(*slots));
+    assert(slots);
+    for (s = 0; s < num_slots; s++) {
+        slots[s].slot = s;
+        slots[s].lc = s / window_depth;
+        slots[s].rpc_in.payload.buf = hcli.buf;
+    }
+
+    /* chunk descriptors, chunks_in_flight per slot */
+    if (mode == BULK_MODE && chunk_size > 0) {
+        chunks = calloc(num_slots * chunks_in_flight, sizeof(*chunks));
+        assert(chunks);
+        for (s = 0; s < num_slots; s++) {
+            for (k = 0; k < chunks_in_flight; k++) {
+                struct chunk_op *co = &chunks[s*chunks_in_flight + k];
+                co->op = &slots[s];
+                co->next = slots[s].free_chunks;
+                slots[s].free_chunks = co;
+            }
+        }
+    }
+
+    if (open_loop_rate > 0.0) {
+        open_loop_free = malloc(num_slots * sizeof(*open_loop_free));
+        assert(open_loop_free);
+    }
+
+    if (num_logical > 1) {
+        logical_hist = malloc(num_logical * sizeof(*logical_hist));
+        assert(logical_hist);
+    }
+
+    /* create, run RPC to grab bulk handle from rdma server
+     * (used in bulk mode) */
+
+    cb_init = calloc(num_logical * num_servers, sizeof(*cb_init));
+    assert(cb_init);
+    for (k = 0; k < num_logical * num_servers; k++) {
+        cb_init[k].is_init = 1;
+        cb_init[k].srv = k % num_servers;
+        cb_init[k].u.is_finished = 0;
+        hret = HG_Create(hcli.hgctx, svr_addrs[k % num_servers],
+                hcli.get_bulk_handle_rpc_id, &cb_init[k].handle);
         assert(hret == HG_SUCCESS);
+
+        HG_Forward(cb_init[k].handle, get_bulk_handle_cli_cb, &cb_init[k],
+                NULL);
     }
 
-    dprintf("client finished benchmark, waiting for others...\n");
+    hret = cli_wait_loop_all(20, num_logical * num_servers, cb_init);
 
-    /* wait on a sync for others to complete */
-    cb_sync.is_init = 1;
-    cb_sync.u.is_finished = 0;
-    hret = HG_Create(hcli.hgctx, svr_addr,
-            hcli.check_in_id, &handle);
-    assert(hret == HG_SUCCESS);
-    hret = HG_Forward(handle, cli_sync_cb, &cb_sync, NULL);
     assert(hret == HG_SUCCESS);
-    hret = cli_wait_loop_all(20, 1, &cb_sync);
-    assert(hret == HG_SUCCESS);
-    HG_Destroy(handle);
 
-    /* send a shutdown request (don't bother checking) */
+    svr_bulks = malloc(num_logical * num_servers * sizeof(*svr_bulks));
+    assert(svr_bulks);
+    for (k = 0; k < num_logical * num_servers; k++) {
+        svr_bulks[k] = cb_init[k].svr_bulk;
+        HG_Destroy(cb_init[k].handle);
+    }
+    free(cb_init);
+    for (s = 0; s < num_slots; s++) {
+        slots[s].svr_bulks = &svr_bulks[slots[s].lc * num_servers];
+        slots[s].svr_bulk = slots[s].svr_bulks[0];
+    }
+
+    /* init rpc handles for benchmark - each slot needs its own, as a handle
+     * can't be forwarded again until its callback fires */
+    bench_rpc_id = mode == RPC_MODE ? hcli.noop_rpc_id :
+                   mode == RPCBULK_MODE ? hcli.bulk_read_rpc_id
+                                        : hcli.sized_rpc_id;
+    if (mode != BULK_MODE) {
+        for (s = 0; s < num_slots; s++) {
+            hret = HG_Create(hcli.hgctx, svr_addr, bench_rpc_id,
+                    &slots[s].handle);
+            assert(hret == HG_SUCCESS);
+            /* spread over multi-context servers */
+            set_handle_target_ctx(slots[s].handle,
+                    svr_num_ctx[slots[s].srv],
+                    (unsigned int) (bench_client_id * num_slots + s));
+        }
+    }
+
+    /* timestamp source and cost, so small-message numbers can be judged -
+     * format: <class> <protocol> timer <tsc | clock> <ns per tick>
+     *   <overhead ns> */
     if (bench_client_id == 0) {
-        hret = HG_Create(hcli.hgctx, svr_addr,
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%-8s %-8s",
+                hcli.class ? hcli.class : "default", hcli.transport);
+        timer_print(stdout, prefix);
+    }
+
+    /* how sharded runs spread ops - format: <class> <protocol> dist
+     *   <rr | uniform | zipf> <# servers> <# keys> <zipf theta> */
+    if (num_servers > 1 && bench_client_id == 0) {
+        printf("%-8s %-8s dist %s %d %lu %.3f\n",
+                hcli.class ? hcli.class : "default", hcli.transport,
+                key_dist_names[key_dist.type], num_servers,
+                (unsigned long) num_keys, key_dist.theta);
+        report_begin("dist");
+        report_str("dist", key_dist_names[key_dist.type]);
+        report_int("servers", num_servers);
+        report_int("keys", (long long) num_keys);
+        report_dbl("theta", key_dist.theta);
+        report_end();
+    }
+
+    /* payloads past max unexpected no longer go out eagerly with the
+     * request - format: <class> <protocol> msg limits <unexp> <exp> */
+    if (mode == RPCDATA_MODE && bench_client_id == 0) {
+        size_t max_unexp, max_exp;
+        get_msg_limits(&hcli, &max_unexp, &max_exp);
+        printf("%-8s %-8s msg limits %lu %lu\n",
+                hcli.class ? hcli.class : "default", hcli.transport,
+                (unsigned long) max_unexp, (unsigned long) max_exp);
+        report_begin("msg_limits");
+        report_int("max_unexpected", (long long) max_unexp);
+        report_int("max_expected", (long long) max_exp);
+        report_end();
+    }
+
+    if (size_sweep) {
+        sz = sizes.min;
+        do {
+            run_point(mode, slots, sz, sz == sizes.min);
+        } while (size_range_next(&sizes, &sz));
+    }
+    else
+        run_point(mode, slots, rdma_size, 1);
+
+    /* send a shutdown request to each server (don't bother checking) */
+    for (k = 0; bench_client_id == 0 && k < num_servers; k++) {
+        hret = HG_Create(hcli.hgctx, svr_addrs[k],
                 hcli.shutdown_server_rpc_id, &handle);
         assert(hret == HG_SUCCESS);
         HG_Forward(handle, NULL, NULL, NULL);
@@ -404,37 +1375,24 @@ static void run_client(
         HG_Destroy(handle);
     }
 
-    /* print out resulting times */
-
-    struct cli_cb_data *cbd;
-    const char * type;
-    switch(mode) {
-        case RPC_MODE:     cbd = &rpc_isolated; type = "rpc"; break;
-        case BULK_MODE:    cbd = &bulk_isolated; type = "bulk"; break;
-        case RPCBULK_MODE: cbd = &rpc_isolated; type = "rpcbulk"; break;
-        default: abort();
-    }
-    if (all_times == NULL) {
-        printf("%-8s %-8s %12lu %3d %4s %3d %7d %.3e %.3e\n",
-                hcli.class ? hcli.class : "default", hcli.transport,
-                hcli.buf_sz, benchmark_seconds, type,
-                bench_client_id, cbd->u.times.num_complete,
-                cbd->u.times.total_time_call / cbd->u.times.num_complete,
-                cbd->u.times.total_time / cbd->u.times.num_complete);
+    if (mode != BULK_MODE) {
+        for (s = 0; s < num_slots; s++)
+            HG_Destroy(slots[s].handle);
     }
-    else {
-        for (int i = 0; i < time_idx; i++) {
-            printf("%-8s %-8s %12lu %3d %4s %3d %.3e %.3e\n",
-                    hcli.class ? hcli.class : "default", hcli.transport,
-                    hcli.buf_sz, benchmark_seconds, type,
-                    bench_client_id, all_times[i].call, all_times[i].complete);
-        }
-    }
-
-    HG_Destroy(rpc_isolated.handle);
-    if (mode == RPCBULK_MODE) HG_Bulk_free(rdbulk);
-    HG_Bulk_free(bulk_isolated.svr_bulk);
-    HG_Addr_free(hcli.hgcl, svr_addr);
+    for (k = 0; k < num_logical * num_servers; k++)
+        HG_Bulk_free(svr_bulks[k]);
+    free(svr_bulks);
+    free(logical_hist);
+    free(shards);
+    free(slots);
+    free(chunks);
+    free(open_loop_free);
+    if (tree_fanout > 0)
+        tree_barrier_fini(&hcli);
+    for (k = 0; k < num_servers; k++)
+        HG_Addr_free(hcli.hgcl, svr_addrs[k]);
+    free(svr_addrs);
+    free(svr_num_ctx);
 
     hg_fini(&hcli);
 }
@@ -446,9 +1404,10 @@ int main(int argc, char *argv[])
     enum mode_t mode = UNKNOWN;
     size_t rdma_size;
     int num_clients;
-    char const * svr, * info_str;
+    char const * info_str;
     char const * svr_id;
     int arg = 1;
+    int rc;
 
     init_verbose();
 
@@ -459,10 +1418,19 @@ int main(int argc, char *argv[])
 
     for (;;) {
         if (strcmp(argv[arg], "-a") == 0) {
-            all_times = malloc((1<<21) * sizeof(*all_times));
-            assert(all_times);
+            print_all_times = 1;
             arg++;
         }
+        else if (strcmp(argv[arg], "-T") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                trace_fname = argv[arg+1];
+                arg += 2;
+            }
+        }
         else if (strcmp(argv[arg], "-t") == 0) {
             if (arg+1 >= argc){
                 usage();
@@ -473,10 +1441,155 @@ int main(int argc, char *argv[])
                 arg += 2;
             }
         }
+        else if (strcmp(argv[arg], "-r") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                open_loop_rate = atof(argv[arg+1]);
+                if (open_loop_rate <= 0.0) {
+                    fprintf(stderr, "rate must be > 0\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-p") == 0) {
+            open_loop_poisson = 1;
+            arg++;
+        }
+        else if (strcmp(argv[arg], "-w") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                window_depth = atoi(argv[arg+1]);
+                if (window_depth < 1) {
+                    fprintf(stderr, "window depth must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-L") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                num_logical = atoi(argv[arg+1]);
+                if (num_logical < 1) {
+                    fprintf(stderr, "logical clients must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-c") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                chunk_size = (hg_size_t) strtoul(argv[arg+1], NULL, 10);
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-k") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                chunks_in_flight = atoi(argv[arg+1]);
+                if (chunks_in_flight < 1) {
+                    fprintf(stderr, "chunks in flight must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-o") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                rpc_out_size = atol(argv[arg+1]);
+                if (rpc_out_size < 0) {
+                    fprintf(stderr, "response size must be >= 0\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "--tree-barrier") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                tree_fanout = atoi(argv[arg+1]);
+                if (tree_fanout < 1) {
+                    fprintf(stderr, "tree barrier fanout must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "--dist") == 0) {
+            if (arg+1 >= argc ||
+                    key_dist_parse(argv[arg+1], &key_dist) != 0) {
+                usage();
+                exit(1);
+            }
+            arg += 2;
+        }
+        else if (strcmp(argv[arg], "--keys") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                num_keys = strtoull(argv[arg+1], NULL, 10);
+                if (num_keys < 2) {
+                    fprintf(stderr, "key space must be >= 2 keys\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-S") == 0) {
+            /* filled in once we have the rdma size */
+            size_sweep = -1;
+            arg++;
+        }
+        else if (strcmp(argv[arg], "--sizes") == 0) {
+            if (arg+1 >= argc ||
+                    size_range_parse(argv[arg+1], &sizes) != 0) {
+                usage();
+                exit(1);
+            }
+            size_sweep = 1;
+            arg += 2;
+        }
+        else if ((rc = parse_common_opt(argc, argv, &arg)) != 0) {
+            if (rc < 0) {
+                usage();
+                exit(1);
+            }
+        }
         else
             break;
     }
 
+    /* converging points run until done or capped - the cap stands in for
+     * -t in the output */
+    if (converge_enabled())
+        benchmark_seconds = (int) ceil(hg_converge_opts.max_seconds);
+
     if (arg >= argc) {
         usage();
         exit(1);
@@ -495,6 +1608,15 @@ int main(int argc, char *argv[])
 
     rdma_size = (size_t) strtol(argv[arg++], NULL, 10);
 
+    /* -S is shorthand for --sizes 0:<rdma size>:x2 */
+    if (size_sweep < 0) {
+        sizes.min = 0;
+        sizes.max = rdma_size;
+        sizes.step = 2;
+        sizes.geometric = 1;
+        size_sweep = 1;
+    }
+
     switch(mode) {
         case CLIENT:
             if (arg+1 >= argc) {
@@ -521,9 +1643,11 @@ int main(int argc, char *argv[])
                 cli_mode = BULK_MODE;
             else if (strcmp(argv[arg], "rpcbulk") == 0)
                 cli_mode = RPCBULK_MODE;
+            else if (strcmp(argv[arg], "rpcdata") == 0)
+                cli_mode = RPCDATA_MODE;
             else {
-                fprintf(stderr, "expected mode \"rpc\" or \"bulk\", got %s\n",
-                        argv[arg]);
+                fprintf(stderr, "expected mode \"rpc\", \"bulk\", "
+                        "\"rpcbulk\" or \"rpcdata\", got %s\n", argv[arg]);
                 usage();
                 exit(1);
             }
@@ -534,9 +1658,16 @@ int main(int argc, char *argv[])
                 exit(1);
             }
 
+            /* zero-length bulk transfers aren't a thing */
+            if (size_sweep && sizes.min == 0 && cli_mode != RPCDATA_MODE) {
+                fprintf(stderr, "size 0 requires mode \"rpcdata\"\n");
+                exit(1);
+            }
+
+            /* the rest are servers */
             info_str = argv[arg++];
-            svr  = argv[arg];
-            run_client(rdma_size, cli_mode, info_str, svr);
+            run_client(rdma_size, cli_mode, info_str, &argv[arg],
+                    argc - arg);
             break;
 
         case SERVER:
@@ -573,13 +1704,53 @@ int main(int argc, char *argv[])
 
 
 const char * usage_str =
-"Usage: hg-ctest4 [-a] [-t TIME] (client | server) OPTIONS\n"
+"Usage: hg-ctest4 [-a] [-T FILE] [-t TIME] [-w DEPTH] [-L NUM]\n"
+"                 [-r RATE [-p]]\n"
+"                 [-c BYTES [-k K]] [-o BYTES] [-S | --sizes SPEC]\n"
+"                 [--tree-barrier K] [--dist DIST [--keys N]]\n"
+"                 (client | server) OPTIONS\n"
 "  -a prints out every measurement, rather than an average in client mode\n"
-"  -t is the time to run the benchmark in client mode\n"
+"  -T streams every measurement to binary trace FILE in client mode\n"
+"     (convert with hg-ctest-trace2csv)\n"
+"  -t is the time to run the benchmark in client mode (with --converge,\n"
+"     points run until they converge instead)\n"
+"  -w is the number of operations each client keeps in flight (default 1)\n"
+"  -L NUM makes the process NUM logical clients (ids <client id>*NUM to\n"
+"     <client id>*NUM+NUM-1), each with its own -w window of handles and\n"
+"     its own server bulk handle, sharing one class and context. Result\n"
+"     lines sum them, \"logical\" lines break them out. The server's\n"
+"     <num clients> counts processes. With -r, each logical client offers\n"
+"     RATE, ops taking whichever slot is free\n"
+"  -r RATE runs clients open-loop, issuing RATE ops/s on a fixed schedule\n"
+"     rather than from completions. -w then caps ops in flight; ops that\n"
+"     come due while all are busy wait, and \"corrected\" latencies are\n"
+"     measured from the scheduled issue time\n"
+"  -p uses Poisson (exponential) inter-arrival times with -r\n"
+"  -c BYTES splits each \"bulk\" mode transfer into BYTES-sized chunks\n"
+"  -k is the number of chunks each op keeps in flight with -c (default 1)\n"
+"     (for \"rpcbulk\", see the server --pull-chunk options below)\n"
+"  -o BYTES sets the response payload size in \"rpcdata\" mode (default:\n"
+"     same as the request)\n"
+"  --sizes MIN:MAX:xF (or MIN:MAX:+STEP) runs each size from MIN to MAX in\n"
+"     one session, -t seconds per size; sizes take K/M/G suffixes\n"
+"     (e.g. 4K:64M:x2). The client buffer is registered at MAX, and the\n"
+"     server's <rdma size max> should be at least MAX\n"
+"  -S sweeps \"rpcdata\" payload sizes 0, 1, 2, 4, ... up to <rdma size>\n"
+"     (same as --sizes 0:<rdma size>:x2)\n"
+"  --tree-barrier K syncs clients through a K-ary tree of clients instead\n"
+"     of the server's check_in (for large client counts). Clients then\n"
+"     listen, so <class+protocol> must be one they can listen on, and\n"
+"     client ids must be 0 to <num clients>-1\n"
+"  --dist DIST spreads ops over several servers (see below) by key:\n"
+"     \"rr\" (round-robin, the default), \"uniform\" or \"zipf[:THETA]\"\n"
+"     (0 < THETA < 1, default 0.99) over --keys N keys (default 1000000),\n"
+"     hashed onto servers. \"shard\" lines break latency down by server\n"
 "  in client mode, OPTIONS are:\n"
-"    <rdma size> <client id> <mode> <class+protocol> <server>\n"
+"    <rdma size> <client id> <mode> <class+protocol> <server> [<server>...]\n"
 "    where client id should be unique among all clients in this run\n"
-"    and mode is one of \"rpc\", \"bulk\", or \"rpcbulk\" \n"
+"    and mode is one of \"rpc\", \"bulk\", \"rpcbulk\" or \"rpcdata\"\n"
+"    (\"rpcdata\" sends <rdma size> bytes inline with each RPC)\n"
+"    with several servers, the first also runs the client barrier\n"
 "  in server mode, OPTIONS are:\n"
 "    <rdma size max> <num clients> <listen addr> [<id>]\n"
 "  servers spit out files named ctest-server-addr.tmp[-<id>] \n"
@@ -590,5 +1761,6 @@ const char * usage_str =
 
 static void usage() {
     fprintf(stderr, "%s", usage_str);
+    print_common_usage(stderr);
 }
 
@@ -0,0 +1,605 @@
+/*
+ * Copyright 2015-2016 Argonne National Laboratory, Department of Energy,
+ * UChicago Argonne, LLC and the HDF Group. See COPYING in the top-level
+ * directory
+ */
+
+/* Test fan-out / fan-in (scatter-gather) RPCs in mercury: each operation
+ * forwards the same RPC to K servers at once and is timed to the first,
+ * the quorum-th and the last response */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <ctype.h>
+
+#include <mercury.h>
+#include <mercury_bulk.h>
+#include <mercury_macros.h>
+
+#define VERBOSE_LOG 0
+#include "hg-ctest-util.h"
+
+static int benchmark_seconds = 10;
+
+/* number of scatter ops kept in flight per client (-w option) */
+static int window_depth = 1;
+
+/* responses an op needs for "quorum" (-q option, 0 -> a majority of
+ * K) */
+static int quorum_opt = 0;
+
+/* fan-outs to run (--fanout option, default 1, 2, 4, ... up to the number
+ * of servers) */
+static struct size_range fanouts;
+static int fanout_set = 0;
+
+/* checked by callbacks, set by progress/trigger loop */
+static int is_finished = 0;
+
+/* incremented by calls, decremented by callbacks (so we can keep
+ * track of pending ops - stopping the loop early causes asserts) */
+static int op_cnt = 0;
+
+/* this needs to be a global to pass around between callback functions and
+ * whatnot */
+static struct hg_comm_info hcli;
+
+/* global id for client process */
+static int bench_client_id = -1;
+
+/* servers - the first also runs the client barrier */
+static hg_addr_t *svr_addrs;
+/* contexts each server spreads RPCs over */
+static unsigned int *svr_num_ctx;
+static int num_servers;
+
+enum cli_mode_t {
+    RPC_MODE = 20,
+    RPCDATA_MODE
+};
+
+static char const * const mode_names[] = { "rpc", "rpcdata" };
+
+static enum cli_mode_t cli_mode;
+
+/* fan-out and quorum of the point being run */
+static int cur_fanout, cur_quorum;
+
+/* latency of the first, quorum-th and last response of each op, and of
+ * every individual response ("leg") - the gap between leg and all is the
+ * straggler amplification */
+static struct lat_hist first_hist, quorum_hist, all_hist, leg_hist;
+
+struct scatter_op;
+
+/* one of an op's forwards */
+struct leg {
+    struct scatter_op *op;
+    hg_handle_t handle;
+};
+
+/* a window slot: one handle per server, of which the first cur_fanout are
+ * used */
+struct scatter_op {
+    int slot;
+    struct leg *legs;
+    sized_rpc_in_t rpc_in; /* RPCDATA_MODE */
+    int num_responded;
+    uint64_t start; /* ticks */
+    /* summed over the point */
+    int num_complete;
+    uint64_t first_ticks, quorum_ticks, all_ticks;
+};
+
+static hg_return_t scatter_cb(const struct hg_cb_info *info);
+
+/* forward the op to the first cur_fanout servers */
+static hg_return_t call_next_scatter(struct scatter_op *op)
+{
+    hg_return_t hret = HG_SUCCESS;
+    int i;
+
+    op->num_responded = 0;
+    op->start = ticks_now();
+    for (i = 0; i < cur_fanout; i++) {
+        trace_event(EV_FORWARD, op->slot);
+        hret = HG_Forward(op->legs[i].handle, scatter_cb, &op->legs[i],
+                cli_mode == RPCDATA_MODE ? (void*) &op->rpc_in : NULL);
+        if (hret != HG_SUCCESS)
+            break;
+        op_cnt++;
+    }
+    return hret;
+}
+
+static hg_return_t scatter_cb(const struct hg_cb_info *info)
+{
+    struct leg *l = info->arg;
+    struct scatter_op *op = l->op;
+    sized_rpc_out_t out;
+    hg_return_t hret;
+    uint64_t d;
+
+    assert(info->ret == HG_SUCCESS);
+    trace_event(EV_CALLBACK, op->slot);
+    op_cnt--;
+
+    /* decoding the response payload is part of the op */
+    if (cli_mode == RPCDATA_MODE) {
+        hret = HG_Get_output(info->info.forward.handle, &out);
+        assert(hret == HG_SUCCESS);
+        HG_Free_output(info->info.forward.handle, &out);
+    }
+
+    d = ticks_now() - op->start;
+    lat_hist_record_ticks(&leg_hist, d);
+    op->num_responded++;
+    if (op->num_responded == 1) {
+        lat_hist_record_ticks(&first_hist, d);
+        op->first_ticks += d;
+    }
+    if (op->num_responded == cur_quorum) {
+        lat_hist_record_ticks(&quorum_hist, d);
+        op->quorum_ticks += d;
+    }
+    if (op->num_responded == cur_fanout) {
+        lat_hist_record_ticks(&all_hist, d);
+        op->all_ticks += d;
+        op->num_complete++;
+        if (!is_finished) {
+            hret = call_next_scatter(op);
+            assert(hret == HG_SUCCESS);
+        }
+    }
+    return HG_SUCCESS;
+}
+
+static hg_return_t cli_wait_timed(uint64_t start)
+{
+    hg_return_t hret = HG_SUCCESS;
+    /* wait a bit of time for processes to wind down */
+    int time_cond = 1;
+
+    dprintf("progress/trigger loop entered\n");
+
+    while (time_cond || op_cnt > 0) {
+        if (!time_cond) {
+            is_finished = 1;
+            dprintf("time over, op_cnt=%d\n", op_cnt);
+        }
+        hret = trigger_ready(hcli.hgctx, NULL);
+        if (hret != HG_SUCCESS)
+            break;
+
+        hret = progress_wait(hcli.hgctx, 100);
+        if (hret != HG_SUCCESS && hret != HG_TIMEOUT)
+            break;
+
+        time_cond = ticks_to_s(ticks_now() - start) <= benchmark_seconds;
+    }
+
+    if (hret == HG_TIMEOUT) hret = HG_SUCCESS;
+    return hret;
+}
+
+static hg_return_t cli_flag_cb(const struct hg_cb_info *info)
+{
+    *(int *) info->arg = 1;
+    return HG_SUCCESS;
+}
+
+/* sync all clients through the first server's check_in */
+static void cli_sync(int max_retries)
+{
+    hg_handle_t handle;
+    hg_return_t hret;
+    int done = 0;
+
+    hret = HG_Create(hcli.hgctx, svr_addrs[0], hcli.check_in_id, &handle);
+    assert(hret == HG_SUCCESS);
+    hret = HG_Forward(handle, cli_flag_cb, &done, NULL);
+    assert(hret == HG_SUCCESS);
+    hret = wait_until(hcli.hgctx, &done, max_retries);
+    assert(hret == HG_SUCCESS);
+    HG_Destroy(handle);
+}
+
+/* run and report one fan-out of the benchmark */
+static void run_point(struct scatter_op *ops, size_t sz, int fanout,
+        int first)
+{
+    hg_return_t hret;
+    uint64_t start_time;
+    char prefix[256];
+    struct cpu_time cpu_start, cpu_end;
+    const char * type = mode_names[cli_mode - RPC_MODE];
+    unsigned long n = 0;
+    uint64_t first_ticks = 0, quorum_ticks = 0, all_ticks = 0;
+    int s;
+
+    cur_fanout = fanout;
+    cur_quorum = quorum_opt > 0 ? quorum_opt : fanout / 2 + 1;
+    if (cur_quorum > fanout)
+        cur_quorum = fanout;
+    is_finished = 0;
+    op_cnt = 0;
+    lat_hist_init(&first_hist);
+    lat_hist_init(&quorum_hist);
+    lat_hist_init(&all_hist);
+    lat_hist_init(&leg_hist);
+    for (s = 0; s < window_depth; s++) {
+        ops[s].num_complete = 0;
+        ops[s].first_ticks = ops[s].quorum_ticks = ops[s].all_ticks = 0;
+    }
+
+    /* do a sync before beginning the benchmark - the first one waits for
+     * up to two minutes for other clients to start up */
+    cli_sync(first ? 1200 : 20);
+
+    get_cpu_time(0, &cpu_start);
+    start_time = ticks_now();
+    for (s = 0; s < window_depth; s++) {
+        hret = call_next_scatter(&ops[s]);
+        assert(hret == HG_SUCCESS);
+    }
+    hret = cli_wait_timed(start_time);
+    assert(hret == HG_SUCCESS);
+    get_cpu_time(0, &cpu_end);
+
+    /* wait on a sync for others to complete */
+    cli_sync(20);
+
+    for (s = 0; s < window_depth; s++) {
+        n += ops[s].num_complete;
+        first_ticks += ops[s].first_ticks;
+        quorum_ticks += ops[s].quorum_ticks;
+        all_ticks += ops[s].all_ticks;
+    }
+
+    /* format: <class> <protocol> <size> <bench time> <type> <id> <fanout>
+     *   <quorum> <# ops> <first avg> <quorum avg> <all avg> <window> */
+    printf("%-8s %-8s %12lu %3d %7s %3d %3d %3d %7lu %.3e %.3e %.3e %3d\n",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            (unsigned long) sz, benchmark_seconds, type, bench_client_id,
+            fanout, cur_quorum, n,
+            n ? ticks_to_s(first_ticks) / n : 0.0,
+            n ? ticks_to_s(quorum_ticks) / n : 0.0,
+            n ? ticks_to_s(all_ticks) / n : 0.0, window_depth);
+    report_ctx_clear();
+    report_ctx_int("size", (long long) sz);
+    report_ctx_int("seconds", benchmark_seconds);
+    report_ctx_str("type", type);
+    report_ctx_int("client", bench_client_id);
+    report_ctx_int("fanout", fanout);
+    report_ctx_int("quorum", cur_quorum);
+    report_begin("result");
+    report_int("count", (long long) n);
+    report_dbl("first", n ? ticks_to_s(first_ticks) / n : 0.0);
+    report_dbl("quorum_time", n ? ticks_to_s(quorum_ticks) / n : 0.0);
+    report_dbl("all", n ? ticks_to_s(all_ticks) / n : 0.0);
+    report_int("window", window_depth);
+    report_end();
+
+    /* latency distributions, format:
+     *   <class> <protocol> <size> <bench time> <type> <id> <fanout>
+     *     lat <first | quorum | all | leg> <count> <p50> <p90> <p99>
+     *     <p99.9> <max> */
+    snprintf(prefix, sizeof(prefix), "%-8s %-8s %12lu %3d %7s %3d %3d",
+            hcli.class ? hcli.class : "default", hcli.transport,
+            (unsigned long) sz, benchmark_seconds, type, bench_client_id,
+            fanout);
+    lat_hist_print(stdout, prefix, "first", &first_hist);
+    lat_hist_print(stdout, prefix, "quorum", &quorum_hist);
+    lat_hist_print(stdout, prefix, "all", &all_hist);
+    lat_hist_print(stdout, prefix, "leg", &leg_hist);
+    /* format: ... progress client <mode> <spin us> <trigger batch>
+     *   <user cpu s> <sys cpu s> */
+    progress_print(stdout, prefix, "client", &cpu_start, &cpu_end);
+}
+
+static void run_client(
+        size_t rdma_size,
+        char const * info_str,
+        char * const * svrs,
+        int nsvrs)
+{
+    struct scatter_op *ops;
+    hg_handle_t handle;
+    hg_return_t hret;
+    size_t fanout;
+    int s, i;
+
+    hg_init(info_str, rdma_size, HG_FALSE, 0, &hcli);
+
+    num_servers = nsvrs;
+    svr_addrs = malloc(num_servers * sizeof(*svr_addrs));
+    svr_num_ctx = malloc(num_servers * sizeof(*svr_num_ctx));
+    assert(svr_addrs && svr_num_ctx);
+    for (i = 0; i < num_servers; i++) {
+        svr_addrs[i] = lookup_serv_addr(&hcli, svrs[i]);
+        assert(svr_addrs[i] != HG_ADDR_NULL);
+        svr_num_ctx[i] = get_server_num_ctx(&hcli, svr_addrs[i], 20);
+    }
+
+    /* default: 1, 2, 4, ... up to all of the servers */
+    if (!fanout_set) {
+        fanouts.min = 1;
+        fanouts.max = (size_t) num_servers;
+        fanouts.step = 2;
+        fanouts.geometric = 1;
+    }
+    if (fanouts.min < 1 || fanouts.max > (size_t) num_servers) {
+        fprintf(stderr, "error: fan-outs must be from 1 to the number of "
+                "servers (%d)\n", num_servers);
+        exit(1);
+    }
+
+    /* each slot gets a handle per server, as a handle can't be forwarded
+     * again until its callback fires */
+    ops = calloc(window_depth, sizeof(*ops));
+    assert(ops);
+    for (s = 0; s < window_depth; s++) {
+        ops[s].slot = s;
+        ops[s].rpc_in.payload.len = (hg_uint32_t) rdma_size;
+        ops[s].rpc_in.payload.buf = hcli.buf;
+        ops[s].rpc_in.out_len = (hg_uint32_t) rdma_size;
+        ops[s].legs = calloc(num_servers, sizeof(*ops[s].legs));
+        assert(ops[s].legs);
+        for (i = 0; i < num_servers; i++) {
+            ops[s].legs[i].op = &ops[s];
+            hret = HG_Create(hcli.hgctx, svr_addrs[i],
+                    cli_mode == RPC_MODE ? hcli.noop_rpc_id
+                                         : hcli.sized_rpc_id,
+                    &ops[s].legs[i].handle);
+            assert(hret == HG_SUCCESS);
+            /* spread over multi-context servers */
+            set_handle_target_ctx(ops[s].legs[i].handle, svr_num_ctx[i],
+                    (unsigned int) (bench_client_id * window_depth + s));
+        }
+    }
+
+    /* timestamp source and cost - format: <class> <protocol> timer
+     *   <tsc | clock> <ns per tick> <overhead ns> */
+    if (bench_client_id == 0) {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%-8s %-8s",
+                hcli.class ? hcli.class : "default", hcli.transport);
+        timer_print(stdout, prefix);
+    }
+
+    fanout = fanouts.min;
+    do {
+        run_point(ops, cli_mode == RPC_MODE ? 0 : rdma_size, (int) fanout,
+                fanout == fanouts.min);
+    } while (size_range_next(&fanouts, &fanout));
+
+    /* send a shutdown request to each server (don't bother checking) */
+    for (i = 0; bench_client_id == 0 && i < num_servers; i++) {
+        hret = HG_Create(hcli.hgctx, svr_addrs[i],
+                hcli.shutdown_server_rpc_id, &handle);
+        assert(hret == HG_SUCCESS);
+        HG_Forward(handle, NULL, NULL, NULL);
+        hret = wait_until(hcli.hgctx, NULL, 10);
+        HG_Destroy(handle);
+    }
+
+    for (s = 0; s < window_depth; s++) {
+        for (i = 0; i < num_servers; i++)
+            HG_Destroy(ops[s].legs[i].handle);
+        free(ops[s].legs);
+    }
+    free(ops);
+    for (i = 0; i < num_servers; i++)
+        HG_Addr_free(hcli.hgcl, svr_addrs[i]);
+    free(svr_addrs);
+    free(svr_num_ctx);
+
+    hg_fini(&hcli);
+}
+
+static void usage();
+
+int main(int argc, char *argv[])
+{
+    enum mode_t mode = UNKNOWN;
+    size_t rdma_size;
+    int num_clients;
+    char const * info_str;
+    char const * svr_id;
+    int arg = 1;
+    int rc;
+
+    init_verbose();
+
+    if (argc < 2) {
+        usage();
+        exit(1);
+    }
+
+    for (;;) {
+        if (strcmp(argv[arg], "-t") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                benchmark_seconds = atoi(argv[arg+1]);
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-w") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                window_depth = atoi(argv[arg+1]);
+                if (window_depth < 1) {
+                    fprintf(stderr, "window depth must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "-q") == 0) {
+            if (arg+1 >= argc){
+                usage();
+                exit(1);
+            }
+            else {
+                quorum_opt = atoi(argv[arg+1]);
+                if (quorum_opt < 1) {
+                    fprintf(stderr, "quorum must be >= 1\n");
+                    exit(1);
+                }
+                arg += 2;
+            }
+        }
+        else if (strcmp(argv[arg], "--fanout") == 0) {
+            if (arg+1 >= argc ||
+                    size_range_parse(argv[arg+1], &fanouts) != 0) {
+                usage();
+                exit(1);
+            }
+            fanout_set = 1;
+            arg += 2;
+        }
+        else if ((rc = parse_common_opt(argc, argv, &arg)) != 0) {
+            if (rc < 0) {
+                usage();
+                exit(1);
+            }
+        }
+        else
+            break;
+    }
+
+    /* points run for a fixed -t */
+    if (converge_enabled()) {
+        fprintf(stderr, "error: hg-ctest5 doesn't support --converge\n");
+        exit(1);
+    }
+
+    if (arg >= argc) {
+        usage();
+        exit(1);
+    }
+
+    if (strcmp(argv[arg], "client") == 0)
+        mode = CLIENT;
+    else if (strcmp(argv[arg], "server") == 0)
+        mode = SERVER;
+    else {
+        usage();
+        exit(1);
+    }
+    arg++;
+
+    if (arg >= argc) {
+        usage();
+        exit(1);
+    }
+    rdma_size = (size_t) strtol(argv[arg++], NULL, 10);
+
+    switch(mode) {
+        case CLIENT:
+            if (arg+1 >= argc) {
+                usage();
+                exit(1);
+            }
+            /* dumb check but probably effective */
+            if (isdigit(argv[arg][0]))
+                bench_client_id = atoi(argv[arg]);
+            else {
+                fprintf(stderr, "bad or nonexisting client id, exiting...\n");
+                exit(1);
+            }
+            arg++;
+
+            if (strcmp(argv[arg], "rpc") == 0)
+                cli_mode = RPC_MODE;
+            else if (strcmp(argv[arg], "rpcdata") == 0)
+                cli_mode = RPCDATA_MODE;
+            else {
+                fprintf(stderr, "expected mode \"rpc\" or \"rpcdata\", "
+                        "got %s\n", argv[arg]);
+                usage();
+                exit(1);
+            }
+            arg++;
+
+            if (arg+1 >= argc) {
+                usage();
+                exit(1);
+            }
+
+            /* the rest are servers */
+            info_str = argv[arg++];
+            run_client(rdma_size, info_str, &argv[arg], argc - arg);
+            break;
+
+        case SERVER:
+            if (arg >= argc) {
+                usage();
+                exit(1);
+            }
+            if (isdigit(argv[arg][0]))
+                num_clients = atoi(argv[arg]);
+            else {
+                fprintf(stderr, "error: num_clients non a number\n");
+                usage();
+                exit(1);
+            }
+            arg++;
+            if (arg >= argc) {
+                usage();
+                exit(1);
+            }
+            info_str = argv[arg];
+            arg++;
+            if (arg < argc)
+                svr_id = argv[arg];
+            else
+                svr_id = NULL;
+            run_server(rdma_size, info_str, svr_id, num_clients);
+            break;
+        default:
+            assert(0);
+    }
+
+    return 0;
+}
+
+
+const char * usage_str =
+"Usage: hg-ctest5 [-t TIME] [-w DEPTH] [-q QUORUM] [--fanout SPEC]\n"
+"                 (client | server) OPTIONS\n"
+"  -t is the time to run each fan-out in client mode\n"
+"  -w is the number of scatter ops each client keeps in flight (default 1)\n"
+"  -q is the number of responses counted as a quorum (default: a majority\n"
+"     of the fan-out, capped at the fan-out)\n"
+"  --fanout MIN:MAX:xF (or MIN:MAX:+STEP) runs each fan-out from MIN to MAX\n"
+"     servers (default 1:<# servers>:x2), -t seconds each\n"
+"  in client mode, OPTIONS are:\n"
+"    <rdma size> <client id> <mode> <class+protocol> <server> [<server>...]\n"
+"    where client id should be unique among all clients in this run\n"
+"    and mode is \"rpc\" (noop) or \"rpcdata\" (<rdma size> bytes each way)\n"
+"    an op with fan-out K goes to the first K servers; the first server\n"
+"    also runs the client barrier\n"
+"  in server mode, OPTIONS are:\n"
+"    <rdma size max> <num clients> <listen addr> [<id>]\n"
+"  servers spit out files named ctest-server-addr.tmp[-<id>] \n"
+"    containing their mercury names for clients to gobble up\n"
+"  Example:\n"
+"    hg-ctest5 server 4096 1 bmi+tcp://localhost:3344 a\n"
+"    hg-ctest5 server 4096 1 bmi+tcp://localhost:3345 b\n"
+"    hg-ctest5 client 4096 0 rpc bmi+tcp \\\n"
+"        $(cat ctest-server-addr.tmp-a) $(cat ctest-server-addr.tmp-b)\n";
+
+static void usage() {
+    fprintf(stderr, "%s", usage_str);
+    print_common_usage(stderr);
+}
@@ -14,6 +14,10 @@ ldpath=ldpath.txt
 # value for now
 sz=$((1<<24))
 
+# in-process size sweep (bench 1 and 4 clients, -z option), e.g.
+# 4K:16M:x2 - the server still gets $sz, which must be at least the max size
+sizes_opt=
+
 # time to wait for benchmark to complete (uncomment for unlimited waiting)
 timeout_cmd="timeout 60s"
 
@@ -59,11 +63,14 @@ server_err=$out_prefix-srv.err
 client_out=$out_prefix.out
 client_err=$out_prefix.err
 
-while getopts ":s:an:t:b:m:d:r" opt ; do
+while getopts ":s:z:an:t:b:m:d:r" opt ; do
     case $opt in
         s)
             sz=$OPTARG
             ;;
+        z)
+            sizes_opt="--sizes $OPTARG"
+            ;;
         a)
             all_opt="-a"
             ;;
@@ -164,6 +171,9 @@ function run () {
     else
         local opts="$all_opt $benchmark_timeopt"
     fi
+    if [[ $hosttype == "client" && ( $benchmark_nr == 1 || $benchmark_nr == 4 ) ]] ; then
+        opts="$opts $sizes_opt"
+    fi
 
     local prog="$timeout_cmd $mpiexec_deco ./hg-ctest$benchmark_nr $opts $hosttype $sz"
     if [[ $benchmark_nr == 4 ]] ; then
@@ -351,11 +361,39 @@ if [[ $benchmark_nr == 1 ]] ; then
 #               bulk: isolated <call> <complete>
 #                     concurrent rpc-first <call> <complete>
 #                     concurrent bulk-first <call> <complete>
+#     placement: <cpu> <numa node>
 EOF
 elif [[ $benchmark_nr == 4 ]] ; then
     cat > $client_out <<EOF
 # format: <class> <protocol> <bulk size> <bench time> <type> <id>
-#     time (s): <# calls> <call avg> <complete avg>
+#     time (s): <# calls> <call avg> <complete avg> <window depth>
+#     placement: <cpu> <numa node>
+#     server: <avg handler time of the benchmark's rpc (0 for bulk)>
+#     <elapsed s (measured part of the point)>
+# followed by latency percentile lines:
+#   <class> <protocol> <bulk size> <bench time> <type> <id | all>
+#     lat <call | complete | corrected> <# calls> <p50> <p90> <p99> <p99.9> <max>
+#     progress client <mode> <spin us> <trigger batch> <user cpu> <sys cpu>
+#     barrier <server | tree> <fanout> <start barrier wait s>
+# and, for -L runs, one line per logical client:
+#     logical <logical id> <# calls> <call avg> <complete avg> <p50> <p99> <max>
+# and, for runs over several servers, one line per server:
+#     shard <server index> <# calls> <complete avg> <p50> <p99> <p99.9> <max>
+# and, for --converge runs:
+#     converge complete <mean | pNN> <warmup ops> <ops> <batches> <estimate>
+#       <rel ci half-width> <converged (bool)>
+# and, for open-loop (-r) runs:
+#     rate <offered ops/s> <achieved ops/s> <const | poisson> <# dropped>
+# and, for chunked bulk (-c) runs of sizes above the chunk size, a "lat chunk"
+# line plus:
+#     chunk <chunk size> <in flight> <# chunks> <per-chunk bw> <end-to-end bw>
+# client 0 also prints the server's side of each point:
+#     server <# progress calls> <# callbacks> <busy s> <idle s> <bulk bytes>
+#     server rpc <name> <count> <avg handler time>
+#     barrier skew <# clients> <max - min release s> <mean - min release s>
+#       <last released client>   (on the "all" prefix)
+# rpcdata runs begin with "<class> <protocol> msg limits <unexp> <exp>"
+# sharded runs begin with "<class> <protocol> dist <dist> <# servers> <# keys> <theta>"
 EOF
 else
     cat > $client_out <<EOF
@@ -364,6 +402,8 @@ else
 #                     concurrent <# calls> <call avg> <complete avg>
 #               bulk: isolated   <# calls> <call avg> <complete avg>
 #                     concurrent <# calls> <call avg> <complete avg>
+#     placement: <cpu> <numa node> (bench 3)
+#                <rpc thread cpu> <node> <bulk thread cpu> <node> (bench 2)
 EOF
 fi
 